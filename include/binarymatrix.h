@@ -0,0 +1,396 @@
+// binarymatrix.h
+#ifndef BINARYMATRIX_H
+#define BINARYMATRIX_H
+
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <climits>
+#include <string>
+#include <stdexcept>
+#include <type_traits>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "sparsematrix.h"
+#include "sparsealgs.h"
+
+// ---memory-mapped binary container for csr, csc and bsr matrices---
+// layout: a 128-byte header followed by the three arrays of the format, each starting at a
+// multiple of SPARSE_ALIGNMENT. reopening a file maps it read-only and the Mapped* views point
+// straight into the mapping, so spMV runs on the file contents without parsing or copying.
+// all fields are stored in native byte order.
+
+const char BINARY_MATRIX_MAGIC[8] = { 'S', 'P', 'M', 'A', 'T', 'B', 'I', 'N' };
+const uint32_t BINARY_MATRIX_VERSION = 1;
+
+enum BinaryMatrixFormat : uint32_t {
+	BINARY_CSR = 1,
+	BINARY_CSC = 2,
+	BINARY_BSR = 3
+};
+
+enum BinaryValueType : uint32_t {
+	BINARY_FLOAT32 = 1,
+	BINARY_FLOAT64 = 2,
+	BINARY_INT32 = 3,
+	BINARY_INT64 = 4
+};
+
+// value type code of T
+template<typename T>
+BinaryValueType binaryValueType() {
+	static_assert(std::is_same<T, float>::value || std::is_same<T, double>::value
+		|| std::is_same<T, int32_t>::value || std::is_same<T, int64_t>::value,
+		"binary matrix values must be float, double, int32_t or int64_t");
+	if (std::is_same<T, float>::value) {
+		return BINARY_FLOAT32;
+	} else if (std::is_same<T, double>::value) {
+		return BINARY_FLOAT64;
+	} else if (std::is_same<T, int32_t>::value) {
+		return BINARY_INT32;
+	}
+	return BINARY_INT64;
+}
+
+// fixed 128-byte file header
+// csr: arrays are rowptr, col, data; csc: colptr, row, data; bsr: blockRowptr, blockCol, data
+struct BinaryMatrixHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t format;        // BinaryMatrixFormat
+	uint32_t indexBytes;    // width of the index arrays
+	uint32_t valueType;     // BinaryValueType
+	int64_t rows;
+	int64_t cols;
+	int64_t nnz;            // non-zero elements, or non-zero blocks for bsr
+	int64_t blockSize;      // 1 for csr and csc
+	uint64_t offset[3];     // byte offsets of the three arrays
+	uint64_t length[3];     // number of elements of the three arrays
+	uint64_t fileSize;
+	uint64_t reserved[2];   // zero
+};
+static_assert(sizeof(BinaryMatrixHeader) == 128, "binary matrix header must be 128 bytes");
+
+// write header and arrays (each padded to SPARSE_ALIGNMENT) to path
+template<typename T>
+void writeBinaryMatrix(const std::string &path, BinaryMatrixFormat format, int64_t rows, int64_t cols,
+		int64_t nnz, int64_t blockSize, const int *ptr, uint64_t ptrLength, const int *idx, uint64_t idxLength,
+		const T *data, uint64_t dataLength) {
+	BinaryMatrixHeader h;
+	std::memset(&h, 0, sizeof(h));
+	std::memcpy(h.magic, BINARY_MATRIX_MAGIC, sizeof(h.magic));
+	h.version = BINARY_MATRIX_VERSION;
+	h.format = format;
+	h.indexBytes = sizeof(int);
+	h.valueType = binaryValueType<T>();
+	h.rows = rows;
+	h.cols = cols;
+	h.nnz = nnz;
+	h.blockSize = blockSize;
+
+	const void *arrays[3] = { ptr, idx, data };
+	uint64_t bytes[3] = { ptrLength * sizeof(int), idxLength * sizeof(int), dataLength * sizeof(T) };
+	h.length[0] = ptrLength;
+	h.length[1] = idxLength;
+	h.length[2] = dataLength;
+	uint64_t pos = sizeof(h);
+	for (int a = 0; a < 3; a++) {
+		pos = (pos + SPARSE_ALIGNMENT - 1) / SPARSE_ALIGNMENT * SPARSE_ALIGNMENT;
+		h.offset[a] = pos;
+		pos += bytes[a];
+	}
+	h.fileSize = pos;
+
+	FILE *f = std::fopen(path.c_str(), "wb");
+	if (f == nullptr) {
+		throw std::runtime_error("writeBinaryMatrix: cannot open " + path);
+	}
+	bool ok = std::fwrite(&h, sizeof(h), 1, f) == 1;
+	static const char zeros[SPARSE_ALIGNMENT] = {};
+	pos = sizeof(h);
+	for (int a = 0; a < 3 && ok; a++) {
+		ok = std::fwrite(zeros, 1, h.offset[a] - pos, f) == h.offset[a] - pos;
+		ok = ok && (bytes[a] == 0 || std::fwrite(arrays[a], 1, bytes[a], f) == bytes[a]);
+		pos = h.offset[a] + bytes[a];
+	}
+	ok = (std::fclose(f) == 0) && ok;
+	if (!ok) {
+		throw std::runtime_error("writeBinaryMatrix: error while writing " + path);
+	}
+}
+
+// save a csr matrix in the binary container
+template<typename T>
+void saveBinaryMatrix(const std::string &path, const DynSparseCSR<T> &csr) {
+	writeBinaryMatrix(path, BINARY_CSR, csr.rows, csr.cols, csr.nnz, 1, csr.rowptr.get(), csr.rows + 1,
+		csr.col.get(), csr.nnz, csr.data.get(), csr.nnz);
+}
+
+// save a csc matrix in the binary container
+template<typename T>
+void saveBinaryMatrix(const std::string &path, const DynSparseCSC<T> &csc) {
+	writeBinaryMatrix(path, BINARY_CSC, csc.rows, csc.cols, csc.nnz, 1, csc.colptr.get(), csc.cols + 1,
+		csc.row.get(), csc.nnz, csc.data.get(), csc.nnz);
+}
+
+// save a bsr matrix in the binary container
+template<typename T>
+void saveBinaryMatrix(const std::string &path, const DynSparseBSR<T> &bsr) {
+	writeBinaryMatrix(path, BINARY_BSR, bsr.rows, bsr.cols, bsr.nnzBlocks, bsr.blockSize, bsr.blockRowptr.get(),
+		bsr.blockRowptr.size(), bsr.blockCol.get(), bsr.nnzBlocks, bsr.data.get(), bsr.data.size());
+}
+
+// read-only mapping of a binary matrix file, validated against the expected format and value type:
+// the array lengths must match the dimensions and the pointer array must run from 0 to nnz.
+// the column (row for csc) indices are only range-checked with checkIndices, an O(nnz) pass over the
+// file; without it they are trusted, and a corrupted file makes spMV read or write out of bounds.
+// move-only; the mapping is released when the object is destroyed
+class BinaryMatrixFile {
+public:
+	BinaryMatrixFile() : base(nullptr), size(0) {}
+
+	// map path; populate pre-faults all pages instead of loading them on first touch,
+	// checkIndices also validates every index of the second array
+	BinaryMatrixFile(const std::string &path, BinaryMatrixFormat format, BinaryValueType valueType,
+			bool populate = false, bool checkIndices = false) : base(nullptr), size(0) {
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) {
+			throw std::runtime_error("BinaryMatrixFile: cannot open " + path);
+		}
+		struct stat st;
+		if (::fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(BinaryMatrixHeader)) {
+			::close(fd);
+			throw std::runtime_error("BinaryMatrixFile: " + path + " is too small for a binary matrix");
+		}
+		size = st.st_size;
+		void *p = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE | (populate ? MAP_POPULATE : 0), fd, 0);
+		::close(fd);
+		if (p == MAP_FAILED) {
+			throw std::runtime_error("BinaryMatrixFile: cannot map " + path);
+		}
+		base = static_cast<const char *>(p);
+
+		const char *error = validate(format, valueType);
+		if (error == nullptr && checkIndices) {
+			error = validateIndices(format);
+		}
+		if (error != nullptr) {
+			::munmap(const_cast<char *>(base), size);
+			base = nullptr;
+			throw std::runtime_error("BinaryMatrixFile: " + path + " " + error);
+		}
+	}
+
+	BinaryMatrixFile(const BinaryMatrixFile &) = delete;
+	BinaryMatrixFile &operator=(const BinaryMatrixFile &) = delete;
+
+	BinaryMatrixFile(BinaryMatrixFile &&other) noexcept : base(other.base), size(other.size) {
+		other.base = nullptr;
+		other.size = 0;
+	}
+
+	BinaryMatrixFile &operator=(BinaryMatrixFile &&other) noexcept {
+		if (this != &other) {
+			release();
+			base = other.base;
+			size = other.size;
+			other.base = nullptr;
+			other.size = 0;
+		}
+		return *this;
+	}
+
+	~BinaryMatrixFile() {
+		release();
+	}
+
+	const BinaryMatrixHeader &header() const {
+		return *reinterpret_cast<const BinaryMatrixHeader *>(base);
+	}
+
+	// pointer to array a (0, 1 or 2) of the file
+	template<typename A>
+	const A *array(int a) const {
+		return reinterpret_cast<const A *>(base + header().offset[a]);
+	}
+
+private:
+	const char *validate(BinaryMatrixFormat format, BinaryValueType valueType) const {
+		const BinaryMatrixHeader &h = header();
+		if (std::memcmp(h.magic, BINARY_MATRIX_MAGIC, sizeof(h.magic)) != 0) {
+			return "is not a binary matrix";
+		}
+		if (h.version != BINARY_MATRIX_VERSION) {
+			return "has an unsupported version";
+		}
+		if (h.format != format) {
+			return "holds a different sparse format";
+		}
+		if (h.indexBytes != sizeof(int)) {
+			return "has an unsupported index width";
+		}
+		if (h.valueType != valueType) {
+			return "holds a different value type";
+		}
+		if (h.fileSize != size) {
+			return "is truncated";
+		}
+		if (h.rows < 0 || h.rows > INT_MAX || h.cols < 0 || h.cols > INT_MAX || h.nnz < 0 || h.nnz > INT_MAX) {
+			return "has dimensions outside the int range";
+		}
+		if (format == BINARY_BSR ? (h.blockSize < 1 || h.blockSize > INT_MAX) : h.blockSize != 1) {
+			return "has an invalid block size";
+		}
+
+		// the array lengths follow from the dimensions, every value fits in 64 bits after the checks above
+		const uint64_t bs = (uint64_t) h.blockSize;
+		const uint64_t ptrLength = format == BINARY_CSR ? (uint64_t) h.rows + 1
+			: format == BINARY_CSC ? (uint64_t) h.cols + 1 : ((uint64_t) h.rows + bs - 1) / bs + 1;
+		if (h.length[0] != ptrLength || h.length[1] != (uint64_t) h.nnz
+				|| (bs > (uint64_t) INT_MAX / bs) || h.length[2] != (uint64_t) h.nnz * bs * bs) {
+			return "has array lengths that do not match its dimensions";
+		}
+
+		// offset + length * elementBytes <= size, written so that nothing overflows
+		uint64_t elementBytes[3] = { h.indexBytes, h.indexBytes, 0 };
+		elementBytes[2] = (valueType == BINARY_FLOAT32 || valueType == BINARY_INT32) ? 4 : 8;
+		for (int a = 0; a < 3; a++) {
+			if (h.offset[a] % SPARSE_ALIGNMENT != 0 || h.offset[a] > size
+					|| h.length[a] > (size - h.offset[a]) / elementBytes[a]) {
+				return "has an array outside the file";
+			}
+		}
+
+		// the pointer array bounds every access to the other two; it is short, so it is checked in
+		// full (the column/row indices are left to validateIndices, they span the whole file)
+		const int *ptr = reinterpret_cast<const int *>(base + h.offset[0]);
+		if (ptr[0] != 0 || ptr[ptrLength - 1] != h.nnz) {
+			return "has a pointer array that does not span the non-zero elements";
+		}
+		for (uint64_t i = 0; i + 1 < ptrLength; i++) {
+			if (ptr[i] > ptr[i + 1]) {
+				return "has a decreasing pointer array";
+			}
+		}
+		return nullptr;
+	}
+
+	// every column index of csr, row index of csc or block column of bsr lies inside the matrix.
+	// only called after validate, so the header and the array bounds can be trusted
+	const char *validateIndices(BinaryMatrixFormat format) const {
+		const BinaryMatrixHeader &h = header();
+		const int64_t limit = format == BINARY_CSR ? h.cols : format == BINARY_CSC ? h.rows
+			: (h.cols + h.blockSize - 1) / h.blockSize;
+		const int *idx = reinterpret_cast<const int *>(base + h.offset[1]);
+		for (uint64_t k = 0; k < h.length[1]; k++) {
+			if (idx[k] < 0 || idx[k] >= limit) {
+				return "has an index outside the matrix";
+			}
+		}
+		return nullptr;
+	}
+
+	void release() {
+		if (base != nullptr) {
+			::munmap(const_cast<char *>(base), size);
+			base = nullptr;
+		}
+	}
+
+	const char *base;
+	size_t size;
+};
+
+// read-only csr view of a memory-mapped binary matrix file
+template<typename T>
+class MappedSparseCSR {
+public:
+	explicit MappedSparseCSR(const std::string &path, bool populate = false, bool checkIndices = false)
+		: file(path, BINARY_CSR, binaryValueType<T>(), populate, checkIndices),
+		  rows((int) file.header().rows), cols((int) file.header().cols), nnz((int) file.header().nnz),
+		  rowptr(file.array<int>(0)), col(file.array<int>(1)), data(file.array<T>(2)) {}
+
+private:
+	BinaryMatrixFile file;
+
+public:
+	int rows;
+	int cols;
+	int nnz;
+	const int *rowptr;
+	const int *col;
+	const T *data;
+};
+
+// read-only csc view of a memory-mapped binary matrix file
+template<typename T>
+class MappedSparseCSC {
+public:
+	explicit MappedSparseCSC(const std::string &path, bool populate = false, bool checkIndices = false)
+		: file(path, BINARY_CSC, binaryValueType<T>(), populate, checkIndices),
+		  rows((int) file.header().rows), cols((int) file.header().cols), nnz((int) file.header().nnz),
+		  colptr(file.array<int>(0)), row(file.array<int>(1)), data(file.array<T>(2)) {}
+
+private:
+	BinaryMatrixFile file;
+
+public:
+	int rows;
+	int cols;
+	int nnz;
+	const int *colptr;
+	const int *row;
+	const T *data;
+};
+
+// read-only bsr view of a memory-mapped binary matrix file
+template<typename T>
+class MappedSparseBSR {
+public:
+	explicit MappedSparseBSR(const std::string &path, bool populate = false, bool checkIndices = false)
+		: file(path, BINARY_BSR, binaryValueType<T>(), populate, checkIndices),
+		  rows((int) file.header().rows), cols((int) file.header().cols),
+		  blockSize((int) file.header().blockSize), nnzBlocks((int) file.header().nnz),
+		  blockRowptr(file.array<int>(0)), blockCol(file.array<int>(1)), data(file.array<T>(2)) {}
+
+private:
+	BinaryMatrixFile file;
+
+public:
+	int rows;
+	int cols;
+	int blockSize;
+	int nnzBlocks;
+	const int *blockRowptr;
+	const int *blockCol;
+	const T *data;
+};
+
+// multiply memory-mapped CSR sparse matrix with dense vector and store results in outVector
+template<typename T>
+void spMV(const MappedSparseCSR<T> &csr, const T *inVector, T *outVector) {
+	csrSpMVRows(csr.rowptr, csr.col, csr.data, inVector, outVector, 0, csr.rows);
+}
+
+// multithreaded spMV on a memory-mapped CSR sparse matrix
+template<typename T>
+void parallelSpMV(const MappedSparseCSR<T> &csr, const T *inVector, T *outVector,
+		const RowPartition &partition, ThreadPool &pool) {
+	csrParallelSpMV(csr.rowptr, csr.col, csr.data, inVector, outVector, partition, pool);
+}
+
+// multiply memory-mapped CSC sparse matrix with dense vector and store results in outVector
+template<typename T>
+void spMV(const MappedSparseCSC<T> &csc, const T *inVector, T *outVector) {
+	cscSpMV(csc.rows, csc.cols, csc.colptr, csc.row, csc.data, inVector, outVector);
+}
+
+// multiply memory-mapped BSR sparse matrix with dense vector
+template<typename T>
+void spMV(const MappedSparseBSR<T> &bsr, const T *inVector, T *outVector) {
+	bsrSpMV(bsr.rows, bsr.cols, bsr.blockSize, bsr.blockRowptr, bsr.blockCol, bsr.data, inVector, outVector);
+}
+
+#endif // BINARYMATRIX_H
@@ -0,0 +1,371 @@
+// formatselect.h
+#ifndef FORMATSELECT_H
+#define FORMATSELECT_H
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "sparsematrix.h"
+#include "sparsealgs.h"
+#include "sparseconvert.h"
+#include "parallel.h"
+
+// ---structure statistics and spMV format selection for runtime-sized matrices---
+
+// BSR block sizes considered by the analyzer and the selector
+const int SELECT_BLOCK_SIZES[] = {2, 3, 4, 8};
+const int SELECT_NUM_BLOCK_SIZES = 4;
+
+// structure statistics of a matrix, computed in O(nnz + rows + cols)
+struct MatrixStats {
+	int rows;
+	int cols;
+	int nnz;
+	double rowMean;
+	double rowVariance;
+	int rowMax;
+	bool symmetric;				// square, with equal values at (i, j) and (j, i)
+	double blockFill[SELECT_NUM_BLOCK_SIZES];	// nnz / stored elements of BSR with SELECT_BLOCK_SIZES[k]
+	double ellOverhead;			// stored elements of ELL (rows * rowMax) / nnz
+	int numDiags;				// occupied diagonals
+	double diaFill;				// stored elements of DIA / nnz
+};
+
+// fraction of the stored elements of BSR with blockSize that are non-zero
+template<typename T>
+double bsrBlockFill(const DynSparseCSR<T> &csr, int blockSize) {
+	const int blockRows = (csr.rows + blockSize - 1) / blockSize;
+	std::vector<int> marker((csr.cols + blockSize - 1) / blockSize, -1);
+	long blocks = 0;
+	for (int i = 0; i < blockRows; i++) {
+		for (int j = csr.rowptr[i * blockSize]; j < csr.rowptr[std::min(csr.rows, (i + 1) * blockSize)]; j++) {
+			int bc = csr.col[j] / blockSize;
+			if (marker[bc] != i) {
+				marker[bc] = i;
+				blocks += 1;
+			}
+		}
+	}
+	return blocks > 0 ? (double) csr.nnz / ((double) blocks * blockSize * blockSize) : 0;
+}
+
+// the symmetry test compares the arrays with those of the transpose, whose rows come out sorted and
+// duplicate-free, so it requires csr rows with sorted, duplicate-free columns (as built by buildCSR
+// or cooToCSR); other matrices are reported unsymmetric
+template<typename T>
+MatrixStats analyzeMatrix(const DynSparseCSR<T> &csr, int numThreads = defaultNumThreads()) {
+	MatrixStats stats = {};
+	stats.rows = csr.rows;
+	stats.cols = csr.cols;
+	stats.nnz = csr.nnz;
+	stats.rowMean = csr.rows > 0 ? (double) csr.nnz / csr.rows : 0;
+	double squares = 0;
+	for (int i = 0; i < csr.rows; i++) {
+		int len = csr.rowptr[i + 1] - csr.rowptr[i];
+		stats.rowMax = std::max(stats.rowMax, len);
+		squares += (len - stats.rowMean) * (len - stats.rowMean);
+	}
+	stats.rowVariance = csr.rows > 0 ? squares / csr.rows : 0;
+
+	// a matrix is symmetric when its transpose has the same arrays
+	stats.symmetric = csr.rows == csr.cols;
+	if (stats.symmetric) {
+		DynSparseCSC<T> transpose = csrToCSC(csr, numThreads);
+		stats.symmetric = std::equal(csr.rowptr.get(), csr.rowptr.get() + csr.rows + 1, transpose.colptr.get())
+			&& std::equal(csr.col.get(), csr.col.get() + csr.nnz, transpose.row.get())
+			&& std::equal(csr.data.get(), csr.data.get() + csr.nnz, transpose.data.get());
+	}
+
+	for (int k = 0; k < SELECT_NUM_BLOCK_SIZES; k++) {
+		stats.blockFill[k] = bsrBlockFill(csr, SELECT_BLOCK_SIZES[k]);
+	}
+	stats.ellOverhead = csr.nnz > 0 ? (double) csr.rows * stats.rowMax / csr.nnz : 0;
+	DIAReport dia = analyzeDiagonals(csr);
+	stats.numDiags = dia.numDiags;
+	stats.diaFill = dia.fill;
+	return stats;
+}
+
+template<typename T>
+MatrixStats analyzeMatrix(const DynSparseCOO<T> &coo, int numThreads = defaultNumThreads()) {
+	return analyzeMatrix(cooToCSR(coo, numThreads), numThreads);
+}
+
+inline std::ostream &operator<<(std::ostream &os, const MatrixStats &stats) {
+	os << stats.rows << " x " << stats.cols << ", nnz = " << stats.nnz << "\n";
+	os << "row length: mean = " << stats.rowMean << ", variance = " << stats.rowVariance << ", max = " << stats.rowMax << "\n";
+	os << "symmetric = " << (stats.symmetric ? "yes" : "no") << "\n";
+	os << "bsr block fill:";
+	for (int k = 0; k < SELECT_NUM_BLOCK_SIZES; k++) {
+		os << " " << SELECT_BLOCK_SIZES[k] << "x" << SELECT_BLOCK_SIZES[k] << " = " << stats.blockFill[k];
+	}
+	os << "\nell overhead = " << stats.ellOverhead << ", diagonals = " << stats.numDiags << " (fill " << stats.diaFill << ")\n";
+	return os;
+}
+
+enum SpMVFormat {FORMAT_CSR, FORMAT_BSR, FORMAT_ELL, FORMAT_TJDS, FORMAT_SSS};
+
+inline const char *formatName(SpMVFormat format) {
+	static const char *names[] = {"CSR", "BSR", "ELL", "TJDS", "SSS"};
+	return names[format];
+}
+
+// a format with its parameters; seconds is the measured spMV time (0 when predicted)
+struct FormatChoice {
+	SpMVFormat format;
+	int blockSize;
+	int threads;
+	double seconds;
+};
+
+// a matrix converted to the chosen format, with the thread pool and partition its spMV needs.
+// only the member of the chosen format is filled
+template<typename T>
+class SelectedMatrix {
+public:
+	SelectedMatrix() : choice({FORMAT_CSR, 1, 1, 0}) {}
+
+	SelectedMatrix(const DynSparseCSR<T> &matrix, FormatChoice choice) : choice(choice) {
+		switch (choice.format) {
+		case FORMAT_BSR:
+			bsr = csrToBSR(matrix, choice.blockSize);
+			break;
+		case FORMAT_ELL:
+			ell = csrToELL(matrix);
+			break;
+		case FORMAT_TJDS:
+			tjds = csrToTJDS(matrix);
+			break;
+		case FORMAT_SSS:
+			sss = csrToSSS(matrix);
+			break;
+		default:
+			csr = DynSparseCSR<T>(matrix.rows, matrix.cols, matrix.nnz);
+			std::copy(matrix.rowptr.get(), matrix.rowptr.get() + matrix.rows + 1, csr.rowptr.get());
+			std::copy(matrix.col.get(), matrix.col.get() + matrix.nnz, csr.col.get());
+			std::copy(matrix.data.get(), matrix.data.get() + matrix.nnz, csr.data.get());
+		}
+		setThreads(choice.threads);
+	}
+
+	// threads for the formats with a parallel spMV (CSR, TJDS, SSS), the others always run on one
+	void setThreads(int threads) {
+		bool parallel = choice.format == FORMAT_CSR || choice.format == FORMAT_TJDS || choice.format == FORMAT_SSS;
+		choice.threads = parallel ? std::max(1, threads) : 1;
+		pool.reset(choice.threads > 1 ? new ThreadPool(choice.threads) : nullptr);
+		if (choice.format == FORMAT_CSR) {
+			rowPartition = RowPartition(csr, choice.threads);
+		} else if (choice.format == FORMAT_TJDS) {
+			tjdsPartition = TJDSPartition<T>(tjds, choice.threads);
+		} else if (choice.format == FORMAT_SSS) {
+			sssPartition = SSSPartition<T>(sss, choice.threads);
+		}
+	}
+
+	FormatChoice choice;
+	DynSparseCSR<T> csr;
+	DynSparseBSR<T> bsr;
+	DynSparseELL<T> ell;
+	DynSparseTJDS<T> tjds;
+	DynSparseSSS<T> sss;
+	RowPartition rowPartition;
+	TJDSPartition<T> tjdsPartition;
+	SSSPartition<T> sssPartition;
+	std::unique_ptr<ThreadPool> pool;
+};
+
+// spMV in the selected format (inVector in the original column order for every format)
+template<typename T>
+void spMV(SelectedMatrix<T> &m, const T *inVector, T *outVector) {
+	switch (m.choice.format) {
+	case FORMAT_BSR:
+		spMV(m.bsr, inVector, outVector);
+		break;
+	case FORMAT_ELL:
+		spMV(m.ell, inVector, outVector);
+		break;
+	case FORMAT_TJDS:
+		if (m.pool) {
+			parallelSpMV(m.tjds, inVector, outVector, m.tjdsPartition, *m.pool);
+		} else {
+			spMV(m.tjds, inVector, outVector);
+		}
+		break;
+	case FORMAT_SSS:
+		if (m.pool) {
+			parallelSpMV(m.sss, inVector, outVector, m.sssPartition, *m.pool);
+		} else {
+			spMV(m.sss, inVector, outVector);
+		}
+		break;
+	default:
+		if (m.pool) {
+			parallelSpMV(m.csr, inVector, outVector, m.rowPartition, *m.pool);
+		} else {
+			spMV(m.csr, inVector, outVector);
+		}
+	}
+}
+
+// 64-bit fingerprint of the dimensions, pattern and values of a csr matrix (FNV-1a over 64-bit words)
+template<typename T>
+uint64_t matrixFingerprint(const DynSparseCSR<T> &csr) {
+	uint64_t h = 0xCBF29CE484222325ULL;
+	auto mix = [&](uint64_t word) {
+		h ^= word;
+		h *= 0x100000001B3ULL;
+	};
+	auto mixBytes = [&](const void *bytes, size_t n) {
+		const unsigned char *p = static_cast<const unsigned char *>(bytes);
+		size_t k = 0;
+		for (; k + 8 <= n; k += 8) {
+			uint64_t word;
+			std::memcpy(&word, p + k, 8);
+			mix(word);
+		}
+		uint64_t tail = 0;
+		std::memcpy(&tail, p + k, n - k);
+		mix(tail);
+	};
+	mix((uint64_t) csr.rows);
+	mix((uint64_t) csr.cols);
+	mix((uint64_t) csr.nnz);
+	mixBytes(csr.rowptr.get(), (size_t) (csr.rows + 1) * sizeof(int));
+	mixBytes(csr.col.get(), (size_t) csr.nnz * sizeof(int));
+	mixBytes(csr.data.get(), (size_t) csr.nnz * sizeof(T));
+	return h;
+}
+
+// persistent map from matrix fingerprints to format choices, kept in a text file with one
+// "key format blockSize threads seconds" line per matrix. the key mixes the fingerprint with the
+// hardware thread count, so a cache copied to another machine does not apply its choices there,
+// and with the thread limit of the selection, so a choice made for 1 thread is not reused for 8
+class FormatCache {
+public:
+	explicit FormatCache(const std::string &path) : path(path) {
+		std::ifstream file(path);
+		uint64_t fingerprint;
+		int format;
+		FormatChoice choice;
+		while (file >> fingerprint >> format >> choice.blockSize >> choice.threads >> choice.seconds) {
+			if (format >= FORMAT_CSR && format <= FORMAT_SSS) {
+				choice.format = (SpMVFormat) format;
+				choices[fingerprint] = choice;
+			}
+		}
+	}
+
+	bool lookup(uint64_t fingerprint, int maxThreads, FormatChoice &choice) const {
+		auto it = choices.find(key(fingerprint, maxThreads));
+		if (it == choices.end()) {
+			return false;
+		}
+		choice = it->second;
+		return true;
+	}
+
+	// adds the choice to the file right away
+	void store(uint64_t fingerprint, int maxThreads, const FormatChoice &choice) {
+		choices[key(fingerprint, maxThreads)] = choice;
+		std::ofstream file(path, std::ios::app);
+		file << key(fingerprint, maxThreads) << " " << (int) choice.format << " " << choice.blockSize << " " << choice.threads << " "
+			<< choice.seconds << "\n";
+	}
+
+private:
+	static uint64_t key(uint64_t fingerprint, int maxThreads) {
+		uint64_t h = (fingerprint ^ (uint64_t) defaultNumThreads()) * 0x9E3779B97F4A7C15ULL;
+		return (h ^ (uint64_t) maxThreads) * 0x9E3779B97F4A7C15ULL;
+	}
+
+	std::string path;
+	std::map<uint64_t, FormatChoice> choices;
+};
+
+// repetitions of every candidate in the selection micro-benchmark
+const int SELECT_REPS = 5;
+
+// median time of SELECT_REPS spMV calls, after one warm-up call
+template<typename T>
+double timeSpMV(SelectedMatrix<T> &m, const T *inVector, T *outVector) {
+	spMV(m, inVector, outVector);
+	std::vector<double> times(SELECT_REPS);
+	for (double &t : times) {
+		auto start = std::chrono::steady_clock::now();
+		spMV(m, inVector, outVector);
+		t = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+	std::sort(times.begin(), times.end());
+	return times[SELECT_REPS / 2];
+}
+
+// fastest spMV format and thread count for this matrix on this machine.
+// candidates ruled out by the statistics are skipped (ELL with more than twice the storage of csr,
+// BSR block sizes less than half full, SSS for unsymmetric matrices); the rest are converted and
+// timed for 1, 2, 4, ... up to maxThreads threads where they have a parallel kernel.
+// with a cache, a matrix that was seen before is converted to its stored choice without timing,
+// and a new choice is stored
+template<typename T>
+SelectedMatrix<T> selectFormat(const DynSparseCSR<T> &csr, FormatCache *cache = nullptr,
+		int maxThreads = defaultNumThreads()) {
+	uint64_t fingerprint = 0;
+	FormatChoice best;
+	if (cache != nullptr) {
+		fingerprint = matrixFingerprint(csr);
+		if (cache->lookup(fingerprint, maxThreads, best)) {
+			return SelectedMatrix<T>(csr, best);
+		}
+	}
+
+	MatrixStats stats = analyzeMatrix(csr);
+	std::vector<FormatChoice> candidates = {{FORMAT_CSR, 1, 1, 0}, {FORMAT_TJDS, 1, 1, 0}};
+	if (stats.symmetric) {
+		candidates.push_back({FORMAT_SSS, 1, 1, 0});
+	}
+	if (stats.ellOverhead <= 2) {
+		candidates.push_back({FORMAT_ELL, 1, 1, 0});
+	}
+	for (int k = 0; k < SELECT_NUM_BLOCK_SIZES; k++) {
+		if (stats.blockFill[k] >= 0.5) {
+			candidates.push_back({FORMAT_BSR, SELECT_BLOCK_SIZES[k], 1, 0});
+		}
+	}
+
+	std::vector<T> inVector(csr.cols, T(1));
+	std::vector<T> outVector(csr.rows);
+	best = {FORMAT_CSR, 1, 1, INFINITY};
+	for (const FormatChoice &candidate : candidates) {
+		SelectedMatrix<T> m(csr, candidate);
+		bool parallel = candidate.format != FORMAT_BSR && candidate.format != FORMAT_ELL;
+		for (int t = 1; ; t = std::min(2 * t, maxThreads)) {
+			m.setThreads(t);
+			double seconds = timeSpMV(m, inVector.data(), outVector.data());
+			if (seconds < best.seconds) {
+				best = m.choice;
+				best.seconds = seconds;
+			}
+			if (!parallel || t >= maxThreads) {
+				break;
+			}
+		}
+	}
+
+	if (cache != nullptr) {
+		cache->store(fingerprint, maxThreads, best);
+	}
+	return SelectedMatrix<T>(csr, best);
+}
+
+template<typename T>
+SelectedMatrix<T> selectFormat(const DynSparseCOO<T> &coo, FormatCache *cache = nullptr,
+		int maxThreads = defaultNumThreads()) {
+	return selectFormat(cooToCSR(coo), cache, maxThreads);
+}
+
+#endif // FORMATSELECT_H
@@ -0,0 +1,523 @@
+// matrixmarket.h
+#ifndef MATRIXMARKET_H
+#define MATRIXMARKET_H
+
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+#include <charconv>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <limits>
+#include <type_traits>
+#include "sparsematrix.h"
+#include "sparsebuild.h"
+#include "parallel.h"
+
+// ---Matrix Market (.mtx) reader and writer---
+// supports the coordinate and array formats with real, integer and pattern fields
+// and general, symmetric and skew-symmetric symmetry (complex and hermitian are not supported).
+// the file is streamed in large chunks; every chunk is split at line boundaries and parsed
+// in parallel with a hand-written integer parser and std::from_chars for values.
+
+// size of the chunks a matrix market file is read in
+const size_t MM_CHUNK_SIZE = 32 << 20;
+
+// header (banner and size line) of a matrix market file
+struct MatrixMarketHeader {
+	bool coordinate;  // coordinate (sparse) or array (dense, column-major) format
+	bool pattern;     // no values stored, every entry is 1
+	bool integer;     // integer rather than real values
+	bool symmetric;   // only the lower triangle is stored, the upper one mirrors it
+	bool skew;        // skew-symmetric: the upper triangle is the negated lower one
+	int rows;
+	int cols;
+	long entries;     // number of stored entries (values, for the array format)
+};
+
+// what to do with the entries of a symmetric file
+enum MatrixMarketSymmetry {
+	MM_EXPAND,  // mirror every off-diagonal entry, giving the full matrix
+	MM_LOWER    // keep only the lower triangle (and diagonal), as stored in SSS
+};
+
+inline const char *mmSkipBlanks(const char *p, const char *end) {
+	while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) {
+		p++;
+	}
+	return p;
+}
+
+// parse a non-negative decimal integer, returns nullptr if there is none or it does not fit in long
+inline const char *mmParseIndex(const char *p, const char *end, long &out) {
+	p = mmSkipBlanks(p, end);
+	if (p == end || *p < '0' || *p > '9') {
+		return nullptr;
+	}
+	long val = 0;
+	while (p < end && *p >= '0' && *p <= '9') {
+		if (val > (std::numeric_limits<long>::max() - (*p - '0')) / 10) {
+			return nullptr;
+		}
+		val = val * 10 + (*p - '0');
+		p++;
+	}
+	out = val;
+	return p;
+}
+
+// parse a real value, returns nullptr if there is none
+inline const char *mmParseValue(const char *p, const char *end, double &out) {
+	p = mmSkipBlanks(p, end);
+	if (p < end && *p == '+') {
+		p++;
+	}
+	std::from_chars_result res = std::from_chars(p, end, out);
+	return res.ec == std::errc() ? res.ptr : nullptr;
+}
+
+// read banner, comments and size line; leaves f at the first data line
+inline MatrixMarketHeader readMatrixMarketHeader(FILE *f, const std::string &path) {
+	std::vector<std::string> lines;
+	std::string line;
+	char buf[1024];
+	// the banner, then comment lines up to the (first non-comment) size line
+	while (std::fgets(buf, sizeof(buf), f) != nullptr) {
+		line += buf;
+		if (line.back() != '\n' && !std::feof(f)) {
+			continue;
+		}
+		bool isComment = line[0] == '%';
+		bool isBlank = line.find_first_not_of(" \t\r\n") == std::string::npos;
+		if (lines.empty() || isComment) {
+			lines.push_back(line);
+		} else if (!isBlank) {
+			lines.push_back(line);
+			break;
+		}
+		line.clear();
+	}
+	if (lines.size() < 2) {
+		throw std::runtime_error("readMatrixMarket: " + path + " is missing its banner or size line");
+	}
+
+	char object[64] = "", format[64] = "", field[64] = "", symmetry[64] = "";
+	if (std::sscanf(lines[0].c_str(), "%%%%MatrixMarket %63s %63s %63s %63s", object, format, field, symmetry) != 4) {
+		throw std::runtime_error("readMatrixMarket: " + path + " has no %%MatrixMarket banner");
+	}
+	for (char *s : { object, format, field, symmetry }) {
+		for (; *s; s++) {
+			*s = (char) std::tolower((unsigned char) *s);
+		}
+	}
+
+	MatrixMarketHeader h;
+	h.coordinate = std::strcmp(format, "coordinate") == 0;
+	h.pattern = std::strcmp(field, "pattern") == 0;
+	h.integer = std::strcmp(field, "integer") == 0;
+	h.symmetric = std::strcmp(symmetry, "symmetric") == 0 || std::strcmp(symmetry, "skew-symmetric") == 0;
+	h.skew = std::strcmp(symmetry, "skew-symmetric") == 0;
+	if (std::strcmp(object, "matrix") != 0 || (!h.coordinate && std::strcmp(format, "array") != 0)) {
+		throw std::runtime_error("readMatrixMarket: " + path + " is not a coordinate or array matrix");
+	}
+	if (!h.pattern && !h.integer && std::strcmp(field, "real") != 0 && std::strcmp(field, "double") != 0) {
+		throw std::runtime_error("readMatrixMarket: unsupported field \"" + std::string(field) + "\" in " + path);
+	}
+	if (!h.symmetric && std::strcmp(symmetry, "general") != 0) {
+		throw std::runtime_error("readMatrixMarket: unsupported symmetry \"" + std::string(symmetry) + "\" in " + path);
+	}
+	if (h.pattern && !h.coordinate) {
+		throw std::runtime_error("readMatrixMarket: pattern field requires coordinate format in " + path);
+	}
+
+	long rows = 0, cols = 0, entries = 0;
+	const std::string &sizeLine = lines.back();
+	const char *p = mmParseIndex(sizeLine.data(), sizeLine.data() + sizeLine.size(), rows);
+	p = p ? mmParseIndex(p, sizeLine.data() + sizeLine.size(), cols) : nullptr;
+	if (p && h.coordinate) {
+		p = mmParseIndex(p, sizeLine.data() + sizeLine.size(), entries);
+	}
+	if (!p) {
+		throw std::runtime_error("readMatrixMarket: malformed size line in " + path);
+	}
+	if (h.symmetric && rows != cols) {
+		throw std::runtime_error("readMatrixMarket: symmetric matrix in " + path + " is not square");
+	}
+	if (rows < 0 || cols < 0 || entries < 0) {
+		throw std::runtime_error("readMatrixMarket: negative size in " + path);
+	}
+	if (rows > std::numeric_limits<int>::max() || cols > std::numeric_limits<int>::max()) {
+		throw std::runtime_error("readMatrixMarket: dimensions of " + path + " do not fit in int");
+	}
+	h.rows = (int) rows;
+	h.cols = (int) cols;
+	if (!h.coordinate) {
+		// array format stores the whole matrix, or its lower triangle (strictly lower if skew)
+		entries = h.symmetric ? (h.skew ? rows * (rows - 1) / 2 : rows * (rows + 1) / 2) : rows * cols;
+	}
+	h.entries = entries;
+	return h;
+}
+
+// parse the data lines in [begin, end) of a coordinate file into 0-based triplets
+// returns the number of entries read, or -1 on a malformed line
+template<typename T>
+long parseMatrixMarketCoordinates(const char *begin, const char *end, const MatrixMarketHeader &h,
+		MatrixMarketSymmetry mode, std::vector<int> &row, std::vector<int> &col, std::vector<T> &val) {
+	long entries = 0;
+	const char *p = begin;
+	while (p < end) {
+		const char *lineEnd = static_cast<const char *>(std::memchr(p, '\n', end - p));
+		if (lineEnd == nullptr) {
+			lineEnd = end;
+		}
+		const char *q = mmSkipBlanks(p, lineEnd);
+		if (q < lineEnd && *q != '%') {
+			entries += 1;
+			long i, j;
+			double v = 1.0;
+			q = mmParseIndex(q, lineEnd, i);
+			q = q ? mmParseIndex(q, lineEnd, j) : nullptr;
+			if (q && !h.pattern) {
+				q = mmParseValue(q, lineEnd, v);
+			}
+			if (!q || i < 1 || i > h.rows || j < 1 || j > h.cols) {
+				return -1;
+			}
+			i -= 1;
+			j -= 1;
+
+			if (h.symmetric && i < j) {
+				// symmetric files store the lower triangle, but accept upper entries too
+				std::swap(i, j);
+				v = h.skew ? -v : v;
+			}
+			row.push_back((int) i);
+			col.push_back((int) j);
+			val.push_back(static_cast<T>(v));
+			if (h.symmetric && mode == MM_EXPAND && i != j) {
+				row.push_back((int) j);
+				col.push_back((int) i);
+				val.push_back(static_cast<T>(h.skew ? -v : v));
+			}
+		}
+		p = lineEnd + 1;
+	}
+	return entries;
+}
+
+// parse the values in [begin, end) of an array file
+// returns the number of values read, or -1 on a malformed line
+template<typename T>
+long parseMatrixMarketValues(const char *begin, const char *end, std::vector<T> &val) {
+	const char *p = begin;
+	while (p < end) {
+		const char *lineEnd = static_cast<const char *>(std::memchr(p, '\n', end - p));
+		if (lineEnd == nullptr) {
+			lineEnd = end;
+		}
+		const char *q = mmSkipBlanks(p, lineEnd);
+		if (q < lineEnd && *q != '%') {
+			double v;
+			if (!mmParseValue(q, lineEnd, v)) {
+				return -1;
+			}
+			val.push_back(static_cast<T>(v));
+		}
+		p = lineEnd + 1;
+	}
+	return (long) val.size();
+}
+
+// read all entries of a matrix market file as 0-based triplets, in file order.
+// symmetric files are expanded to the full matrix or reduced to their lower triangle depending on mode.
+// the result is an unsorted coo matrix (explicit zeros of array files are dropped)
+template<typename T>
+DynSparseCOO<T> readMatrixMarketTriplets(const std::string &path, MatrixMarketSymmetry mode = MM_EXPAND,
+		int numThreads = defaultNumThreads(), MatrixMarketHeader *header = nullptr) {
+	FILE *f = std::fopen(path.c_str(), "rb");
+	if (f == nullptr) {
+		throw std::runtime_error("readMatrixMarket: cannot open " + path);
+	}
+	MatrixMarketHeader h;
+	try {
+		h = readMatrixMarketHeader(f, path);
+	} catch (...) {
+		std::fclose(f);
+		throw;
+	}
+	if (header != nullptr) {
+		*header = h;
+	}
+
+	// the coo arrays are indexed by int, an expanded symmetric file holds up to twice its entries.
+	// array files are read into a buffer of all their entries first, which has the same limit
+	long capacity = (h.symmetric && mode == MM_EXPAND) ? 2 * h.entries : h.entries;
+	if ((h.coordinate ? capacity : h.entries) > std::numeric_limits<int>::max()) {
+		std::fclose(f);
+		throw std::runtime_error("readMatrixMarket: " + path + " has more entries than fit in int");
+	}
+	numThreads = std::max(1, numThreads);
+	DynSparseCOO<T> coo(h.rows, h.cols, h.coordinate ? (int) capacity : 0);
+	std::vector<T> arrayValues;
+	if (!h.coordinate) {
+		arrayValues.resize(h.entries);
+	}
+
+	std::vector<std::vector<int>> rows(numThreads), cols(numThreads);
+	std::vector<std::vector<T>> vals(numThreads);
+	std::vector<char> buffer(MM_CHUNK_SIZE);
+	size_t leftover = 0;
+	long count = 0, entries = 0;
+	bool malformed = false, tooMany = false;
+	while (!malformed && !tooMany) {
+		// refill the buffer after the incomplete last line of the previous chunk
+		size_t bytes = leftover + std::fread(buffer.data() + leftover, 1, buffer.size() - leftover, f);
+		bool last = bytes < buffer.size();
+		if (bytes == 0) {
+			break;
+		}
+		size_t chunk = bytes;
+		if (!last) {
+			const char *nl = buffer.data() + bytes;
+			while (nl > buffer.data() && nl[-1] != '\n') {
+				nl--;
+			}
+			if (nl == buffer.data()) {
+				// a single line longer than the buffer, grow it
+				leftover = bytes;
+				buffer.resize(buffer.size() * 2);
+				continue;
+			}
+			chunk = nl - buffer.data();
+		}
+
+		// split the chunk into one piece per thread at line boundaries and parse them in parallel
+		std::vector<size_t> cut(numThreads + 1, chunk);
+		cut[0] = 0;
+		for (int t = 1; t < numThreads; t++) {
+			size_t pos = std::max(cut[t - 1], chunk * t / numThreads);
+			const char *nl = static_cast<const char *>(std::memchr(buffer.data() + pos, '\n', chunk - pos));
+			cut[t] = nl ? nl - buffer.data() + 1 : chunk;
+		}
+		std::vector<long> pieceEntries(numThreads, 0);
+		parallelRun(numThreads, [&](int t) {
+			rows[t].clear();
+			cols[t].clear();
+			vals[t].clear();
+			const char *begin = buffer.data() + cut[t];
+			const char *end = buffer.data() + cut[t + 1];
+			pieceEntries[t] = h.coordinate ? parseMatrixMarketCoordinates(begin, end, h, mode, rows[t], cols[t], vals[t])
+			                          : parseMatrixMarketValues(begin, end, vals[t]);
+		});
+
+		// append the pieces in order
+		std::vector<long> offset(numThreads + 1, count);
+		for (int t = 0; t < numThreads; t++) {
+			malformed = malformed || pieceEntries[t] < 0;
+			entries += pieceEntries[t];
+			offset[t + 1] = offset[t] + (long) vals[t].size();
+		}
+		tooMany = entries > h.entries;
+		if (!malformed && !tooMany) {
+			parallelRun(numThreads, [&](int t) {
+				if (h.coordinate) {
+					std::copy(rows[t].begin(), rows[t].end(), coo.row.get() + offset[t]);
+					std::copy(cols[t].begin(), cols[t].end(), coo.col.get() + offset[t]);
+					std::copy(vals[t].begin(), vals[t].end(), coo.data.get() + offset[t]);
+				} else {
+					std::copy(vals[t].begin(), vals[t].end(), arrayValues.begin() + offset[t]);
+				}
+			});
+			count = offset[numThreads];
+		}
+
+		leftover = bytes - chunk;
+		std::memmove(buffer.data(), buffer.data() + chunk, leftover);
+		if (last) {
+			break;
+		}
+	}
+	std::fclose(f);
+	if (malformed) {
+		throw std::runtime_error("readMatrixMarket: malformed entry in " + path);
+	}
+	if (entries != h.entries) {
+		throw std::runtime_error("readMatrixMarket: " + path + " does not contain the number of entries in its size line");
+	}
+
+	if (h.coordinate) {
+		coo.nnz = (int) count;
+		return coo;
+	}
+
+	// array files are column-major; symmetric ones hold the lower triangle of every column
+	long nnz = 0;
+	for (long k = 0; k < h.entries; k++) {
+		nnz += arrayValues[k] != 0;
+	}
+	capacity = (h.symmetric && mode == MM_EXPAND) ? 2 * nnz : nnz;
+	if (capacity > std::numeric_limits<int>::max()) {
+		throw std::runtime_error("readMatrixMarket: " + path + " has more non-zero entries than fit in int");
+	}
+	DynSparseCOO<T> dense(h.rows, h.cols, (int) capacity);
+	int n = 0;
+	long k = 0;
+	for (int j = 0; j < h.cols; j++) {
+		for (int i = h.symmetric ? j + h.skew : 0; i < h.rows; i++, k++) {
+			if (arrayValues[k] == 0) {
+				continue;
+			}
+			dense.row[n] = i;
+			dense.col[n] = j;
+			dense.data[n] = arrayValues[k];
+			n += 1;
+			if (h.symmetric && mode == MM_EXPAND && i != j) {
+				dense.row[n] = j;
+				dense.col[n] = i;
+				dense.data[n] = h.skew ? -arrayValues[k] : arrayValues[k];
+				n += 1;
+			}
+		}
+	}
+	dense.nnz = n;
+	return dense;
+}
+
+// read a matrix market file into a row-major sorted coo matrix (duplicates are summed)
+template<typename T>
+DynSparseCOO<T> readMatrixMarketCOO(const std::string &path, int numThreads = defaultNumThreads()) {
+	return buildCOO(readMatrixMarketTriplets<T>(path, MM_EXPAND, numThreads), std::plus<T>(), numThreads);
+}
+
+// read a matrix market file into a csr matrix (duplicates are summed)
+template<typename T>
+DynSparseCSR<T> readMatrixMarketCSR(const std::string &path, int numThreads = defaultNumThreads()) {
+	return buildCSR(readMatrixMarketTriplets<T>(path, MM_EXPAND, numThreads), std::plus<T>(), numThreads);
+}
+
+// read a square, symmetric matrix market file into an sss matrix.
+// for a general file the lower triangle is used and the upper one is assumed to mirror it
+template<typename T>
+DynSparseSSS<T> readMatrixMarketSSS(const std::string &path, int numThreads = defaultNumThreads()) {
+	MatrixMarketHeader h;
+	DynSparseCOO<T> lower = readMatrixMarketTriplets<T>(path, MM_LOWER, numThreads, &h);
+	if (h.rows != h.cols || h.skew) {
+		throw std::runtime_error("readMatrixMarketSSS: " + path + " is not a square symmetric matrix");
+	}
+
+	// diagonal goes to dvalues, the strictly lower triangle is compressed like csr
+	DynSparseSSS<T> sss;
+	sss.n = h.rows;
+	sss.dvalues = AlignedArray<T>(h.rows);
+	std::fill(sss.dvalues.get(), sss.dvalues.get() + h.rows, T(0));
+	int strict = 0;
+	for (int k = 0; k < lower.nnz; k++) {
+		if (lower.row[k] == lower.col[k]) {
+			sss.dvalues[lower.row[k]] += lower.data[k];
+		} else if (lower.row[k] > lower.col[k]) {
+			lower.row[strict] = lower.row[k];
+			lower.col[strict] = lower.col[k];
+			lower.data[strict] = lower.data[k];
+			strict += 1;
+		}
+	}
+	sss.lowerNnz = compressTriplets(h.rows, h.cols, strict, lower.row.get(), lower.col.get(), lower.data.get(),
+		std::plus<T>(), numThreads, sss.rowptr, sss.col, sss.values);
+	return sss;
+}
+
+// append "i j v\n" (1-based) to out
+template<typename T>
+void mmFormatEntry(std::string &out, long i, long j, T v) {
+	// two 64-bit indices and the longest shortest-round-trip value fit easily
+	char buf[128];
+	char *p = std::to_chars(buf, buf + 32, i + 1).ptr;
+	*p++ = ' ';
+	p = std::to_chars(p, p + 32, j + 1).ptr;
+	*p++ = ' ';
+	p = std::to_chars(p, p + 48, v).ptr;
+	*p++ = '\n';
+	out.append(buf, p);
+}
+
+// write banner, size line and the entries produced by format(begin, end, out) for items [0, numItems).
+// items are formatted in parallel, in batches, and written in order
+template<typename T, typename F>
+void writeMatrixMarketEntries(const std::string &path, const char *symmetry, int rows, int cols, long entries,
+		long numItems, int numThreads, F format) {
+	numThreads = std::max(1, numThreads);
+	FILE *f = std::fopen(path.c_str(), "wb");
+	if (f == nullptr) {
+		throw std::runtime_error("writeMatrixMarket: cannot open " + path);
+	}
+	std::fprintf(f, "%%%%MatrixMarket matrix coordinate %s %s\n%d %d %ld\n",
+		std::is_integral<T>::value ? "integer" : "real", symmetry, rows, cols, entries);
+
+	const long batch = 65536L * numThreads;
+	std::vector<std::string> out(numThreads);
+	bool ok = true;
+	for (long first = 0; first < numItems && ok; first += batch) {
+		long last = std::min(numItems, first + batch);
+		parallelRun(numThreads, [&](int t) {
+			long begin, end;
+			splitRange(last - first, numThreads, t, begin, end);
+			out[t].clear();
+			format(first + begin, first + end, out[t]);
+		});
+		for (int t = 0; t < numThreads && ok; t++) {
+			ok = std::fwrite(out[t].data(), 1, out[t].size(), f) == out[t].size();
+		}
+	}
+	ok = (std::fclose(f) == 0) && ok;
+	if (!ok) {
+		throw std::runtime_error("writeMatrixMarket: error while writing " + path);
+	}
+}
+
+// write a coo matrix as a general coordinate matrix market file
+template<typename T>
+void writeMatrixMarket(const std::string &path, const DynSparseCOO<T> &coo, int numThreads = defaultNumThreads()) {
+	writeMatrixMarketEntries<T>(path, "general", coo.rows, coo.cols, coo.nnz, coo.nnz, numThreads,
+		[&](long begin, long end, std::string &out) {
+			for (long k = begin; k < end; k++) {
+				mmFormatEntry(out, coo.row[k], coo.col[k], coo.data[k]);
+			}
+		});
+}
+
+// write a csr matrix as a general coordinate matrix market file
+template<typename T>
+void writeMatrixMarket(const std::string &path, const DynSparseCSR<T> &csr, int numThreads = defaultNumThreads()) {
+	writeMatrixMarketEntries<T>(path, "general", csr.rows, csr.cols, csr.nnz, csr.rows, numThreads,
+		[&](long begin, long end, std::string &out) {
+			for (long i = begin; i < end; i++) {
+				for (int j = csr.rowptr[i]; j < csr.rowptr[i + 1]; j++) {
+					mmFormatEntry(out, i, csr.col[j], csr.data[j]);
+				}
+			}
+		});
+}
+
+// write an sss matrix as a symmetric coordinate matrix market file (lower triangle only)
+template<typename T>
+void writeMatrixMarket(const std::string &path, const DynSparseSSS<T> &sss, int numThreads = defaultNumThreads()) {
+	long entries = sss.lowerNnz;
+	for (int i = 0; i < sss.n; i++) {
+		entries += sss.dvalues[i] != 0;
+	}
+	writeMatrixMarketEntries<T>(path, "symmetric", sss.n, sss.n, entries, sss.n, numThreads,
+		[&](long begin, long end, std::string &out) {
+			for (long i = begin; i < end; i++) {
+				for (int j = sss.rowptr[i]; j < sss.rowptr[i + 1]; j++) {
+					mmFormatEntry(out, i, sss.col[j], sss.values[j]);
+				}
+				if (sss.dvalues[i] != 0) {
+					mmFormatEntry(out, i, i, sss.dvalues[i]);
+				}
+			}
+		});
+}
+
+#endif // MATRIXMARKET_H
@@ -0,0 +1,177 @@
+// parallel.h
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <algorithm>
+
+// number of hardware threads (at least 1)
+inline int defaultNumThreads() {
+	unsigned int n = std::thread::hardware_concurrency();
+	return n > 0 ? (int) n : 1;
+}
+
+// run f(tid) for tid = 0 ... numThreads - 1 on separate threads and wait for all of them
+// the calling thread runs tid 0 itself
+template<typename F>
+void parallelRun(int numThreads, F f) {
+	if (numThreads <= 1) {
+		f(0);
+		return;
+	}
+
+	std::vector<std::thread> workers;
+	workers.reserve(numThreads - 1);
+	for (int t = 1; t < numThreads; t++) {
+		workers.emplace_back(f, t);
+	}
+	f(0);
+	for (std::thread &w : workers) {
+		w.join();
+	}
+}
+
+// [begin, end) bounds of part t when n items are split into numParts contiguous, equally sized parts
+inline void splitRange(long n, int numParts, int t, long &begin, long &end) {
+	begin = n * t / numParts;
+	end = n * (t + 1) / numParts;
+}
+
+// first index i in [0, n] of a non-decreasing prefix array (prefix[0] = 0, prefix[n] = total)
+// such that prefix[i] >= total * t / numParts.
+// splitting at these indices gives parts with (almost) equal prefix weight, e.g. equal nnz per row range
+template<typename I>
+int balancedSplit(const I *prefix, int n, int numParts, int t) {
+	if (t <= 0) {
+		return 0;
+	}
+	if (t >= numParts) {
+		return n;
+	}
+	long long target = (long long) prefix[n] * t / numParts;
+	return (int) (std::lower_bound(prefix, prefix + n + 1, (I) target) - prefix);
+}
+
+// turns counts[0 ... n - 1] into an exclusive prefix sum stored in prefix[0 ... n]
+// (counts and prefix may point to the same array, which then needs n + 1 elements)
+template<typename I>
+void parallelExclusiveScan(const I *counts, int n, I *prefix, int numThreads) {
+	numThreads = std::max(1, std::min(numThreads, n / 4096 + 1));
+	std::vector<I> partial(numThreads + 1, 0);
+
+	// 1) sum of every block, 2) exclusive scan of block sums, 3) local scans
+	parallelRun(numThreads, [&](int t) {
+		long begin, end;
+		splitRange(n, numThreads, t, begin, end);
+		I sum = 0;
+		for (long i = begin; i < end; i++) {
+			sum += counts[i];
+		}
+		partial[t + 1] = sum;
+	});
+	for (int t = 0; t < numThreads; t++) {
+		partial[t + 1] += partial[t];
+	}
+	parallelRun(numThreads, [&](int t) {
+		long begin, end;
+		splitRange(n, numThreads, t, begin, end);
+		I sum = partial[t];
+		for (long i = begin; i < end; i++) {
+			I c = counts[i];
+			prefix[i] = sum;
+			sum += c;
+		}
+	});
+	prefix[n] = partial[numThreads];
+}
+
+// small pool of persistent worker threads for kernels that are called many times.
+// run(f) calls f(tid) for tid = 0 ... size() - 1 (the calling thread runs tid 0) and waits,
+// so repeated calls pay for a wake-up rather than for creating threads.
+// run must not be called concurrently or from inside a task
+class ThreadPool {
+public:
+	explicit ThreadPool(int numThreads = defaultNumThreads())
+		: numThreads(std::max(1, numThreads)), generation(0), pending(0), stop(false), call(nullptr), task(nullptr) {
+		for (int t = 1; t < this->numThreads; t++) {
+			workers.emplace_back(&ThreadPool::worker, this, t);
+		}
+	}
+
+	ThreadPool(const ThreadPool &) = delete;
+	ThreadPool &operator=(const ThreadPool &) = delete;
+
+	~ThreadPool() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stop = true;
+		}
+		wake.notify_all();
+		for (std::thread &w : workers) {
+			w.join();
+		}
+	}
+
+	int size() const {
+		return numThreads;
+	}
+
+	template<typename F>
+	void run(F f) {
+		if (numThreads == 1) {
+			f(0);
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			task = &f;
+			call = [](void *task, int tid) { (*static_cast<F *>(task))(tid); };
+			pending = numThreads - 1;
+			generation += 1;
+		}
+		wake.notify_all();
+		f(0);
+		std::unique_lock<std::mutex> lock(mutex);
+		done.wait(lock, [this] { return pending == 0; });
+	}
+
+private:
+	void worker(int tid) {
+		long seen = 0;
+		while (true) {
+			void (*myCall)(void *, int);
+			void *myTask;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [&] { return stop || generation != seen; });
+				if (stop) {
+					return;
+				}
+				seen = generation;
+				myCall = call;
+				myTask = task;
+			}
+			myCall(myTask, tid);
+			std::lock_guard<std::mutex> lock(mutex);
+			if (--pending == 0) {
+				done.notify_one();
+			}
+		}
+	}
+
+	int numThreads;
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+	long generation;
+	int pending;
+	bool stop;
+	void (*call)(void *, int);
+	void *task;
+};
+
+#endif // PARALLEL_H
@@ -3,7 +3,15 @@
 #define RANDOMMATRIX_H
 
 #include <cstdlib>
+#include <cstdint>
+#include <climits>
+#include <stdexcept>
+#include <vector>
+#include <algorithm>
 #include "sparsematrix.h"
+#include "sparsebuild.h"
+#include "sparseconvert.h"
+#include "parallel.h"
 
 // generate a random 2D array for coo, csr, csc formats
 template<int K, int M, int LO, int HI, typename T>
@@ -130,4 +138,318 @@ void createSparseMatSss(int lowerNnz, T mat[N][N]) {
 	}
 }
 
+// ---seeded generators of large runtime-sized matrices---
+// the generators above fill dense arrays with rand() and retry on collisions. the ones below write
+// csr/coo arrays directly, draw from a xoshiro256** stream per chunk of rows (or edges) instead of
+// the global rand(), need no retries at any density, and split the chunks across numThreads threads.
+// the streams depend only on seed and chunk, so the matrix is the same for every numThreads.
+// values are uniform in [lo, hi)
+
+// xoshiro256** pseudo-random generator ("Scrambled Linear Pseudorandom Number Generators", Blackman, Vigna)
+class Xoshiro256 {
+public:
+	// independent stream number "stream" of a seed, the state is expanded with splitmix64
+	explicit Xoshiro256(uint64_t seed, uint64_t stream = 0) {
+		uint64_t x = seed ^ (stream * 0xD1342543DE82EF95ULL);
+		for (int k = 0; k < 4; k++) {
+			x += 0x9E3779B97F4A7C15ULL;
+			uint64_t z = x;
+			z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+			z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+			s[k] = z ^ (z >> 31);
+		}
+	}
+
+	uint64_t next() {
+		uint64_t result = rotl(s[1] * 5, 7) * 9;
+		uint64_t t = s[1] << 17;
+		s[2] ^= s[0];
+		s[3] ^= s[1];
+		s[1] ^= s[2];
+		s[0] ^= s[3];
+		s[2] ^= t;
+		s[3] = rotl(s[3], 45);
+		return result;
+	}
+
+	// uniform in [0, 1)
+	double uniform() {
+		return (next() >> 11) * 0x1.0p-53;
+	}
+
+	// uniform in [0, n) by multiply-shift (Lemire), without a division
+	uint64_t below(uint64_t n) {
+		return (uint64_t) (((unsigned __int128) next() * n) >> 64);
+	}
+
+private:
+	static uint64_t rotl(uint64_t x, int k) {
+		return (x << k) | (x >> (64 - k));
+	}
+
+	uint64_t s[4];
+};
+
+// rows per generator stream
+const int RANDOM_CHUNK_ROWS = 1024;
+
+// k distinct integers drawn uniformly from [lo, hi) (k <= hi - lo), written to out in increasing order.
+// every k-subset is equally likely. when k is a large part of the range, one pass of sequential
+// selection (Knuth's algorithm S) keeps every integer with probability still needed / still left;
+// otherwise Floyd's algorithm draws k integers whatever the range and keeps out sorted by insertion
+inline void uniformSample(Xoshiro256 &gen, long lo, long hi, int k, int *out) {
+	const long n = hi - lo;
+	if (n <= 32L * k) {
+		int chosen = 0;
+		for (long i = 0; i < n && chosen < k; i++) {
+			if ((long) gen.below(n - i) < k - chosen) {
+				out[chosen++] = (int) (lo + i);
+			}
+		}
+		return;
+	}
+
+	// Floyd: for j = n - k ... n - 1 take t uniform in [0, j], or j itself if t is taken already.
+	// every earlier draw is below j, so j always goes to the end
+	int size = 0;
+	for (long j = n - k; j < n; j++) {
+		int t = (int) (lo + (long) gen.below(j + 1));
+		int *pos = std::lower_bound(out, out + size, t);
+		if (pos != out + size && *pos == t) {
+			out[size++] = (int) (lo + j);
+		} else {
+			std::copy_backward(pos, out + size, out + size + 1);
+			*pos = t;
+			size++;
+		}
+	}
+}
+
+// average row length avg as floor(avg) or floor(avg) + 1 elements, at most limit
+inline int randomRowLength(Xoshiro256 &gen, double avg, long limit) {
+	long len = (long) avg + (gen.uniform() < avg - (long) avg ? 1 : 0);
+	return (int) std::max(0L, std::min(len, limit));
+}
+
+// builds a rows x cols csr matrix in two passes over chunks of RANDOM_CHUNK_ROWS rows:
+// length(gen, i) returns the length of row i, then fill(gen, i, len, col, data) writes its elements.
+// every chunk draws from stream 2c in the first pass and 2c + 1 in the second
+template<typename T, typename Length, typename Fill>
+DynSparseCSR<T> generateCSR(int rows, int cols, uint64_t seed, Length length, Fill fill, int numThreads) {
+	const int numChunks = (rows + RANDOM_CHUNK_ROWS - 1) / RANDOM_CHUNK_ROWS;
+	numThreads = std::max(1, std::min(numThreads, numChunks));
+	std::vector<long> rowptr(rows + 1, 0);
+	parallelRun(numThreads, [&](int t) {
+		long first, last;
+		splitRange(numChunks, numThreads, t, first, last);
+		for (long c = first; c < last; c++) {
+			Xoshiro256 gen(seed, 2 * c);
+			for (int i = c * RANDOM_CHUNK_ROWS; i < std::min(rows, (int) (c + 1) * RANDOM_CHUNK_ROWS); i++) {
+				rowptr[i + 1] = length(gen, i);
+			}
+		}
+	});
+	for (int i = 0; i < rows; i++) {
+		rowptr[i + 1] += rowptr[i];
+	}
+	if (rowptr[rows] > INT_MAX) {
+		throw std::runtime_error("generateCSR: matrix has more than INT_MAX non-zero elements");
+	}
+
+	DynSparseCSR<T> csr(rows, cols, (int) rowptr[rows]);
+	for (int i = 0; i <= rows; i++) {
+		csr.rowptr[i] = (int) rowptr[i];
+	}
+	parallelRun(numThreads, [&](int t) {
+		long first, last;
+		splitRange(numChunks, numThreads, t, first, last);
+		for (long c = first; c < last; c++) {
+			Xoshiro256 gen(seed, 2 * c + 1);
+			for (int i = c * RANDOM_CHUNK_ROWS; i < std::min(rows, (int) (c + 1) * RANDOM_CHUNK_ROWS); i++) {
+				int begin = csr.rowptr[i];
+				fill(gen, i, csr.rowptr[i + 1] - begin, csr.col.get() + begin, csr.data.get() + begin);
+			}
+		}
+	});
+	return csr;
+}
+
+// uniformly random pattern with nnzPerRow elements per row on average
+template<typename T>
+DynSparseCSR<T> randomUniformCSR(int rows, int cols, double nnzPerRow, uint64_t seed, T lo = T(1), T hi = T(9),
+		int numThreads = defaultNumThreads()) {
+	return generateCSR<T>(rows, cols, seed,
+		[&](Xoshiro256 &gen, int) { return randomRowLength(gen, nnzPerRow, cols); },
+		[&](Xoshiro256 &gen, int, int len, int *col, T *data) {
+			uniformSample(gen, 0, cols, len, col);
+			for (int j = 0; j < len; j++) {
+				data[j] = lo + (T) ((hi - lo) * gen.uniform());
+			}
+		}, numThreads);
+}
+
+// banded pattern: the elements of row i lie in columns [i - halfBandwidth, i + halfBandwidth],
+// nnzPerRow on average (halfBandwidth = 1 and nnzPerRow = 3 gives a full tridiagonal matrix)
+template<typename T>
+DynSparseCSR<T> randomBandedCSR(int rows, int cols, int halfBandwidth, double nnzPerRow, uint64_t seed,
+		T lo = T(1), T hi = T(9), int numThreads = defaultNumThreads()) {
+	auto window = [=](int i, long &first, long &last) {
+		first = std::max(0L, (long) i - halfBandwidth);
+		last = std::min((long) cols, (long) i + halfBandwidth + 1);
+	};
+	return generateCSR<T>(rows, cols, seed,
+		[&](Xoshiro256 &gen, int i) {
+			long first, last;
+			window(i, first, last);
+			return randomRowLength(gen, nnzPerRow, last - first);
+		},
+		[&](Xoshiro256 &gen, int i, int len, int *col, T *data) {
+			long first, last;
+			window(i, first, last);
+			uniformSample(gen, first, last, len, col);
+			for (int j = 0; j < len; j++) {
+				data[j] = lo + (T) ((hi - lo) * gen.uniform());
+			}
+		}, numThreads);
+}
+
+// block-structured pattern: every block row of blockSize rows has blocksPerRow dense blockSize x blockSize
+// blocks in random block columns (edge blocks are cut at the matrix border).
+// the block columns of block row b are drawn from their own stream, so both passes see the same ones
+template<typename T>
+DynSparseCSR<T> randomBlockCSR(int rows, int cols, int blockSize, int blocksPerRow, uint64_t seed,
+		T lo = T(1), T hi = T(9), int numThreads = defaultNumThreads()) {
+	if (blockSize <= 0) {
+		throw std::invalid_argument("randomBlockCSR: blockSize must be positive");
+	}
+	const int blockCols = (cols + blockSize - 1) / blockSize;
+	const int k = std::max(0, std::min(blocksPerRow, blockCols));
+	const uint64_t blockSeed = seed ^ 0x5851F42D4C957F2DULL;
+	auto blocksOf = [=](int i, int *blocks) {
+		Xoshiro256 gen(blockSeed, i / blockSize);
+		uniformSample(gen, 0, blockCols, k, blocks);
+	};
+	return generateCSR<T>(rows, cols, seed,
+		[&](Xoshiro256 &, int i) {
+			thread_local std::vector<int> blocks;
+			blocks.resize(k);
+			blocksOf(i, blocks.data());
+			return k > 0 && blocks[k - 1] == blockCols - 1 ? k * blockSize - (blockCols * blockSize - cols) : k * blockSize;
+		},
+		[&](Xoshiro256 &gen, int i, int, int *col, T *data) {
+			thread_local std::vector<int> blocks;
+			blocks.resize(k);
+			blocksOf(i, blocks.data());
+			int j = 0;
+			for (int b : blocks) {
+				for (int c = b * blockSize; c < std::min(cols, (b + 1) * blockSize); c++, j++) {
+					col[j] = c;
+					data[j] = lo + (T) ((hi - lo) * gen.uniform());
+				}
+			}
+		}, numThreads);
+}
+
+// symmetric pattern with a non-zero diagonal and nnzPerRow off-diagonal elements per row on average:
+// the strictly lower triangle is drawn row by row, then mirrored
+template<typename T>
+DynSparseCSR<T> randomSymmetricCSR(int n, double nnzPerRow, uint64_t seed, T lo = T(1), T hi = T(9),
+		int numThreads = defaultNumThreads()) {
+	DynSparseCSR<T> lower = generateCSR<T>(n, n, seed,
+		[&](Xoshiro256 &gen, int i) { return 1 + randomRowLength(gen, nnzPerRow / 2, i); },
+		[&](Xoshiro256 &gen, int i, int len, int *col, T *data) {
+			uniformSample(gen, 0, i, len - 1, col);
+			col[len - 1] = i;
+			for (int j = 0; j < len; j++) {
+				data[j] = lo + (T) ((hi - lo) * gen.uniform());
+			}
+		}, numThreads);
+	// the csc arrays of the lower triangle are the csr arrays of the upper one
+	DynSparseCSC<T> upper = csrToCSC(lower, numThreads);
+
+	// row i: lower row i (ends with the diagonal), then upper row i without the diagonal
+	long total = 2L * lower.nnz - n;
+	if (total > INT_MAX) {
+		throw std::runtime_error("randomSymmetricCSR: matrix has more than INT_MAX non-zero elements");
+	}
+	DynSparseCSR<T> csr(n, n, (int) total);
+	csr.rowptr[0] = 0;
+	for (int i = 0; i < n; i++) {
+		csr.rowptr[i + 1] = csr.rowptr[i] + (lower.rowptr[i + 1] - lower.rowptr[i]) + (upper.colptr[i + 1] - upper.colptr[i] - 1);
+	}
+	numThreads = std::max(1, std::min(numThreads, n / RANDOM_CHUNK_ROWS + 1));
+	parallelRun(numThreads, [&](int t) {
+		long first, last;
+		splitRange(n, numThreads, t, first, last);
+		for (long i = first; i < last; i++) {
+			int dst = csr.rowptr[i];
+			for (int j = lower.rowptr[i]; j < lower.rowptr[i + 1]; j++, dst++) {
+				csr.col[dst] = lower.col[j];
+				csr.data[dst] = lower.data[j];
+			}
+			// upper.row[colptr[i]] is the diagonal
+			for (int j = upper.colptr[i] + 1; j < upper.colptr[i + 1]; j++, dst++) {
+				csr.col[dst] = upper.row[j];
+				csr.data[dst] = upper.data[j];
+			}
+		}
+	});
+	return csr;
+}
+
+// edges per generator stream of the R-MAT generator
+const int RANDOM_CHUNK_EDGES = 65536;
+
+// power-law graph of 2^scale vertices and edgeFactor * 2^scale edges by R-MAT
+// ("R-MAT: A Recursive Model for Graph Mining", Chakrabarti et al.): every edge descends scale levels of
+// the adjacency matrix, picking the top-left, top-right, bottom-left or bottom-right quadrant with
+// probability a, b, c and 1 - a - b - c. the Graph500 parameters are the default.
+// the coo matrix is unsorted and holds repeated edges, buildCSR(coo) sums them
+template<typename T>
+DynSparseCOO<T> randomRMATCOO(int scale, int edgeFactor, uint64_t seed, double a = 0.57, double b = 0.19,
+		double c = 0.19, T lo = T(1), T hi = T(9), int numThreads = defaultNumThreads()) {
+	if (scale < 0 || scale > 30) {
+		throw std::invalid_argument("randomRMATCOO: scale must be in [0, 30]");
+	}
+	const int n = 1 << scale;
+	long edges = (long) edgeFactor * n;
+	if (edges > INT_MAX) {
+		throw std::runtime_error("randomRMATCOO: matrix has more than INT_MAX non-zero elements");
+	}
+	DynSparseCOO<T> coo(n, n, (int) edges);
+	const long numChunks = (edges + RANDOM_CHUNK_EDGES - 1) / RANDOM_CHUNK_EDGES;
+	numThreads = std::max(1, (int) std::min((long) numThreads, numChunks));
+	parallelRun(numThreads, [&](int t) {
+		long first, last;
+		splitRange(numChunks, numThreads, t, first, last);
+		for (long k = first; k < last; k++) {
+			Xoshiro256 gen(seed, k);
+			for (long e = k * RANDOM_CHUNK_EDGES; e < std::min(edges, (k + 1) * RANDOM_CHUNK_EDGES); e++) {
+				int row = 0;
+				int col = 0;
+				for (int level = scale - 1; level >= 0; level--) {
+					double u = gen.uniform();
+					if (u >= a + b) {
+						row |= 1 << level;
+					}
+					if ((u >= a && u < a + b) || u >= a + b + c) {
+						col |= 1 << level;
+					}
+				}
+				coo.row[e] = row;
+				coo.col[e] = col;
+				coo.data[e] = lo + (T) ((hi - lo) * gen.uniform());
+			}
+		}
+	});
+	return coo;
+}
+
+// R-MAT graph as a csr matrix, repeated edges summed
+template<typename T>
+DynSparseCSR<T> randomRMATCSR(int scale, int edgeFactor, uint64_t seed, double a = 0.57, double b = 0.19,
+		double c = 0.19, T lo = T(1), T hi = T(9), int numThreads = defaultNumThreads()) {
+	return buildCSR(randomRMATCOO<T>(scale, edgeFactor, seed, a, b, c, lo, hi, numThreads), std::plus<T>(), numThreads);
+}
+
 #endif // RANDOMMATRIX_H
@@ -0,0 +1,271 @@
+// reorder.h
+#ifndef REORDER_H
+#define REORDER_H
+
+#include <stdexcept>
+#include <vector>
+#include <algorithm>
+#include "sparsematrix.h"
+#include "sparsealgs.h"
+#include "parallel.h"
+
+// ---bandwidth-reducing reordering of square matrices---
+// an ordering is a permutation vector perm of length n: row/column perm[i] of the original matrix
+// becomes row/column i of the reordered one, i.e. B = P A P^T with B[i][j] = A[perm[i]][perm[j]].
+// the reordered matrix is used in its own numbering; permutedSpMV keeps the original numbering
+// for the caller
+
+// bandwidth: largest |i - j| over the stored elements.
+// profile: sum over the rows of the distance from the first stored column left of the diagonal to the
+// diagonal, i.e. the size of the lower envelope
+struct BandwidthProfile {
+	int bandwidth;
+	long profile;
+};
+
+template<typename T>
+BandwidthProfile bandwidthProfile(const DynSparseCSR<T> &csr) {
+	BandwidthProfile result = {0, 0};
+	for (int i = 0; i < csr.rows; i++) {
+		int first = i;
+		for (int j = csr.rowptr[i]; j < csr.rowptr[i + 1]; j++) {
+			result.bandwidth = std::max(result.bandwidth, std::abs(csr.col[j] - i));
+			first = std::min(first, csr.col[j]);
+		}
+		result.profile += i - first;
+	}
+	return result;
+}
+
+template<int ROWS, int COLS, int NNZ, typename T>
+BandwidthProfile bandwidthProfile(const SparseCSR<ROWS, COLS, NNZ, T> &csr) {
+	return bandwidthProfile(DynSparseCSR<T>(csr));
+}
+
+inline std::ostream &operator<<(std::ostream &os, const BandwidthProfile &bp) {
+	os << "bandwidth = " << bp.bandwidth << ", profile = " << bp.profile << "\n";
+	return os;
+}
+
+// breadth-first search from root over the stored pattern; appends the reached nodes to order level
+// by level and returns the number of levels. nodes with mark[v] == stamp count as visited, so a new
+// search only needs a new stamp. lastLevel is set to the offset in order of the last level
+template<typename T>
+int bfsLevels(const DynSparseCSR<T> &csr, int root, std::vector<int> &mark, int stamp, std::vector<int> &order,
+		size_t &lastLevel) {
+	size_t begin = order.size();
+	order.push_back(root);
+	mark[root] = stamp;
+	int levels = 0;
+	while (begin < order.size()) {
+		size_t end = order.size();
+		lastLevel = begin;
+		levels += 1;
+		for (size_t q = begin; q < end; q++) {
+			int v = order[q];
+			for (int j = csr.rowptr[v]; j < csr.rowptr[v + 1]; j++) {
+				int w = csr.col[j];
+				if (mark[w] != stamp) {
+					mark[w] = stamp;
+					order.push_back(w);
+				}
+			}
+		}
+		begin = end;
+	}
+	return levels;
+}
+
+// Reverse Cuthill-McKee ordering of a square matrix with a symmetric pattern
+// (for an unsymmetric matrix, pass the pattern of A + A^T).
+// every connected component is started from a pseudo-peripheral node (George-Liu: repeat a
+// breadth-first search from a lowest-degree node of the last level while that adds levels), then
+// visited breadth-first with the neighbours of every node taken in order of increasing degree.
+// reversing the whole order gives the same bandwidth and a smaller profile
+template<typename T>
+std::vector<int> rcmOrdering(const DynSparseCSR<T> &csr) {
+	if (csr.rows != csr.cols) {
+		throw std::invalid_argument("rcmOrdering: matrix must be square");
+	}
+	const int n = csr.rows;
+	std::vector<int> degree(n);
+	for (int i = 0; i < n; i++) {
+		degree[i] = csr.rowptr[i + 1] - csr.rowptr[i];
+	}
+	auto byDegree = [&](int a, int b) { return degree[a] < degree[b] || (degree[a] == degree[b] && a < b); };
+
+	// components are started in order of increasing degree
+	std::vector<int> starts(n);
+	for (int i = 0; i < n; i++) {
+		starts[i] = i;
+	}
+	std::sort(starts.begin(), starts.end(), byDegree);
+
+	std::vector<int> perm;
+	perm.reserve(n);
+	std::vector<char> visited(n, 0);
+	std::vector<int> mark(n, -1);
+	std::vector<int> levelOrder;
+	int stamp = 0;
+	for (int s : starts) {
+		if (visited[s]) {
+			continue;
+		}
+
+		// pseudo-peripheral root of the component of s
+		int root = s;
+		levelOrder.clear();
+		size_t lastLevel = 0;
+		int levels = bfsLevels(csr, root, mark, stamp++, levelOrder, lastLevel);
+		while (true) {
+			int candidate = *std::min_element(levelOrder.begin() + lastLevel, levelOrder.end(), byDegree);
+			levelOrder.clear();
+			size_t candidateLast = 0;
+			int candidateLevels = bfsLevels(csr, candidate, mark, stamp++, levelOrder, candidateLast);
+			if (candidateLevels <= levels) {
+				break;
+			}
+			root = candidate;
+			levels = candidateLevels;
+			lastLevel = candidateLast;
+		}
+
+		// Cuthill-McKee from root
+		size_t q = perm.size();
+		perm.push_back(root);
+		visited[root] = 1;
+		for (; q < perm.size(); q++) {
+			int v = perm[q];
+			size_t first = perm.size();
+			for (int j = csr.rowptr[v]; j < csr.rowptr[v + 1]; j++) {
+				int w = csr.col[j];
+				if (!visited[w]) {
+					visited[w] = 1;
+					perm.push_back(w);
+				}
+			}
+			std::sort(perm.begin() + first, perm.end(), byDegree);
+		}
+	}
+	std::reverse(perm.begin(), perm.end());
+	return perm;
+}
+
+template<int ROWS, int COLS, int NNZ, typename T>
+std::vector<int> rcmOrdering(const SparseCSR<ROWS, COLS, NNZ, T> &csr) {
+	return rcmOrdering(DynSparseCSR<T>(csr));
+}
+
+// degree (hub) ordering for graphs: rows sorted by number of stored elements, most populated first
+// unless ascending is set, ties keep their original order. grouping the hubs at the front keeps
+// their entries of inVector together in cache
+template<typename T>
+std::vector<int> degreeOrdering(const DynSparseCSR<T> &csr, bool ascending = false) {
+	if (csr.rows != csr.cols) {
+		throw std::invalid_argument("degreeOrdering: matrix must be square");
+	}
+	std::vector<int> perm(csr.rows);
+	for (int i = 0; i < csr.rows; i++) {
+		perm[i] = i;
+	}
+	const int *rowptr = csr.rowptr.get();
+	std::stable_sort(perm.begin(), perm.end(), [&](int a, int b) {
+		int da = rowptr[a + 1] - rowptr[a];
+		int db = rowptr[b + 1] - rowptr[b];
+		return ascending ? da < db : da > db;
+	});
+	return perm;
+}
+
+template<int ROWS, int COLS, int NNZ, typename T>
+std::vector<int> degreeOrdering(const SparseCSR<ROWS, COLS, NNZ, T> &csr, bool ascending = false) {
+	return degreeOrdering(DynSparseCSR<T>(csr), ascending);
+}
+
+// B = P A P^T for an ordering perm, with the columns of every row of B sorted
+template<typename T>
+DynSparseCSR<T> permuteSymmetric(const DynSparseCSR<T> &csr, const std::vector<int> &perm,
+		int numThreads = defaultNumThreads()) {
+	const int n = csr.rows;
+	if (csr.rows != csr.cols || (int) perm.size() != n) {
+		throw std::invalid_argument("permuteSymmetric: matrix must be square and perm must have one entry per row");
+	}
+	std::vector<int> inverse(n, -1);
+	for (int i = 0; i < n; i++) {
+		if (perm[i] < 0 || perm[i] >= n || inverse[perm[i]] != -1) {
+			throw std::invalid_argument("permuteSymmetric: perm is not a permutation");
+		}
+		inverse[perm[i]] = i;
+	}
+
+	DynSparseCSR<T> result(n, n, csr.nnz);
+	result.rowptr[0] = 0;
+	for (int i = 0; i < n; i++) {
+		result.rowptr[i + 1] = result.rowptr[i] + csr.rowptr[perm[i] + 1] - csr.rowptr[perm[i]];
+	}
+	numThreads = std::max(1, std::min(numThreads, n / 1024 + 1));
+	parallelRun(numThreads, [&](int t) {
+		long begin, end;
+		splitRange(n, numThreads, t, begin, end);
+		std::vector<std::pair<int, T>> entries;
+		for (long i = begin; i < end; i++) {
+			int src = perm[i];
+			entries.clear();
+			for (int j = csr.rowptr[src]; j < csr.rowptr[src + 1]; j++) {
+				entries.emplace_back(inverse[csr.col[j]], csr.data[j]);
+			}
+			std::sort(entries.begin(), entries.end(),
+				[](const std::pair<int, T> &a, const std::pair<int, T> &b) { return a.first < b.first; });
+			int dst = result.rowptr[i];
+			for (const std::pair<int, T> &e : entries) {
+				result.col[dst] = e.first;
+				result.data[dst] = e.second;
+				dst++;
+			}
+		}
+	});
+	return result;
+}
+
+// spMV with a reordered matrix in the original numbering: outVector = A inVector where
+// matrix = P A P^T (any square format with a spMV, e.g. the reordered csr or an ELL/SSS conversion of it).
+// work must hold 2 * n elements
+template<typename M, typename T>
+void permutedSpMV(const M &matrix, const std::vector<int> &perm, const T *inVector, T *outVector, T *work) {
+	const int n = (int) perm.size();
+	T *permutedIn = work;
+	T *permutedOut = work + n;
+	for (int i = 0; i < n; i++) {
+		permutedIn[i] = inVector[perm[i]];
+	}
+	spMV(matrix, permutedIn, permutedOut);
+	for (int i = 0; i < n; i++) {
+		outVector[perm[i]] = permutedOut[i];
+	}
+}
+
+// multithreaded permutedSpMV for a reordered csr matrix; partition is usually RowPartition(matrix, pool.size())
+template<typename T>
+void permutedParallelSpMV(const DynSparseCSR<T> &matrix, const std::vector<int> &perm, const T *inVector,
+		T *outVector, T *work, const RowPartition &partition, ThreadPool &pool) {
+	const int n = (int) perm.size();
+	T *permutedIn = work;
+	T *permutedOut = work + n;
+	pool.run([&](int tid) {
+		long begin, end;
+		splitRange(n, pool.size(), tid, begin, end);
+		for (long i = begin; i < end; i++) {
+			permutedIn[i] = inVector[perm[i]];
+		}
+	});
+	parallelSpMV(matrix, permutedIn, permutedOut, partition, pool);
+	pool.run([&](int tid) {
+		long begin, end;
+		splitRange(n, pool.size(), tid, begin, end);
+		for (long i = begin; i < end; i++) {
+			outVector[perm[i]] = permutedOut[i];
+		}
+	});
+}
+
+#endif // REORDER_H
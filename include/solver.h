@@ -0,0 +1,365 @@
+// solver.h
+#ifndef SOLVER_H
+#define SOLVER_H
+
+#include <chrono>
+#include <cmath>
+#include <ostream>
+#include <stdexcept>
+#include <vector>
+#include <algorithm>
+#include "sparsematrix.h"
+#include "sparsealgs.h"
+#include "parallel.h"
+
+// ---conjugate gradient solvers for symmetric positive-definite systems A x = b---
+// the textbook iteration composed of spMV, dot and axpy calls makes a separate pass over the vectors for
+// every step (q = A p, p.q, x += alpha p, r -= alpha q, z = D^-1 r, r.z, r.r, p = z + beta p).
+// here every iteration makes three passes:
+//  1) q = A p together with p.q
+//  2) r -= alpha q together with r.r and, for the jacobi preconditioner, r.z with z = D^-1 r
+//  3) x += alpha p together with p = z + beta p
+// z is recomputed from r and the inverse diagonal instead of being stored. every pass runs on the threads
+// of a pool; reductions are summed per thread and then in thread order, so a given thread count
+// always gives the same result
+
+// vectors of length n read or written per iteration by the fused loop, with and without the
+// preconditioner, and by the jacobi pcg composed of one pass per step
+const int CG_VECTOR_STREAMS = 10;
+const int PCG_VECTOR_STREAMS = 12;
+const int PCG_COMPOSED_VECTOR_STREAMS = 19;
+
+struct CGResult {
+	int iterations;
+	double residual;			// ||r|| / ||b|| of the recurrence residual r = b - A x
+	bool converged;				// residual <= tolerance
+	double seconds;				// solve loop, setup excluded
+	double secondsPerIteration;
+	double bytesPerIteration;	// modelled memory traffic: the matrix once plus the vector streams
+};
+
+inline std::ostream &operator<<(std::ostream &os, const CGResult &result) {
+	os << result.iterations << " iterations, residual = " << result.residual
+		<< (result.converged ? "" : " (not converged)") << ", " << result.secondsPerIteration * 1e3
+		<< " ms per iteration, " << result.bytesPerIteration / 1e6 << " MB per iteration (modelled)\n";
+	return os;
+}
+
+// q = A p for an sss matrix, returns p.q. p.q = p^T A p is summed row by row as p[r] * (d[r] p[r] + 2 dot),
+// with dot the lower triangle part of row r, so it does not wait for the mirrored writes to q.
+// partition has pool.size() parts (see SSSPartition), partial holds one element per part
+template<typename T>
+T sssSpMVDot(int n, const T *dvalues, const int *rowptr, const int *col, const T *values, const T *p, T *q,
+		SSSPartition<T> &partition, ThreadPool &pool, T *partial) {
+	const int numParts = partition.numParts();
+	pool.run([&](int tid) {
+		for (int t = tid; t < numParts; t += pool.size()) {
+			const int first = partition.bounds[t];
+			const int last = partition.bounds[t + 1];
+			const int reach = partition.reach[t];
+			T *local = partition.local[t].get();
+			std::fill(local, local + (first - reach), T(0));
+			for (int r = first; r < last; r++) {
+				q[r] = dvalues[r] * p[r];
+			}
+
+			T sum = 0;
+			for (int r = first; r < last; r++) {
+				T dot = 0;
+				for (int j = rowptr[r]; j < rowptr[r + 1]; j++) {
+					int c = col[j];
+					dot += values[j] * p[c];
+					if (c >= first) {
+						q[c] += values[j] * p[r];
+					} else {
+						local[c - reach] += values[j] * p[r];
+					}
+				}
+				q[r] += dot;
+				sum += p[r] * (dvalues[r] * p[r] + 2 * dot);
+			}
+			partial[t] = sum;
+		}
+	});
+
+	pool.run([&](int tid) {
+		long begin, end;
+		splitRange(n, pool.size(), tid, begin, end);
+		for (int t = 0; t < numParts; t++) {
+			int lo = std::max((int) begin, partition.reach[t]);
+			int hi = std::min((int) end, partition.bounds[t]);
+			const T *local = partition.local[t].get() - partition.reach[t];
+			for (int i = lo; i < hi; i++) {
+				q[i] += local[i];
+			}
+		}
+	});
+
+	T pq = 0;
+	for (int t = 0; t < numParts; t++) {
+		pq += partial[t];
+	}
+	return pq;
+}
+
+// q = A p for a csr matrix, returns p.q; partial holds one element per part of partition
+template<typename T>
+T csrSpMVDot(const int *rowptr, const int *col, const T *data, const T *p, T *q, const RowPartition &partition,
+		ThreadPool &pool, T *partial) {
+	pool.run([&](int tid) {
+		for (int t = tid; t < partition.numParts(); t += pool.size()) {
+			T sum = 0;
+			for (int i = partition.bounds[t]; i < partition.bounds[t + 1]; i++) {
+				T dot = 0;
+				for (int j = rowptr[i]; j < rowptr[i + 1]; j++) {
+					dot += data[j] * p[col[j]];
+				}
+				q[i] = dot;
+				sum += p[i] * dot;
+			}
+			partial[t] = sum;
+		}
+	});
+	T pq = 0;
+	for (int t = 0; t < partition.numParts(); t++) {
+		pq += partial[t];
+	}
+	return pq;
+}
+
+// threads for a system with n unknowns, the vector passes are too short to split below a few thousand
+inline int cgThreads(int n, int numThreads) {
+	return std::max(1, std::min(numThreads, n / 4096 + 1));
+}
+
+// the fused (preconditioned) cg loop. spMVDot(p, q) sets q = A p and returns p.q; invDiag is the
+// inverse diagonal for jacobi preconditioning or null. x holds the initial guess
+template<typename T, typename F>
+CGResult cgSolve(int n, F spMVDot, const T *invDiag, const T *b, T *x, double tolerance, int maxIterations,
+		ThreadPool &pool, double matrixBytes) {
+	const int numThreads = pool.size();
+	std::vector<T> r(n), p(n), q(n);
+	std::vector<T> partialRZ(numThreads), partialRR(numThreads), partialBB(numThreads);
+	auto sum = [](const std::vector<T> &partial) {
+		T s = 0;
+		for (T v : partial) {
+			s += v;
+		}
+		return s;
+	};
+
+	// r = b - A x, p = z
+	spMVDot(x, q.data());
+	pool.run([&](int tid) {
+		long begin, end;
+		splitRange(n, numThreads, tid, begin, end);
+		T rz = 0, rr = 0, bb = 0;
+		for (long i = begin; i < end; i++) {
+			r[i] = b[i] - q[i];
+			p[i] = invDiag ? invDiag[i] * r[i] : r[i];
+			rz += r[i] * p[i];
+			rr += r[i] * r[i];
+			bb += b[i] * b[i];
+		}
+		partialRZ[tid] = rz;
+		partialRR[tid] = rr;
+		partialBB[tid] = bb;
+	});
+	T rz = sum(partialRZ);
+	T rr = sum(partialRR);
+	const double bNorm = std::sqrt((double) sum(partialBB));
+
+	CGResult result = {};
+	result.bytesPerIteration = matrixBytes
+		+ (double) (invDiag ? PCG_VECTOR_STREAMS : CG_VECTOR_STREAMS) * n * sizeof(T);
+	if (bNorm == 0) {
+		// the solution of A x = 0 is x = 0
+		std::fill(x, x + n, T(0));
+		result.converged = true;
+		return result;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	int k = 0;
+	while (std::sqrt((double) rr) > tolerance * bNorm && k < maxIterations) {
+		// 1) q = A p, p.q
+		T pq = spMVDot(p.data(), q.data());
+		if (!(pq > 0)) {
+			throw std::runtime_error("cgSolve: matrix is not positive definite");
+		}
+		const T alpha = rz / pq;
+
+		// 2) r -= alpha q, r.r and r.z
+		pool.run([&](int tid) {
+			long begin, end;
+			splitRange(n, numThreads, tid, begin, end);
+			T sumRR = 0, sumRZ = 0;
+			if (invDiag) {
+				for (long i = begin; i < end; i++) {
+					T ri = r[i] - alpha * q[i];
+					r[i] = ri;
+					sumRR += ri * ri;
+					sumRZ += ri * ri * invDiag[i];
+				}
+			} else {
+				for (long i = begin; i < end; i++) {
+					T ri = r[i] - alpha * q[i];
+					r[i] = ri;
+					sumRR += ri * ri;
+				}
+				sumRZ = sumRR;
+			}
+			partialRR[tid] = sumRR;
+			partialRZ[tid] = sumRZ;
+		});
+		T rzNew = sum(partialRZ);
+		rr = sum(partialRR);
+		const T beta = rzNew / rz;
+		rz = rzNew;
+
+		// 3) x += alpha p, p = z + beta p
+		pool.run([&](int tid) {
+			long begin, end;
+			splitRange(n, numThreads, tid, begin, end);
+			if (invDiag) {
+				for (long i = begin; i < end; i++) {
+					x[i] += alpha * p[i];
+					p[i] = invDiag[i] * r[i] + beta * p[i];
+				}
+			} else {
+				for (long i = begin; i < end; i++) {
+					x[i] += alpha * p[i];
+					p[i] = r[i] + beta * p[i];
+				}
+			}
+		});
+		k++;
+	}
+
+	result.iterations = k;
+	result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	result.secondsPerIteration = k > 0 ? result.seconds / k : 0;
+	result.residual = std::sqrt((double) rr) / bNorm;
+	result.converged = result.residual <= tolerance;
+	return result;
+}
+
+// inverse of a diagonal, which must be positive for a positive-definite matrix
+template<typename T>
+std::vector<T> inverseDiagonal(const T *diagonal, int n) {
+	std::vector<T> inv(n);
+	for (int i = 0; i < n; i++) {
+		if (!(diagonal[i] > 0)) {
+			throw std::invalid_argument("inverseDiagonal: diagonal element is not positive");
+		}
+		inv[i] = T(1) / diagonal[i];
+	}
+	return inv;
+}
+
+template<typename T>
+CGResult sssCG(int n, const T *dvalues, const int *rowptr, const int *col, const T *values, const T *b, T *x,
+		bool jacobi, double tolerance, int maxIterations, int numThreads) {
+	ThreadPool pool(cgThreads(n, numThreads));
+	SSSPartition<T> partition(rowptr, col, n, pool.size());
+	std::vector<T> partial(pool.size());
+	std::vector<T> invDiag;
+	if (jacobi) {
+		invDiag = inverseDiagonal(dvalues, n);
+	}
+	double matrixBytes = (double) n * sizeof(T) + (double) rowptr[n] * (sizeof(T) + sizeof(int))
+		+ (double) (n + 1) * sizeof(int);
+	auto spMVDot = [&](const T *p, T *q) {
+		return sssSpMVDot(n, dvalues, rowptr, col, values, p, q, partition, pool, partial.data());
+	};
+	return cgSolve(n, spMVDot, jacobi ? invDiag.data() : (const T *) nullptr, b, x, tolerance, maxIterations, pool,
+		matrixBytes);
+}
+
+template<typename T>
+CGResult csrCG(int rows, int cols, const int *rowptr, const int *col, const T *data, const T *b, T *x,
+		bool jacobi, double tolerance, int maxIterations, int numThreads) {
+	if (rows != cols) {
+		throw std::invalid_argument("csrCG: matrix must be square");
+	}
+	const int n = rows;
+	ThreadPool pool(cgThreads(n, numThreads));
+	RowPartition partition(rowptr, n, pool.size());
+	std::vector<T> partial(pool.size());
+	std::vector<T> invDiag;
+	if (jacobi) {
+		std::vector<T> diagonal(n, T(0));
+		for (int i = 0; i < n; i++) {
+			for (int j = rowptr[i]; j < rowptr[i + 1]; j++) {
+				if (col[j] == i) {
+					diagonal[i] += data[j];
+				}
+			}
+		}
+		invDiag = inverseDiagonal(diagonal.data(), n);
+	}
+	double matrixBytes = (double) rowptr[n] * (sizeof(T) + sizeof(int)) + (double) (n + 1) * sizeof(int);
+	auto spMVDot = [&](const T *p, T *q) {
+		return csrSpMVDot(rowptr, col, data, p, q, partition, pool, partial.data());
+	};
+	return cgSolve(n, spMVDot, jacobi ? invDiag.data() : (const T *) nullptr, b, x, tolerance, maxIterations, pool,
+		matrixBytes);
+}
+
+// solve A x = b by conjugate gradients, x holds the initial guess and receives the solution.
+// stops once ||b - A x|| <= tolerance * ||b|| or after maxIterations
+template<typename T>
+CGResult conjugateGradient(const DynSparseSSS<T> &sss, const T *b, T *x, double tolerance = 1e-8,
+		int maxIterations = 1000, int numThreads = defaultNumThreads()) {
+	return sssCG(sss.n, sss.dvalues.get(), sss.rowptr.get(), sss.col.get(), sss.values.get(), b, x, false, tolerance,
+		maxIterations, numThreads);
+}
+
+template<int N, int LOWERNNZ, typename T>
+CGResult conjugateGradient(const SparseSSS<N, LOWERNNZ, T> &sss, const T b[N], T x[N], double tolerance = 1e-8,
+		int maxIterations = 1000, int numThreads = defaultNumThreads()) {
+	return sssCG(N, sss.dvalues, sss.rowptr, sss.col, sss.values, b, x, false, tolerance, maxIterations, numThreads);
+}
+
+template<typename T>
+CGResult conjugateGradient(const DynSparseCSR<T> &csr, const T *b, T *x, double tolerance = 1e-8,
+		int maxIterations = 1000, int numThreads = defaultNumThreads()) {
+	return csrCG(csr.rows, csr.cols, csr.rowptr.get(), csr.col.get(), csr.data.get(), b, x, false, tolerance,
+		maxIterations, numThreads);
+}
+
+template<int ROWS, int COLS, int NNZ, typename T>
+CGResult conjugateGradient(const SparseCSR<ROWS, COLS, NNZ, T> &csr, const T b[ROWS], T x[COLS],
+		double tolerance = 1e-8, int maxIterations = 1000, int numThreads = defaultNumThreads()) {
+	return csrCG(ROWS, COLS, csr.rowptr, csr.col, csr.data, b, x, false, tolerance, maxIterations, numThreads);
+}
+
+// conjugate gradients preconditioned with the inverse diagonal (jacobi), which evens out rows of
+// very different scale; the diagonal is dvalues for sss and the diagonal elements for csr
+template<typename T>
+CGResult jacobiPCG(const DynSparseSSS<T> &sss, const T *b, T *x, double tolerance = 1e-8,
+		int maxIterations = 1000, int numThreads = defaultNumThreads()) {
+	return sssCG(sss.n, sss.dvalues.get(), sss.rowptr.get(), sss.col.get(), sss.values.get(), b, x, true, tolerance,
+		maxIterations, numThreads);
+}
+
+template<int N, int LOWERNNZ, typename T>
+CGResult jacobiPCG(const SparseSSS<N, LOWERNNZ, T> &sss, const T b[N], T x[N], double tolerance = 1e-8,
+		int maxIterations = 1000, int numThreads = defaultNumThreads()) {
+	return sssCG(N, sss.dvalues, sss.rowptr, sss.col, sss.values, b, x, true, tolerance, maxIterations, numThreads);
+}
+
+template<typename T>
+CGResult jacobiPCG(const DynSparseCSR<T> &csr, const T *b, T *x, double tolerance = 1e-8,
+		int maxIterations = 1000, int numThreads = defaultNumThreads()) {
+	return csrCG(csr.rows, csr.cols, csr.rowptr.get(), csr.col.get(), csr.data.get(), b, x, true, tolerance,
+		maxIterations, numThreads);
+}
+
+template<int ROWS, int COLS, int NNZ, typename T>
+CGResult jacobiPCG(const SparseCSR<ROWS, COLS, NNZ, T> &csr, const T b[ROWS], T x[COLS],
+		double tolerance = 1e-8, int maxIterations = 1000, int numThreads = defaultNumThreads()) {
+	return csrCG(ROWS, COLS, csr.rowptr, csr.col, csr.data, b, x, true, tolerance, maxIterations, numThreads);
+}
+
+#endif // SOLVER_H
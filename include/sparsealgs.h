@@ -2,6 +2,11 @@
 #define SPARSEALGS_H
 
 #include "sparsematrix.h"
+#include "parallel.h"
+
+#if defined(__SSE3__) || defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
 
 // multiply COO sparse matrix with dense vector and store results in outVector
 template<int ROWS, int COLS, int NNZ, typename T>
@@ -27,53 +32,183 @@ void spMV(const SparseCSR<ROWS, COLS, NNZ, T> &csr, const T inVector[COLS], T ou
 	}
 }
 
-// multiply BSR sparse matrix with dense vector
-template<int ROWS, int COLS, int BLOCKSIZE, int NNZBLOCKS, typename T>
-void spMV(const SparseBSR<ROWS, COLS, BLOCKSIZE, NNZBLOCKS, T> &bsr, const T inVector[COLS], T outVector[ROWS]) {
-	
-	for (int i = 0; i < ROWS; i++) {
-		outVector[i] = 0;
-	}
+// ---register-blocked bsr kernels---
+// one block row of a bsr matrix is multiplied by a kernel that knows the block size at compile time,
+// so the loops over the block are fully unrolled, the block-row accumulators stay in registers and
+// the inVector slice of every block is loaded once.
+// x of the last block col is tailX (zero padded) when cols is not a multiple of BS (tailBlockCol >= 0),
+// so edge blocks never read past the end of inVector
 
-	for (int i = 0; i < ROWS / BLOCKSIZE; i++) {
-		for (int j = bsr.blockRowptr[i]; j < bsr.blockRowptr[i + 1]; j++) {
-			for (int k = j * BLOCKSIZE * BLOCKSIZE; k < (j + 1) * BLOCKSIZE * BLOCKSIZE; k++) {
-				int col = bsr.blockCol[j] * BLOCKSIZE + k % BLOCKSIZE;
-				int row = i * BLOCKSIZE + k % (BLOCKSIZE * BLOCKSIZE) / BLOCKSIZE;
-				outVector[row] += bsr.data[k] * inVector[col];
+// acc[0 ... BS - 1] = block row [first, last) times inVector
+template<typename T, int BS>
+inline void bsrBlockRowSpMV(const T *data, const int *blockCol, int first, int last, const T *inVector,
+		int tailBlockCol, const T *tailX, T *acc) {
+	T sum[BS] = {};
+	for (int b = first; b < last; b++) {
+		const T *block = data + (size_t) b * BS * BS;
+		const T *x = blockCol[b] == tailBlockCol ? tailX : inVector + (size_t) blockCol[b] * BS;
+		T xr[BS];
+		for (int j = 0; j < BS; j++) {
+			xr[j] = x[j];
+		}
+		for (int i = 0; i < BS; i++) {
+			for (int j = 0; j < BS; j++) {
+				sum[i] += block[i * BS + j] * xr[j];
 			}
 		}
 	}
+	for (int i = 0; i < BS; i++) {
+		acc[i] = sum[i];
+	}
+}
+
+#if defined(__SSE3__)
+// SSE 4x4 float kernel: one accumulator per block row, reduced once per block row
+template<>
+inline void bsrBlockRowSpMV<float, 4>(const float *data, const int *blockCol, int first, int last, const float *inVector,
+		int tailBlockCol, const float *tailX, float *acc) {
+	__m128 s0 = _mm_setzero_ps(), s1 = _mm_setzero_ps(), s2 = _mm_setzero_ps(), s3 = _mm_setzero_ps();
+	for (int b = first; b < last; b++) {
+		const float *block = data + (size_t) b * 16;
+		__m128 x = _mm_loadu_ps(blockCol[b] == tailBlockCol ? tailX : inVector + (size_t) blockCol[b] * 4);
+		s0 = _mm_add_ps(s0, _mm_mul_ps(_mm_loadu_ps(block), x));
+		s1 = _mm_add_ps(s1, _mm_mul_ps(_mm_loadu_ps(block + 4), x));
+		s2 = _mm_add_ps(s2, _mm_mul_ps(_mm_loadu_ps(block + 8), x));
+		s3 = _mm_add_ps(s3, _mm_mul_ps(_mm_loadu_ps(block + 12), x));
+	}
+	_mm_storeu_ps(acc, _mm_hadd_ps(_mm_hadd_ps(s0, s1), _mm_hadd_ps(s2, s3)));
+}
+#endif
+
+#if defined(__AVX2__) && defined(__FMA__)
+// AVX2 4x4 double kernel
+template<>
+inline void bsrBlockRowSpMV<double, 4>(const double *data, const int *blockCol, int first, int last, const double *inVector,
+		int tailBlockCol, const double *tailX, double *acc) {
+	__m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd(), s2 = _mm256_setzero_pd(), s3 = _mm256_setzero_pd();
+	for (int b = first; b < last; b++) {
+		const double *block = data + (size_t) b * 16;
+		__m256d x = _mm256_loadu_pd(blockCol[b] == tailBlockCol ? tailX : inVector + (size_t) blockCol[b] * 4);
+		s0 = _mm256_fmadd_pd(_mm256_loadu_pd(block), x, s0);
+		s1 = _mm256_fmadd_pd(_mm256_loadu_pd(block + 4), x, s1);
+		s2 = _mm256_fmadd_pd(_mm256_loadu_pd(block + 8), x, s2);
+		s3 = _mm256_fmadd_pd(_mm256_loadu_pd(block + 12), x, s3);
+	}
+	// [s0 s1 s0 s1] and [s2 s3 s2 s3] partial sums, then add the 128-bit halves
+	__m256d h01 = _mm256_hadd_pd(s0, s1);
+	__m256d h23 = _mm256_hadd_pd(s2, s3);
+	_mm256_storeu_pd(acc, _mm256_add_pd(_mm256_permute2f128_pd(h01, h23, 0x20), _mm256_permute2f128_pd(h01, h23, 0x31)));
+}
+
+// AVX2 8x8 float kernel
+template<>
+inline void bsrBlockRowSpMV<float, 8>(const float *data, const int *blockCol, int first, int last, const float *inVector,
+		int tailBlockCol, const float *tailX, float *acc) {
+	__m256 s[8];
+	for (int i = 0; i < 8; i++) {
+		s[i] = _mm256_setzero_ps();
+	}
+	for (int b = first; b < last; b++) {
+		const float *block = data + (size_t) b * 64;
+		__m256 x = _mm256_loadu_ps(blockCol[b] == tailBlockCol ? tailX : inVector + (size_t) blockCol[b] * 8);
+		for (int i = 0; i < 8; i++) {
+			s[i] = _mm256_fmadd_ps(_mm256_loadu_ps(block + i * 8), x, s[i]);
+		}
+	}
+	// two levels of hadd leave the row sums of both 128-bit halves, which are then added
+	__m256 h0123 = _mm256_hadd_ps(_mm256_hadd_ps(s[0], s[1]), _mm256_hadd_ps(s[2], s[3]));
+	__m256 h4567 = _mm256_hadd_ps(_mm256_hadd_ps(s[4], s[5]), _mm256_hadd_ps(s[6], s[7]));
+	_mm256_storeu_ps(acc, _mm256_add_ps(_mm256_permute2f128_ps(h0123, h4567, 0x20), _mm256_permute2f128_ps(h0123, h4567, 0x31)));
+}
+#endif
+
+#if defined(__AVX512F__)
+// AVX-512 8x8 double kernel
+template<>
+inline void bsrBlockRowSpMV<double, 8>(const double *data, const int *blockCol, int first, int last, const double *inVector,
+		int tailBlockCol, const double *tailX, double *acc) {
+	__m512d s[8];
+	for (int i = 0; i < 8; i++) {
+		s[i] = _mm512_setzero_pd();
+	}
+	for (int b = first; b < last; b++) {
+		const double *block = data + (size_t) b * 64;
+		__m512d x = _mm512_loadu_pd(blockCol[b] == tailBlockCol ? tailX : inVector + (size_t) blockCol[b] * 8);
+		for (int i = 0; i < 8; i++) {
+			s[i] = _mm512_fmadd_pd(_mm512_loadu_pd(block + i * 8), x, s[i]);
+		}
+	}
+	for (int i = 0; i < 8; i++) {
+		acc[i] = _mm512_reduce_add_pd(s[i]);
+	}
+}
+#endif
+
+// bsr spMV of block rows [firstBlockRow, lastBlockRow) with a compile-time block size
+template<typename T, int BS>
+void bsrSpMVBlockRows(int rows, int cols, const int *blockRowptr, const int *blockCol, const T *data,
+		const T *inVector, T *outVector, int firstBlockRow, int lastBlockRow) {
+	const int tailBlockCol = cols % BS != 0 ? cols / BS : -1;
+	T tailX[BS] = {};
+	for (int j = 0; tailBlockCol >= 0 && tailBlockCol * BS + j < cols; j++) {
+		tailX[j] = inVector[tailBlockCol * BS + j];
+	}
+
+	T acc[BS];
+	for (int i = firstBlockRow; i < lastBlockRow; i++) {
+		bsrBlockRowSpMV<T, BS>(data, blockCol, blockRowptr[i], blockRowptr[i + 1], inVector, tailBlockCol, tailX, acc);
+		int n = std::min(BS, rows - i * BS);
+		for (int r = 0; r < n; r++) {
+			outVector[i * BS + r] = acc[r];
+		}
+	}
+}
+
+// multiply BSR sparse matrix with dense vector
+template<int ROWS, int COLS, int BLOCKSIZE, int NNZBLOCKS, typename T>
+void spMV(const SparseBSR<ROWS, COLS, BLOCKSIZE, NNZBLOCKS, T> &bsr, const T inVector[COLS], T outVector[ROWS]) {
+	bsrSpMVBlockRows<T, BLOCKSIZE>(ROWS, COLS, bsr.blockRowptr, bsr.blockCol, bsr.data, inVector, outVector,
+		0, (ROWS + BLOCKSIZE - 1) / BLOCKSIZE);
 }
 
 // multiply ELL sparse matrix with dense vector and store results in outVector
+// padding is recognized by its -1 column index, so explicitly stored zeros are handled correctly
 template<int ROWS, int COLS, int MAXNNZCOLS, typename T>
 void spMV(const SparseELL<ROWS, COLS, MAXNNZCOLS, T> &ell, const T inVector[COLS], T outVector[ROWS]) {
 	for (int i = 0; i < ROWS; i++) {
 		T dot = 0;
-		for (int j = 0; j < MAXNNZCOLS && ell.data[i * MAXNNZCOLS + j] != 0; j++) {
+		for (int j = 0; j < MAXNNZCOLS && ell.col[i * MAXNNZCOLS + j] != -1; j++) {
 			dot += ell.data[i * MAXNNZCOLS + j] * inVector[ell.col[i * MAXNNZCOLS + j]];
 		}
 		outVector[i] = dot;
 	}	
 }
 
+// tjds spMV on raw arrays for the stored columns [firstCol, lastCol) of every jagged diagonal.
+// inVector is in the original column order and is gathered through perm
+// (perm = nullptr: inVector has been reordered as part of sparse matrix encoding)
+template<typename T>
+void tjdsSpMVCols(int tjTiles, const int *start, const int *row_index, const T *val, const int *perm,
+		const T *inVector, T *outVector, int firstCol, int lastCol) {
+	for (int i = 0; i < tjTiles; i++) {
+		const int end = std::min(lastCol, start[i + 1] - start[i]);
+		const int *rowIdx = row_index + start[i];
+		const T *diag = val + start[i];
+		for (int p = firstCol; p < end; p++) {
+			outVector[rowIdx[p]] += diag[p] * inVector[perm != nullptr ? perm[p] : p];
+		}
+	}
+}
+
 // multiply TJDS sparse matrix with dense vector and store results in outVector
-// NOTE: assumes that inVector has been reordered as part of sparse matrix encoding
+// inVector is in the original column order
 template<int ROWS, int COLS, int NNZ, int TJ_TILES, typename T>
 void spMV(const SparseTJDS<ROWS, COLS, NNZ, TJ_TILES, T> &tjds, const T inVector[COLS], T outVector[ROWS]) {
 	
 	for (int i = 0; i < ROWS; i++) {
 		outVector[i] = 0;
 	}
-
-	for (int i = 0; i < TJ_TILES; i++) {
-		int vecIdx = 0;
-		for (int j = tjds.start[i]; j < tjds.start[i + 1]; j++) {
-			outVector[tjds.row_index[j]] += tjds.val[j] * inVector[vecIdx];
-			vecIdx += 1;
-		}
-	}	
+	tjdsSpMVCols(TJ_TILES, tjds.start, tjds.row_index, tjds.val, tjds.perm, inVector, outVector, 0, COLS);
 }
 
 // multiply SSS sparse matrix with dense vector
@@ -159,4 +294,1375 @@ void columnWiseProductSpMM(const SparseCSC<M, K, NNZ1, T> &a, const SparseCSC<K,
 	
 }
 
+// ---sparse x dense multi-vector products---
+// spMM multiplies a sparse matrix with K dense vectors at once. denseIn is COLS x K and denseOut is
+// ROWS x K, both row-major, so every non-zero element is read once and applied to a K-wide row slice
+// of denseIn; the cost of streaming the matrix is shared by all K right-hand sides.
+// the raw-array kernels take k at runtime and are shared by the fixed-size and runtime-sized formats
+
+// y[0 ... k - 1] += a * x[0 ... k - 1]
+template<typename T>
+inline void denseRowAxpy(int k, T a, const T *x, T *y) {
+	for (int j = 0; j < k; j++) {
+		y[j] += a * x[j];
+	}
+}
+
+#if defined(__AVX512F__) || (defined(__AVX2__) && defined(__FMA__))
+inline void denseRowAxpy(int k, double a, const double *x, double *y) {
+	int j = 0;
+#if defined(__AVX512F__)
+	__m512d a8 = _mm512_set1_pd(a);
+	for (; j + 8 <= k; j += 8) {
+		_mm512_storeu_pd(y + j, _mm512_fmadd_pd(a8, _mm512_loadu_pd(x + j), _mm512_loadu_pd(y + j)));
+	}
+#endif
+	__m256d a4 = _mm256_set1_pd(a);
+	for (; j + 4 <= k; j += 4) {
+		_mm256_storeu_pd(y + j, _mm256_fmadd_pd(a4, _mm256_loadu_pd(x + j), _mm256_loadu_pd(y + j)));
+	}
+	for (; j < k; j++) {
+		y[j] += a * x[j];
+	}
+}
+
+inline void denseRowAxpy(int k, float a, const float *x, float *y) {
+	int j = 0;
+#if defined(__AVX512F__)
+	__m512 a16 = _mm512_set1_ps(a);
+	for (; j + 16 <= k; j += 16) {
+		_mm512_storeu_ps(y + j, _mm512_fmadd_ps(a16, _mm512_loadu_ps(x + j), _mm512_loadu_ps(y + j)));
+	}
+#endif
+	__m256 a8 = _mm256_set1_ps(a);
+	for (; j + 8 <= k; j += 8) {
+		_mm256_storeu_ps(y + j, _mm256_fmadd_ps(a8, _mm256_loadu_ps(x + j), _mm256_loadu_ps(y + j)));
+	}
+	for (; j < k; j++) {
+		y[j] += a * x[j];
+	}
+}
+#endif
+
+// coo spMM on raw arrays
+template<typename T>
+void cooSpMM(int rows, int nnz, const int *row, const int *col, const T *data, int k, const T *denseIn, T *denseOut) {
+	std::fill(denseOut, denseOut + (size_t) rows * k, T(0));
+	for (int i = 0; i < nnz; i++) {
+		denseRowAxpy(k, data[i], denseIn + (size_t) col[i] * k, denseOut + (size_t) row[i] * k);
+	}
+}
+
+// csr spMM on raw arrays for rows [first, last)
+template<typename T>
+void csrSpMMRows(const int *rowptr, const int *col, const T *data, int k, const T *denseIn, T *denseOut,
+		int first, int last) {
+	for (int i = first; i < last; i++) {
+		T *out = denseOut + (size_t) i * k;
+		std::fill(out, out + k, T(0));
+		for (int j = rowptr[i]; j < rowptr[i + 1]; j++) {
+			denseRowAxpy(k, data[j], denseIn + (size_t) col[j] * k, out);
+		}
+	}
+}
+
+// bsr spMM on raw arrays, blocks are stored row-major and edge blocks are zero padded
+template<typename T>
+void bsrSpMM(int rows, int cols, int blockSize, const int *blockRowptr, const int *blockCol, const T *data,
+		int k, const T *denseIn, T *denseOut) {
+	const int bs = blockSize;
+	std::fill(denseOut, denseOut + (size_t) rows * k, T(0));
+	for (int i = 0; i < (rows + bs - 1) / bs; i++) {
+		int rowsInBlock = std::min(bs, rows - i * bs);
+		for (int j = blockRowptr[i]; j < blockRowptr[i + 1]; j++) {
+			const T *block = data + (size_t) j * bs * bs;
+			int colsInBlock = std::min(bs, cols - blockCol[j] * bs);
+			for (int block_i = 0; block_i < rowsInBlock; block_i++) {
+				T *out = denseOut + (size_t) (i * bs + block_i) * k;
+				for (int block_j = 0; block_j < colsInBlock; block_j++) {
+					denseRowAxpy(k, block[block_i * bs + block_j], denseIn + (size_t) (blockCol[j] * bs + block_j) * k, out);
+				}
+			}
+		}
+	}
+}
+
+// ell spMM on raw arrays, padding is recognized by its -1 column index
+template<typename T>
+void ellSpMM(int rows, int maxNnzCols, const int *col, const T *data, int k, const T *denseIn, T *denseOut) {
+	for (int i = 0; i < rows; i++) {
+		T *out = denseOut + (size_t) i * k;
+		std::fill(out, out + k, T(0));
+		for (size_t j = (size_t) i * maxNnzCols; j < (size_t) (i + 1) * maxNnzCols && col[j] >= 0; j++) {
+			denseRowAxpy(k, data[j], denseIn + (size_t) col[j] * k, out);
+		}
+	}
+}
+
+// tjds spMM on raw arrays, the rows of denseIn are gathered through perm like the inVector of tjds spMV
+template<typename T>
+void tjdsSpMM(int rows, int tjTiles, const int *start, const int *row_index, const T *val, const int *perm, int k,
+		const T *denseIn, T *denseOut) {
+	std::fill(denseOut, denseOut + (size_t) rows * k, T(0));
+	for (int i = 0; i < tjTiles; i++) {
+		int vecIdx = 0;
+		for (int j = start[i]; j < start[i + 1]; j++) {
+			int inRow = perm != nullptr ? perm[vecIdx] : vecIdx;
+			denseRowAxpy(k, val[j], denseIn + (size_t) inRow * k, denseOut + (size_t) row_index[j] * k);
+			vecIdx += 1;
+		}
+	}
+}
+
+// sss spMM on raw arrays, every stored lower element updates its row and its mirrored row
+template<typename T>
+void sssSpMM(int n, const T *dvalues, const int *rowptr, const int *col, const T *values, int k,
+		const T *denseIn, T *denseOut) {
+	for (int r = 0; r < n; r++) {
+		T *out = denseOut + (size_t) r * k;
+		std::fill(out, out + k, T(0));
+		denseRowAxpy(k, dvalues[r], denseIn + (size_t) r * k, out);
+	}
+	for (int r = 0; r < n; r++) {
+		for (int j = rowptr[r]; j < rowptr[r + 1]; j++) {
+			int c = col[j];
+			denseRowAxpy(k, values[j], denseIn + (size_t) c * k, denseOut + (size_t) r * k);
+			denseRowAxpy(k, values[j], denseIn + (size_t) r * k, denseOut + (size_t) c * k);
+		}
+	}
+}
+
+// multiply COO sparse matrix with K dense vectors (denseIn) and store results in denseOut
+template<int ROWS, int COLS, int NNZ, typename T, int K>
+void spMM(const SparseCOO<ROWS, COLS, NNZ, T> &coo, const T denseIn[COLS][K], T denseOut[ROWS][K]) {
+	cooSpMM(ROWS, NNZ, coo.row, coo.col, coo.data, K, &denseIn[0][0], &denseOut[0][0]);
+}
+
+// multiply CSR sparse matrix with K dense vectors (denseIn) and store results in denseOut
+template<int ROWS, int COLS, int NNZ, typename T, int K>
+void spMM(const SparseCSR<ROWS, COLS, NNZ, T> &csr, const T denseIn[COLS][K], T denseOut[ROWS][K]) {
+	csrSpMMRows(csr.rowptr, csr.col, csr.data, K, &denseIn[0][0], &denseOut[0][0], 0, ROWS);
+}
+
+// multiply BSR sparse matrix with K dense vectors (denseIn) and store results in denseOut
+template<int ROWS, int COLS, int BLOCKSIZE, int NNZBLOCKS, typename T, int K>
+void spMM(const SparseBSR<ROWS, COLS, BLOCKSIZE, NNZBLOCKS, T> &bsr, const T denseIn[COLS][K], T denseOut[ROWS][K]) {
+	bsrSpMM(ROWS, COLS, BLOCKSIZE, bsr.blockRowptr, bsr.blockCol, bsr.data, K, &denseIn[0][0], &denseOut[0][0]);
+}
+
+// multiply ELL sparse matrix with K dense vectors (denseIn) and store results in denseOut
+template<int ROWS, int COLS, int MAXNNZCOLS, typename T, int K>
+void spMM(const SparseELL<ROWS, COLS, MAXNNZCOLS, T> &ell, const T denseIn[COLS][K], T denseOut[ROWS][K]) {
+	ellSpMM(ROWS, MAXNNZCOLS, ell.col, ell.data, K, &denseIn[0][0], &denseOut[0][0]);
+}
+
+// multiply TJDS sparse matrix with K dense vectors (denseIn) and store results in denseOut
+template<int ROWS, int COLS, int NNZ, int TJ_TILES, typename T, int K>
+void spMM(const SparseTJDS<ROWS, COLS, NNZ, TJ_TILES, T> &tjds, const T denseIn[COLS][K], T denseOut[ROWS][K]) {
+	tjdsSpMM(ROWS, TJ_TILES, tjds.start, tjds.row_index, tjds.val, tjds.perm, K, &denseIn[0][0], &denseOut[0][0]);
+}
+
+// multiply SSS sparse matrix with K dense vectors (denseIn) and store results in denseOut
+template<int N, int LOWERNNZ, typename T, int K>
+void spMM(const SparseSSS<N, LOWERNNZ, T> &sss, const T denseIn[N][K], T denseOut[N][K]) {
+	sssSpMM(N, sss.dvalues, sss.rowptr, sss.col, sss.values, K, &denseIn[0][0], &denseOut[0][0]);
+}
+
+// ---runtime-sized formats---
+// same entry points as above; vectors are plain arrays of length cols (inVector) and rows (outVector)
+// dense matrices are row-major arrays
+
+// multiply runtime-sized COO sparse matrix with dense vector and store results in outVector
+template<typename T>
+void spMV(const DynSparseCOO<T> &coo, const T *inVector, T *outVector) {
+	for (int i = 0; i < coo.rows; i++) {
+		outVector[i] = 0;
+	}
+
+	for (int i = 0; i < coo.nnz; i++) {
+		outVector[coo.row[i]] += coo.data[i] * inVector[coo.col[i]];
+	}
+}
+
+// sum of data[j] * inVector[col[j]] for j in [begin, end)
+template<typename T, typename I>
+inline T sparseDot(const T *data, const I *col, const T *inVector, int begin, int end) {
+	T dot = 0;
+	for (int j = begin; j < end; j++) {
+		dot += data[j] * inVector[col[j]];
+	}
+	return dot;
+}
+
+#if defined(__AVX512F__)
+// AVX-512 gather + fused multiply-add, scalar tail
+inline double sparseDot(const double *data, const int *col, const double *inVector, int begin, int end) {
+	__m512d sum = _mm512_setzero_pd();
+	int j = begin;
+	for (; j + 8 <= end; j += 8) {
+		__m256i idx = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(col + j));
+		sum = _mm512_fmadd_pd(_mm512_loadu_pd(data + j), _mm512_i32gather_pd(idx, inVector, 8), sum);
+	}
+	double dot = _mm512_reduce_add_pd(sum);
+	for (; j < end; j++) {
+		dot += data[j] * inVector[col[j]];
+	}
+	return dot;
+}
+
+inline float sparseDot(const float *data, const int *col, const float *inVector, int begin, int end) {
+	__m512 sum = _mm512_setzero_ps();
+	int j = begin;
+	for (; j + 16 <= end; j += 16) {
+		__m512i idx = _mm512_loadu_si512(col + j);
+		sum = _mm512_fmadd_ps(_mm512_loadu_ps(data + j), _mm512_i32gather_ps(idx, inVector, 4), sum);
+	}
+	float dot = _mm512_reduce_add_ps(sum);
+	for (; j < end; j++) {
+		dot += data[j] * inVector[col[j]];
+	}
+	return dot;
+}
+#elif defined(__AVX2__) && defined(__FMA__)
+// AVX2 gather + fused multiply-add, scalar tail
+inline double sparseDot(const double *data, const int *col, const double *inVector, int begin, int end) {
+	__m256d sum = _mm256_setzero_pd();
+	int j = begin;
+	for (; j + 4 <= end; j += 4) {
+		__m128i idx = _mm_loadu_si128(reinterpret_cast<const __m128i *>(col + j));
+		sum = _mm256_fmadd_pd(_mm256_loadu_pd(data + j), _mm256_i32gather_pd(inVector, idx, 8), sum);
+	}
+	alignas(32) double lanes[4];
+	_mm256_store_pd(lanes, sum);
+	double dot = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+	for (; j < end; j++) {
+		dot += data[j] * inVector[col[j]];
+	}
+	return dot;
+}
+
+inline float sparseDot(const float *data, const int *col, const float *inVector, int begin, int end) {
+	__m256 sum = _mm256_setzero_ps();
+	int j = begin;
+	for (; j + 8 <= end; j += 8) {
+		__m256i idx = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(col + j));
+		sum = _mm256_fmadd_ps(_mm256_loadu_ps(data + j), _mm256_i32gather_ps(inVector, idx, 4), sum);
+	}
+	alignas(32) float lanes[8];
+	_mm256_store_ps(lanes, sum);
+	float dot = ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) + ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7]));
+	for (; j < end; j++) {
+		dot += data[j] * inVector[col[j]];
+	}
+	return dot;
+}
+#endif
+
+// coo spMV on raw arrays as a segmented reduction; the elements should be sorted by row, as the
+// dense-scan constructors and buildCOO produce them. a read-only pass over the same slices checks
+// that first (as cooToCSR does), and unsorted input goes to a serial scatter instead.
+// every thread takes an equal slice of the elements and reduces each run of equal rows with sparseDot.
+// the run a slice starts with may have begun in an earlier slice, so its sum is kept as the slice's
+// carry-out and added once all threads are done; every later run starts inside the slice and is
+// written directly. rows without elements are zeroed by the thread whose slice passes over them
+template<typename T>
+void cooParallelSpMV(int rows, int nnz, const int *row, const int *col, const T *data,
+		const T *inVector, T *outVector, ThreadPool &pool) {
+	const int numThreads = pool.size();
+	std::vector<T> carry(numThreads, 0);
+	std::vector<int> carryRow(numThreads, -1);
+	std::vector<char> unsorted(numThreads, 0);
+
+	pool.run([&](int tid) {
+		long begin, end;
+		splitRange(nnz, numThreads, tid, begin, end);
+		for (long j = std::max(begin, 1L); j < end && !unsorted[tid]; j++) {
+			unsorted[tid] = row[j - 1] > row[j];
+		}
+	});
+	if (std::find(unsorted.begin(), unsorted.end(), 1) != unsorted.end()) {
+		std::fill(outVector, outVector + rows, T(0));
+		for (int j = 0; j < nnz; j++) {
+			outVector[row[j]] += data[j] * inVector[col[j]];
+		}
+		return;
+	}
+
+	pool.run([&](int tid) {
+		long begin, end;
+		splitRange(nnz, numThreads, tid, begin, end);
+		if (begin == end) {
+			if (nnz == 0 && tid == 0) {
+				std::fill(outVector, outVector + rows, T(0));
+			}
+			return;
+		}
+		// empty rows between the previous slice's last element and this slice's first one
+		for (int i = begin == 0 ? 0 : row[begin - 1] + 1; i < row[begin]; i++) {
+			outVector[i] = 0;
+		}
+
+		for (int j = (int) begin; j < end; ) {
+			int r = row[j];
+			int s = j;
+			while (j < end && row[j] == r) {
+				j++;
+			}
+			T dot = sparseDot(data, col, inVector, s, j);
+			if (s == begin) {
+				carry[tid] = dot;
+				carryRow[tid] = r;
+			} else {
+				for (int i = row[s - 1] + 1; i < r; i++) {
+					outVector[i] = 0;
+				}
+				outVector[r] = dot;
+			}
+		}
+
+		if (end == nnz) {
+			for (int i = row[nnz - 1] + 1; i < rows; i++) {
+				outVector[i] = 0;
+			}
+		}
+	});
+
+	// a slice's first run continues a row written by an earlier slice unless it starts the row
+	for (int t = 0; t < numThreads; t++) {
+		if (carryRow[t] < 0) {
+			continue;
+		}
+		long begin, end;
+		splitRange(nnz, numThreads, t, begin, end);
+		if (begin == 0 || row[begin - 1] != carryRow[t]) {
+			outVector[carryRow[t]] = carry[t];
+		} else {
+			outVector[carryRow[t]] += carry[t];
+		}
+	}
+}
+
+// multithreaded, vectorized spMV on a runtime-sized COO sparse matrix. only row-sorted matrices
+// (buildCOO, csrToCOO, the dense-scan constructor) run in parallel, others fall back to a serial scatter
+template<typename T>
+void parallelSpMV(const DynSparseCOO<T> &coo, const T *inVector, T *outVector, ThreadPool &pool) {
+	cooParallelSpMV(coo.rows, coo.nnz, coo.row.get(), coo.col.get(), coo.data.get(), inVector, outVector, pool);
+}
+
+// multithreaded, vectorized spMV on a fixed-size COO sparse matrix (row-sorted by construction)
+template<int ROWS, int COLS, int NNZ, typename T>
+void parallelSpMV(const SparseCOO<ROWS, COLS, NNZ, T> &coo, const T inVector[COLS], T outVector[ROWS], ThreadPool &pool) {
+	cooParallelSpMV(ROWS, NNZ, coo.row, coo.col, coo.data, inVector, outVector, pool);
+}
+
+// csr spMV on raw arrays for rows [first, last)
+// shared by every csr-like matrix (runtime-sized, memory-mapped, ...)
+// I: column index type, P: row pointer type (int for all formats except SparseIndexedCSR)
+template<typename T, typename I, typename P>
+void csrSpMVRows(const P *rowptr, const I *col, const T *data, const T *inVector, T *outVector, int first, int last) {
+	for (int i = first; i < last; i++) {
+		T dot = 0;
+		for (P j = rowptr[i]; j < rowptr[i + 1]; j++) {
+			dot += data[j] * inVector[col[j]];
+		}
+		outVector[i] = dot;
+	}
+}
+
+// csr spMV for rows [first, last) with one gathered dot product per row (sparseDot),
+// ahead of csrSpMVRows once the rows are long enough to fill the vector registers
+template<typename T>
+void csrSpMVRowsGather(const int *rowptr, const int *col, const T *data, const T *inVector, T *outVector,
+		int first, int last) {
+	for (int i = first; i < last; i++) {
+		outVector[i] = sparseDot(data, col, inVector, rowptr[i], rowptr[i + 1]);
+	}
+}
+
+// csr spMV for rows [first, last) that prefetches the element of inVector needed distance non-zero
+// elements ahead, which hides part of the latency of the indirect loads once inVector no longer fits in cache
+template<typename T>
+void csrSpMVRowsPrefetch(const int *rowptr, const int *col, const T *data, const T *inVector, T *outVector,
+		int first, int last, int distance) {
+	const int end = rowptr[last];
+	for (int i = first; i < last; i++) {
+		T dot = 0;
+		for (int j = rowptr[i]; j < rowptr[i + 1]; j++) {
+			__builtin_prefetch(inVector + col[std::min(j + distance, end - 1)]);
+			dot += data[j] * inVector[col[j]];
+		}
+		outVector[i] = dot;
+	}
+}
+
+// csc spMV on raw arrays
+template<typename T>
+void cscSpMV(int rows, int cols, const int *colptr, const int *row, const T *data, const T *inVector, T *outVector) {
+	for (int i = 0; i < rows; i++) {
+		outVector[i] = 0;
+	}
+
+	for (int j = 0; j < cols; j++) {
+		for (int i = colptr[j]; i < colptr[j + 1]; i++) {
+			outVector[row[i]] += data[i] * inVector[j];
+		}
+	}
+}
+
+// bsr spMV of block rows [firstBlockRow, lastBlockRow) with a runtime block size, blocks are stored row-major
+template<typename T>
+void bsrSpMVGenericBlockRows(int rows, int cols, int blockSize, const int *blockRowptr, const int *blockCol,
+		const T *data, const T *inVector, T *outVector, int firstBlockRow, int lastBlockRow) {
+	const int bs = blockSize;
+	for (int i = firstBlockRow * bs; i < std::min(rows, lastBlockRow * bs); i++) {
+		outVector[i] = 0;
+	}
+	for (int i = firstBlockRow; i < lastBlockRow; i++) {
+		int rowsInBlock = std::min(bs, rows - i * bs);
+		for (int j = blockRowptr[i]; j < blockRowptr[i + 1]; j++) {
+			const T *block = data + (size_t) j * bs * bs;
+			const T *x = inVector + (size_t) blockCol[j] * bs;
+			int colsInBlock = std::min(bs, cols - blockCol[j] * bs);
+			for (int block_i = 0; block_i < rowsInBlock; block_i++) {
+				T dot = 0;
+				for (int block_j = 0; block_j < colsInBlock; block_j++) {
+					dot += block[block_i * bs + block_j] * x[block_j];
+				}
+				outVector[i * bs + block_i] += dot;
+			}
+		}
+	}
+}
+
+// bsr spMV on raw arrays, blocks are stored row-major
+// common block sizes go to the register-blocked kernels, others to a generic loop
+template<typename T>
+void bsrSpMV(int rows, int cols, int blockSize, const int *blockRowptr, const int *blockCol, const T *data,
+		const T *inVector, T *outVector) {
+	const int bs = blockSize;
+	const int blockRows = (rows + bs - 1) / bs;
+	switch (bs) {
+	case 1:
+		csrSpMVRows(blockRowptr, blockCol, data, inVector, outVector, 0, rows);
+		return;
+	case 2:
+		bsrSpMVBlockRows<T, 2>(rows, cols, blockRowptr, blockCol, data, inVector, outVector, 0, blockRows);
+		return;
+	case 3:
+		bsrSpMVBlockRows<T, 3>(rows, cols, blockRowptr, blockCol, data, inVector, outVector, 0, blockRows);
+		return;
+	case 4:
+		bsrSpMVBlockRows<T, 4>(rows, cols, blockRowptr, blockCol, data, inVector, outVector, 0, blockRows);
+		return;
+	case 8:
+		bsrSpMVBlockRows<T, 8>(rows, cols, blockRowptr, blockCol, data, inVector, outVector, 0, blockRows);
+		return;
+	}
+	bsrSpMVGenericBlockRows(rows, cols, bs, blockRowptr, blockCol, data, inVector, outVector, 0, blockRows);
+}
+
+// multiply runtime-sized CSR sparse matrix with dense vector and store results in outVector
+template<typename T>
+void spMV(const DynSparseCSR<T> &csr, const T *inVector, T *outVector) {
+	csrSpMVRows(csr.rowptr.get(), csr.col.get(), csr.data.get(), inVector, outVector, 0, csr.rows);
+}
+
+// split of the rows of a csr matrix into numParts contiguous ranges with (almost) equal numbers
+// of non-zero elements, found by binary search on rowptr.
+// splitting by equal row counts leaves most threads idle on power-law matrices,
+// where a few rows hold most of the non-zero elements.
+// compute it once per matrix and reuse it for every parallelSpMV call
+class RowPartition {
+public:
+	RowPartition() {}
+
+	template<typename P>
+	RowPartition(const P *rowptr, int rows, int numParts) : bounds(numParts + 1) {
+		for (int t = 0; t <= numParts; t++) {
+			bounds[t] = balancedSplit(rowptr, rows, numParts, t);
+		}
+	}
+
+	template<typename T>
+	RowPartition(const DynSparseCSR<T> &csr, int numParts) : RowPartition(csr.rowptr.get(), csr.rows, numParts) {}
+
+	template<int ROWS, int COLS, int NNZ, typename T>
+	RowPartition(const SparseCSR<ROWS, COLS, NNZ, T> &csr, int numParts) : RowPartition(csr.rowptr, ROWS, numParts) {}
+
+	template<typename T, typename I>
+	RowPartition(const SparseTiledCSR<T, I> &tiled, int numParts) : RowPartition(tiled.totalRowptr.get(), tiled.rows, numParts) {}
+
+	template<typename T, typename I, typename P>
+	RowPartition(const SparseIndexedCSR<T, I, P> &csr, int numParts) : RowPartition(csr.rowptr.get(), csr.rows, numParts) {}
+
+	template<typename T, typename D>
+	RowPartition(const SparseDeltaCSR<T, D> &csr, int numParts) : RowPartition(csr.rowptr.get(), csr.rows, numParts) {}
+
+	int numParts() const {
+		return (int) bounds.size() - 1;
+	}
+
+	// part t covers rows [bounds[t], bounds[t + 1])
+	std::vector<int> bounds;
+};
+
+// csr spMV on raw arrays, with the row ranges of partition spread over the threads of pool
+template<typename T, typename I, typename P>
+void csrParallelSpMV(const P *rowptr, const I *col, const T *data, const T *inVector, T *outVector,
+		const RowPartition &partition, ThreadPool &pool) {
+	pool.run([&](int tid) {
+		for (int t = tid; t < partition.numParts(); t += pool.size()) {
+			csrSpMVRows(rowptr, col, data, inVector, outVector, partition.bounds[t], partition.bounds[t + 1]);
+		}
+	});
+}
+
+// multithreaded CSR spMV; partition is usually RowPartition(csr, pool.size())
+template<typename T>
+void parallelSpMV(const DynSparseCSR<T> &csr, const T *inVector, T *outVector,
+		const RowPartition &partition, ThreadPool &pool) {
+	csrParallelSpMV(csr.rowptr.get(), csr.col.get(), csr.data.get(), inVector, outVector, partition, pool);
+}
+
+template<int ROWS, int COLS, int NNZ, typename T>
+void parallelSpMV(const SparseCSR<ROWS, COLS, NNZ, T> &csr, const T inVector[COLS], T outVector[ROWS],
+		const RowPartition &partition, ThreadPool &pool) {
+	csrParallelSpMV(csr.rowptr, csr.col, csr.data, inVector, outVector, partition, pool);
+}
+
+// merge-path split of a csr matrix, based on "Merge-based Parallel Sparse Matrix-Vector Multiplication"
+// (Merrill, Garland). spMV is viewed as merging the row end offsets rowptr[1 ... rows] with the
+// non-zero indices 0 ... nnz - 1; that merge path of rows + nnz steps is cut into numParts equal
+// pieces. every part gets the same amount of work whatever the row lengths, even when a single
+// row holds most of the non-zero elements. compute it once per matrix and reuse it
+class MergePathPartition {
+public:
+	MergePathPartition() {}
+
+	MergePathPartition(const int *rowptr, int rows, int numParts) : rowStart(numParts + 1), nzStart(numParts + 1) {
+		long nnz = rowptr[rows];
+		long pathLength = rows + nnz;
+		for (int t = 0; t <= numParts; t++) {
+			// binary search along the diagonal for the first point where row ends are ahead of non-zeros
+			long diagonal = std::min(pathLength, pathLength * t / numParts);
+			long lo = std::max(diagonal - nnz, 0L);
+			long hi = std::min(diagonal, (long) rows);
+			while (lo < hi) {
+				long pivot = (lo + hi) / 2;
+				if (rowptr[pivot + 1] <= diagonal - pivot - 1) {
+					lo = pivot + 1;
+				} else {
+					hi = pivot;
+				}
+			}
+			rowStart[t] = (int) lo;
+			nzStart[t] = (int) (diagonal - lo);
+		}
+	}
+
+	template<typename T>
+	MergePathPartition(const DynSparseCSR<T> &csr, int numParts) : MergePathPartition(csr.rowptr.get(), csr.rows, numParts) {}
+
+	template<int ROWS, int COLS, int NNZ, typename T>
+	MergePathPartition(const SparseCSR<ROWS, COLS, NNZ, T> &csr, int numParts) : MergePathPartition(csr.rowptr, ROWS, numParts) {}
+
+	int numParts() const {
+		return (int) rowStart.size() - 1;
+	}
+
+	// part t starts at row rowStart[t] and non-zero element nzStart[t]
+	std::vector<int> rowStart;
+	std::vector<int> nzStart;
+};
+
+// merge-path csr spMV on raw arrays.
+// every part writes the rows it completes and returns the partial sum of the row it stops in
+// (its carry-out) in carry[t], which is added once all parts are done.
+// carry holds one element per part; the overload without it allocates one per call
+template<typename T>
+void csrMergePathSpMV(const int *rowptr, const int *col, const T *data, int rows, const T *inVector, T *outVector,
+		const MergePathPartition &partition, ThreadPool &pool, T *carry) {
+	const int numParts = partition.numParts();
+	pool.run([&](int tid) {
+		for (int t = tid; t < numParts; t += pool.size()) {
+			int row = partition.rowStart[t];
+			int nz = partition.nzStart[t];
+			const int rowEnd = partition.rowStart[t + 1];
+			const int nzEnd = partition.nzStart[t + 1];
+
+			for (; row < rowEnd; row++) {
+				T dot = 0;
+				for (; nz < rowptr[row + 1]; nz++) {
+					dot += data[nz] * inVector[col[nz]];
+				}
+				outVector[row] = dot;
+			}
+
+			T partial = 0;
+			for (; nz < nzEnd; nz++) {
+				partial += data[nz] * inVector[col[nz]];
+			}
+			carry[t] = partial;
+		}
+	});
+
+	// a part's carry-out belongs to the row it stopped in, which a later part completes.
+	// parts are fixed up in order, after every row has been written
+	for (int t = 0; t < numParts; t++) {
+		if (partition.rowStart[t + 1] < rows) {
+			outVector[partition.rowStart[t + 1]] += carry[t];
+		}
+	}
+}
+
+template<typename T>
+void csrMergePathSpMV(const int *rowptr, const int *col, const T *data, int rows, const T *inVector, T *outVector,
+		const MergePathPartition &partition, ThreadPool &pool) {
+	std::vector<T> carry(partition.numParts(), T(0));
+	csrMergePathSpMV(rowptr, col, data, rows, inVector, outVector, partition, pool, carry.data());
+}
+
+// merge-path CSR spMV; partition is usually MergePathPartition(csr, pool.size())
+template<typename T>
+void mergePathSpMV(const DynSparseCSR<T> &csr, const T *inVector, T *outVector,
+		const MergePathPartition &partition, ThreadPool &pool) {
+	csrMergePathSpMV(csr.rowptr.get(), csr.col.get(), csr.data.get(), csr.rows, inVector, outVector, partition, pool);
+}
+
+template<int ROWS, int COLS, int NNZ, typename T>
+void mergePathSpMV(const SparseCSR<ROWS, COLS, NNZ, T> &csr, const T inVector[COLS], T outVector[ROWS],
+		const MergePathPartition &partition, ThreadPool &pool) {
+	csrMergePathSpMV(csr.rowptr, csr.col, csr.data, ROWS, inVector, outVector, partition, pool);
+}
+
+// column-tiled csr spMV for rows [first, last): outVector is accumulated panel by panel, so every
+// panel only gathers from its own slice of inVector
+template<typename T, typename I>
+void tiledSpMVRows(const SparseTiledCSR<T, I> &tiled, const T *inVector, T *outVector, int first, int last) {
+	for (int i = first; i < last; i++) {
+		outVector[i] = 0;
+	}
+	const int *rowIdx = tiled.rowIdx.get();
+	for (int p = 0; p < tiled.numPanels; p++) {
+		const T *panelVector = inVector + (size_t) p * tiled.panelWidth;
+		int k = (int) (std::lower_bound(rowIdx + tiled.panelPtr[p], rowIdx + tiled.panelPtr[p + 1], first) - rowIdx);
+		for (; k < tiled.panelPtr[p + 1] && rowIdx[k] < last; k++) {
+			outVector[rowIdx[k]] += sparseDot(tiled.data.get(), tiled.col.get(), panelVector, tiled.rowptr[k], tiled.rowptr[k + 1]);
+		}
+	}
+}
+
+// multiply column-tiled CSR sparse matrix with dense vector and store results in outVector
+template<typename T, typename I>
+void spMV(const SparseTiledCSR<T, I> &tiled, const T *inVector, T *outVector) {
+	tiledSpMVRows(tiled, inVector, outVector, 0, tiled.rows);
+}
+
+// multithreaded column-tiled CSR spMV over row blocks; partition is usually RowPartition(tiled, pool.size()).
+// every thread sweeps the panels over its own rows, so no output row is shared
+template<typename T, typename I>
+void parallelSpMV(const SparseTiledCSR<T, I> &tiled, const T *inVector, T *outVector,
+		const RowPartition &partition, ThreadPool &pool) {
+	pool.run([&](int tid) {
+		for (int t = tid; t < partition.numParts(); t += pool.size()) {
+			tiledSpMVRows(tiled, inVector, outVector, partition.bounds[t], partition.bounds[t + 1]);
+		}
+	});
+}
+
+// multiply CSR sparse matrix with narrow or wide index types with dense vector and store results in outVector
+template<typename T, typename I, typename P>
+void spMV(const SparseIndexedCSR<T, I, P> &csr, const T *inVector, T *outVector) {
+	csrSpMVRows(csr.rowptr.get(), csr.col.get(), csr.data.get(), inVector, outVector, 0, csr.rows);
+}
+
+// multithreaded spMV of a CSR matrix with narrow or wide index types; partition is usually RowPartition(csr, pool.size())
+template<typename T, typename I, typename P>
+void parallelSpMV(const SparseIndexedCSR<T, I, P> &csr, const T *inVector, T *outVector,
+		const RowPartition &partition, ThreadPool &pool) {
+	csrParallelSpMV(csr.rowptr.get(), csr.col.get(), csr.data.get(), inVector, outVector, partition, pool);
+}
+
+// next column of a delta-compressed row: adds the difference at p to c and advances p past it
+template<typename D>
+inline void decodeDelta(const D *&p, int &c) {
+	D d = *p++;
+	if (d != std::numeric_limits<D>::max()) {
+		c += d;
+	} else {
+		int delta;
+		std::memcpy(&delta, p, sizeof(int));
+		p += sizeof(int) / sizeof(D);
+		c += delta;
+	}
+}
+
+// delta-compressed csr spMV for rows [first, last), the column indices are decoded on the fly.
+// two partial sums per row, so the decoding overlaps the latency of the multiply-adds
+template<typename T, typename D>
+void deltaCSRSpMVRows(const SparseDeltaCSR<T, D> &csr, const T *inVector, T *outVector, int first, int last) {
+	const D *deltas = csr.deltas.get();
+	const T *data = csr.data.get();
+	for (int i = first; i < last; i++) {
+		T dot0 = 0;
+		T dot1 = 0;
+		int begin = csr.rowptr[i];
+		int end = csr.rowptr[i + 1];
+		if (begin < end) {
+			const D *p = deltas + csr.deltaPtr[i];
+			int c;
+			std::memcpy(&c, p, sizeof(int));
+			p += SparseDeltaCSR<T, D>::FULL_UNITS;
+			dot0 = data[begin] * inVector[c];
+			int j = begin + 1;
+			for (; j + 2 <= end; j += 2) {
+				decodeDelta(p, c);
+				dot1 += data[j] * inVector[c];
+				decodeDelta(p, c);
+				dot0 += data[j + 1] * inVector[c];
+			}
+			if (j < end) {
+				decodeDelta(p, c);
+				dot1 += data[j] * inVector[c];
+			}
+		}
+		outVector[i] = dot0 + dot1;
+	}
+}
+
+// multiply delta-compressed CSR sparse matrix with dense vector and store results in outVector
+template<typename T, typename D>
+void spMV(const SparseDeltaCSR<T, D> &csr, const T *inVector, T *outVector) {
+	deltaCSRSpMVRows(csr, inVector, outVector, 0, csr.rows);
+}
+
+// multithreaded delta-compressed CSR spMV; partition is usually RowPartition(csr, pool.size())
+template<typename T, typename D>
+void parallelSpMV(const SparseDeltaCSR<T, D> &csr, const T *inVector, T *outVector,
+		const RowPartition &partition, ThreadPool &pool) {
+	pool.run([&](int tid) {
+		for (int t = tid; t < partition.numParts(); t += pool.size()) {
+			deltaCSRSpMVRows(csr, inVector, outVector, partition.bounds[t], partition.bounds[t + 1]);
+		}
+	});
+}
+
+// multiply runtime-sized CSC sparse matrix with dense vector and store results in outVector
+template<typename T>
+void spMV(const DynSparseCSC<T> &csc, const T *inVector, T *outVector) {
+	cscSpMV(csc.rows, csc.cols, csc.colptr.get(), csc.row.get(), csc.data.get(), inVector, outVector);
+}
+
+// multiply runtime-sized BSR sparse matrix with dense vector
+template<typename T>
+void spMV(const DynSparseBSR<T> &bsr, const T *inVector, T *outVector) {
+	bsrSpMV(bsr.rows, bsr.cols, bsr.blockSize, bsr.blockRowptr.get(), bsr.blockCol.get(), bsr.data.get(), inVector, outVector);
+}
+
+// multiply runtime-sized ELL sparse matrix with dense vector and store results in outVector
+// padding is recognized by its -1 column index, so explicitly stored zeros are handled correctly
+template<typename T>
+void spMV(const DynSparseELL<T> &ell, const T *inVector, T *outVector) {
+	for (int i = 0; i < ell.rows; i++) {
+		T dot = 0;
+		for (size_t j = (size_t) i * ell.maxNnzCols; j < (size_t) (i + 1) * ell.maxNnzCols && ell.col[j] >= 0; j++) {
+			dot += ell.data[j] * inVector[ell.col[j]];
+		}
+		outVector[i] = dot;
+	}
+}
+
+// one chunk of a SELL-C-sigma matrix: acc[r] = sum over j of data[j * C + r] * inVector[col[j * C + r]]
+// scalar fallback, written so that the compiler can vectorize the loop over r
+template<typename T, int C>
+inline void sellChunkSpMV(const T *data, const int *col, int width, const T *inVector, T *acc) {
+	for (int r = 0; r < C; r++) {
+		acc[r] = 0;
+	}
+	for (int j = 0; j < width; j++) {
+		for (int r = 0; r < C; r++) {
+			acc[r] += data[j * C + r] * inVector[col[j * C + r]];
+		}
+	}
+}
+
+#if defined(__AVX2__) && defined(__FMA__)
+// AVX2 chunk kernels: C rows per gather + fused multiply-add
+template<>
+inline void sellChunkSpMV<double, 4>(const double *data, const int *col, int width, const double *inVector, double *acc) {
+	__m256d sum = _mm256_setzero_pd();
+	for (int j = 0; j < width; j++) {
+		__m128i idx = _mm_loadu_si128(reinterpret_cast<const __m128i *>(col + j * 4));
+		sum = _mm256_fmadd_pd(_mm256_loadu_pd(data + j * 4), _mm256_i32gather_pd(inVector, idx, 8), sum);
+	}
+	_mm256_storeu_pd(acc, sum);
+}
+
+template<>
+inline void sellChunkSpMV<float, 8>(const float *data, const int *col, int width, const float *inVector, float *acc) {
+	__m256 sum = _mm256_setzero_ps();
+	for (int j = 0; j < width; j++) {
+		__m256i idx = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(col + j * 8));
+		sum = _mm256_fmadd_ps(_mm256_loadu_ps(data + j * 8), _mm256_i32gather_ps(inVector, idx, 4), sum);
+	}
+	_mm256_storeu_ps(acc, sum);
+}
+#endif
+
+#if defined(__AVX512F__)
+// AVX-512 chunk kernels
+template<>
+inline void sellChunkSpMV<double, 8>(const double *data, const int *col, int width, const double *inVector, double *acc) {
+	__m512d sum = _mm512_setzero_pd();
+	for (int j = 0; j < width; j++) {
+		__m256i idx = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(col + j * 8));
+		sum = _mm512_fmadd_pd(_mm512_loadu_pd(data + j * 8), _mm512_i32gather_pd(idx, inVector, 8), sum);
+	}
+	_mm512_storeu_pd(acc, sum);
+}
+
+template<>
+inline void sellChunkSpMV<float, 16>(const float *data, const int *col, int width, const float *inVector, float *acc) {
+	__m512 sum = _mm512_setzero_ps();
+	for (int j = 0; j < width; j++) {
+		__m512i idx = _mm512_loadu_si512(col + j * 16);
+		sum = _mm512_fmadd_ps(_mm512_loadu_ps(data + j * 16), _mm512_i32gather_ps(idx, inVector, 4), sum);
+	}
+	_mm512_storeu_ps(acc, sum);
+}
+#endif
+
+// SELL-C-sigma spMV for chunks [firstChunk, lastChunk), results are scattered back to the original rows
+template<typename T, int C>
+void sellSpMVChunks(const SparseSELL<T, C> &sell, const T *inVector, T *outVector, int firstChunk, int lastChunk) {
+	alignas(SPARSE_ALIGNMENT) T acc[C];
+	for (int c = firstChunk; c < lastChunk; c++) {
+		sellChunkSpMV<T, C>(sell.data.get() + sell.chunkPtr[c], sell.col.get() + sell.chunkPtr[c], sell.chunkLen[c],
+			inVector, acc);
+		for (int r = 0; r < C && c * C + r < sell.rows; r++) {
+			outVector[sell.rowPerm[c * C + r]] = acc[r];
+		}
+	}
+}
+
+// multiply SELL-C-sigma sparse matrix with dense vector and store results in outVector
+template<typename T, int C>
+void spMV(const SparseSELL<T, C> &sell, const T *inVector, T *outVector) {
+	sellSpMVChunks(sell, inVector, outVector, 0, sell.numChunks);
+}
+
+// multithreaded SELL-C-sigma spMV, chunks are split by their stored (padded) elements
+template<typename T, int C>
+void parallelSpMV(const SparseSELL<T, C> &sell, const T *inVector, T *outVector, ThreadPool &pool) {
+	pool.run([&](int tid) {
+		int first = balancedSplit(sell.chunkPtr.get(), sell.numChunks, pool.size(), tid);
+		int last = balancedSplit(sell.chunkPtr.get(), sell.numChunks, pool.size(), tid + 1);
+		sellSpMVChunks(sell, inVector, outVector, first, last);
+	});
+}
+
+// acc[i] += data[i] * inVector[col[i]] for i in [0, n), one ELL column of a block of rows
+template<typename T>
+inline void gatherAxpy(const T *data, const int *col, int n, const T *inVector, T *acc) {
+	for (int i = 0; i < n; i++) {
+		acc[i] += data[i] * inVector[col[i]];
+	}
+}
+
+#if defined(__AVX512F__)
+inline void gatherAxpy(const double *data, const int *col, int n, const double *inVector, double *acc) {
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256i idx = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(col + i));
+		__m512d x = _mm512_i32gather_pd(idx, inVector, 8);
+		_mm512_storeu_pd(acc + i, _mm512_fmadd_pd(_mm512_loadu_pd(data + i), x, _mm512_loadu_pd(acc + i)));
+	}
+	for (; i < n; i++) {
+		acc[i] += data[i] * inVector[col[i]];
+	}
+}
+
+inline void gatherAxpy(const float *data, const int *col, int n, const float *inVector, float *acc) {
+	int i = 0;
+	for (; i + 16 <= n; i += 16) {
+		__m512 x = _mm512_i32gather_ps(_mm512_loadu_si512(col + i), inVector, 4);
+		_mm512_storeu_ps(acc + i, _mm512_fmadd_ps(_mm512_loadu_ps(data + i), x, _mm512_loadu_ps(acc + i)));
+	}
+	for (; i < n; i++) {
+		acc[i] += data[i] * inVector[col[i]];
+	}
+}
+#elif defined(__AVX2__) && defined(__FMA__)
+inline void gatherAxpy(const double *data, const int *col, int n, const double *inVector, double *acc) {
+	int i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128i idx = _mm_loadu_si128(reinterpret_cast<const __m128i *>(col + i));
+		__m256d x = _mm256_i32gather_pd(inVector, idx, 8);
+		_mm256_storeu_pd(acc + i, _mm256_fmadd_pd(_mm256_loadu_pd(data + i), x, _mm256_loadu_pd(acc + i)));
+	}
+	for (; i < n; i++) {
+		acc[i] += data[i] * inVector[col[i]];
+	}
+}
+
+inline void gatherAxpy(const float *data, const int *col, int n, const float *inVector, float *acc) {
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256i idx = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(col + i));
+		__m256 x = _mm256_i32gather_ps(inVector, idx, 4);
+		_mm256_storeu_ps(acc + i, _mm256_fmadd_ps(_mm256_loadu_ps(data + i), x, _mm256_loadu_ps(acc + i)));
+	}
+	for (; i < n; i++) {
+		acc[i] += data[i] * inVector[col[i]];
+	}
+}
+#endif
+
+// rows per block of the fused HYB kernel, the block's partial sums stay on the stack
+const int HYB_BLOCK_ROWS = 256;
+
+// fused HYB spMV for rows [firstRow, lastRow): every block of rows runs down the ELL columns,
+// then adds the COO tail elements of the same rows before outVector is written once
+template<typename T>
+void hybSpMVRows(const SparseHYB<T> &hyb, const T *inVector, T *outVector, int firstRow, int lastRow) {
+	alignas(SPARSE_ALIGNMENT) T acc[HYB_BLOCK_ROWS];
+	int e = (int) (std::lower_bound(hyb.cooRow.get(), hyb.cooRow.get() + hyb.cooNnz, firstRow) - hyb.cooRow.get());
+	for (int r0 = firstRow; r0 < lastRow; r0 += HYB_BLOCK_ROWS) {
+		int n = std::min(HYB_BLOCK_ROWS, lastRow - r0);
+		for (int i = 0; i < n; i++) {
+			acc[i] = 0;
+		}
+		for (int j = 0; j < hyb.k; j++) {
+			size_t offset = (size_t) j * hyb.rows + r0;
+			gatherAxpy(hyb.data.get() + offset, hyb.col.get() + offset, n, inVector, acc);
+		}
+		for (; e < hyb.cooNnz && hyb.cooRow[e] < r0 + n; e++) {
+			acc[hyb.cooRow[e] - r0] += hyb.cooData[e] * inVector[hyb.cooCol[e]];
+		}
+		for (int i = 0; i < n; i++) {
+			outVector[r0 + i] = acc[i];
+		}
+	}
+}
+
+// multiply HYB sparse matrix with dense vector and store results in outVector
+template<typename T>
+void spMV(const SparseHYB<T> &hyb, const T *inVector, T *outVector) {
+	hybSpMVRows(hyb, inVector, outVector, 0, hyb.rows);
+}
+
+// multithreaded HYB spMV. the ELL part costs the same for every row, so the rows are split into
+// equal ranges (rounded to whole blocks); the COO tail only holds the spill of the longest rows
+template<typename T>
+void parallelSpMV(const SparseHYB<T> &hyb, const T *inVector, T *outVector, ThreadPool &pool) {
+	int numBlocks = (hyb.rows + HYB_BLOCK_ROWS - 1) / HYB_BLOCK_ROWS;
+	pool.run([&](int tid) {
+		long first, last;
+		splitRange(numBlocks, pool.size(), tid, first, last);
+		hybSpMVRows(hyb, inVector, outVector, (int) first * HYB_BLOCK_ROWS,
+			std::min(hyb.rows, (int) last * HYB_BLOCK_ROWS));
+	});
+}
+
+// y[i] += d[i] * x[i] for i in [0, n), one stored diagonal over a block of rows
+template<typename T>
+inline void diagonalFma(int n, const T *d, const T *x, T *y) {
+	for (int i = 0; i < n; i++) {
+		y[i] += d[i] * x[i];
+	}
+}
+
+#if defined(__AVX512F__)
+inline void diagonalFma(int n, const double *d, const double *x, double *y) {
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		_mm512_storeu_pd(y + i, _mm512_fmadd_pd(_mm512_loadu_pd(d + i), _mm512_loadu_pd(x + i), _mm512_loadu_pd(y + i)));
+	}
+	for (; i < n; i++) {
+		y[i] += d[i] * x[i];
+	}
+}
+
+inline void diagonalFma(int n, const float *d, const float *x, float *y) {
+	int i = 0;
+	for (; i + 16 <= n; i += 16) {
+		_mm512_storeu_ps(y + i, _mm512_fmadd_ps(_mm512_loadu_ps(d + i), _mm512_loadu_ps(x + i), _mm512_loadu_ps(y + i)));
+	}
+	for (; i < n; i++) {
+		y[i] += d[i] * x[i];
+	}
+}
+#elif defined(__AVX2__) && defined(__FMA__)
+inline void diagonalFma(int n, const double *d, const double *x, double *y) {
+	int i = 0;
+	for (; i + 4 <= n; i += 4) {
+		_mm256_storeu_pd(y + i, _mm256_fmadd_pd(_mm256_loadu_pd(d + i), _mm256_loadu_pd(x + i), _mm256_loadu_pd(y + i)));
+	}
+	for (; i < n; i++) {
+		y[i] += d[i] * x[i];
+	}
+}
+
+inline void diagonalFma(int n, const float *d, const float *x, float *y) {
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		_mm256_storeu_ps(y + i, _mm256_fmadd_ps(_mm256_loadu_ps(d + i), _mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i)));
+	}
+	for (; i < n; i++) {
+		y[i] += d[i] * x[i];
+	}
+}
+#endif
+
+// rows per block of the DIA kernel, small enough for the block of outVector to stay in L1
+// while all diagonals are added to it
+const int DIA_BLOCK_ROWS = 1024;
+
+// DIA spMV for rows [firstRow, lastRow), every diagonal is clipped to the rows where its column
+// lies inside the matrix, so padding is never read
+template<typename T>
+void diaSpMVRows(const SparseDIA<T> &dia, const T *inVector, T *outVector, int firstRow, int lastRow) {
+	for (int r0 = firstRow; r0 < lastRow; r0 += DIA_BLOCK_ROWS) {
+		int r1 = std::min(lastRow, r0 + DIA_BLOCK_ROWS);
+		for (int i = r0; i < r1; i++) {
+			outVector[i] = 0;
+		}
+		for (int d = 0; d < dia.numDiags; d++) {
+			int offset = dia.offsets[d];
+			int lo = std::max(r0, -offset);
+			int hi = std::min(r1, dia.cols - offset);
+			if (lo < hi) {
+				diagonalFma(hi - lo, dia.data.get() + (size_t) d * dia.rows + lo, inVector + lo + offset,
+					outVector + lo);
+			}
+		}
+	}
+}
+
+// multiply DIA sparse matrix with dense vector and store results in outVector
+template<typename T>
+void spMV(const SparseDIA<T> &dia, const T *inVector, T *outVector) {
+	diaSpMVRows(dia, inVector, outVector, 0, dia.rows);
+}
+
+// multithreaded DIA spMV, every row costs the same so the rows are split into equal ranges
+template<typename T>
+void parallelSpMV(const SparseDIA<T> &dia, const T *inVector, T *outVector, ThreadPool &pool) {
+	pool.run([&](int tid) {
+		long first, last;
+		splitRange(dia.rows, pool.size(), tid, first, last);
+		diaSpMVRows(dia, inVector, outVector, (int) first, (int) last);
+	});
+}
+
+// multiply runtime-sized TJDS sparse matrix with dense vector and store results in outVector
+// inVector is in the original column order
+template<typename T>
+void spMV(const DynSparseTJDS<T> &tjds, const T *inVector, T *outVector) {
+	for (int i = 0; i < tjds.rows; i++) {
+		outVector[i] = 0;
+	}
+	tjdsSpMVCols(tjds.tjTiles, tjds.start.get(), tjds.row_index.get(), tjds.val.get(), tjds.perm.get(),
+		inVector, outVector, 0, tjds.cols);
+}
+
+// split of the stored columns of a tjds matrix for parallelSpMV, with the private output vectors
+// of the threads. every jagged diagonal is cut at the same column positions, which are chosen so
+// that the parts hold (almost) equal numbers of elements. rows of different columns collide, so
+// part 0 writes outVector and every other part a private vector, which are added afterwards.
+// compute it once per matrix and reuse it; it holds scratch memory, so one parallelSpMV at a time
+template<typename T>
+class TJDSPartition {
+public:
+	TJDSPartition() {}
+
+	TJDSPartition(int rows, int cols, int tjTiles, const int *start, int numParts) : bounds(numParts + 1) {
+		// elements up to column position p: the stored columns are sorted by decreasing length,
+		// so column p has one element in every diagonal that is longer than p
+		std::vector<long> prefix(cols + 1, 0);
+		for (int p = 0, i = tjTiles; p < cols; p++) {
+			while (i > 0 && start[i] - start[i - 1] <= p) {
+				i -= 1;
+			}
+			prefix[p + 1] = prefix[p] + i;
+		}
+		for (int t = 0; t <= numParts; t++) {
+			bounds[t] = balancedSplit(prefix.data(), cols, numParts, t);
+		}
+		for (int t = 1; t < numParts; t++) {
+			local.emplace_back(rows);
+		}
+	}
+
+	TJDSPartition(const DynSparseTJDS<T> &tjds, int numParts)
+		: TJDSPartition(tjds.rows, tjds.cols, tjds.tjTiles, tjds.start.get(), numParts) {}
+
+	template<int ROWS, int COLS, int NNZ, int TJ_TILES>
+	TJDSPartition(const SparseTJDS<ROWS, COLS, NNZ, TJ_TILES, T> &tjds, int numParts)
+		: TJDSPartition(ROWS, COLS, TJ_TILES, tjds.start, numParts) {}
+
+	int numParts() const {
+		return (int) bounds.size() - 1;
+	}
+
+	// part t covers column positions [bounds[t], bounds[t + 1]) of every jagged diagonal
+	std::vector<int> bounds;
+	std::vector<AlignedArray<T>> local;
+};
+
+// tjds spMV on raw arrays, with the column ranges of partition spread over the threads of pool
+template<typename T>
+void tjdsParallelSpMV(int rows, int tjTiles, const int *start, const int *row_index, const T *val, const int *perm,
+		const T *inVector, T *outVector, TJDSPartition<T> &partition, ThreadPool &pool) {
+	const int numParts = partition.numParts();
+	pool.run([&](int tid) {
+		for (int t = tid; t < numParts; t += pool.size()) {
+			T *out = t == 0 ? outVector : partition.local[t - 1].get();
+			std::fill(out, out + rows, T(0));
+			tjdsSpMVCols(tjTiles, start, row_index, val, perm, inVector, out, partition.bounds[t], partition.bounds[t + 1]);
+		}
+	});
+	if (numParts == 1) {
+		return;
+	}
+	pool.run([&](int tid) {
+		long begin, end;
+		splitRange(rows, pool.size(), tid, begin, end);
+		for (int t = 1; t < numParts; t++) {
+			const T *local = partition.local[t - 1].get();
+			for (long i = begin; i < end; i++) {
+				outVector[i] += local[i];
+			}
+		}
+	});
+}
+
+// multithreaded TJDS spMV; partition is usually TJDSPartition<T>(tjds, pool.size())
+template<typename T>
+void parallelSpMV(const DynSparseTJDS<T> &tjds, const T *inVector, T *outVector, TJDSPartition<T> &partition, ThreadPool &pool) {
+	tjdsParallelSpMV(tjds.rows, tjds.tjTiles, tjds.start.get(), tjds.row_index.get(), tjds.val.get(), tjds.perm.get(),
+		inVector, outVector, partition, pool);
+}
+
+template<int ROWS, int COLS, int NNZ, int TJ_TILES, typename T>
+void parallelSpMV(const SparseTJDS<ROWS, COLS, NNZ, TJ_TILES, T> &tjds, const T inVector[COLS], T outVector[ROWS],
+		TJDSPartition<T> &partition, ThreadPool &pool) {
+	tjdsParallelSpMV(ROWS, TJ_TILES, tjds.start, tjds.row_index, tjds.val, tjds.perm, inVector, outVector, partition, pool);
+}
+
+// multiply runtime-sized SSS sparse matrix with dense vector
+// outVector[c] is written before row c is reached, so it is initialized up front
+template<typename T>
+void spMV(const DynSparseSSS<T> &sss, const T *inVector, T *outVector) {
+	for (int r = 0; r < sss.n; r++) {
+		outVector[r] = sss.dvalues[r] * inVector[r];
+	}
+
+	for (int r = 0; r < sss.n; r++) {
+		T dot = 0;
+		for (int j = sss.rowptr[r]; j < sss.rowptr[r + 1]; j++) {
+			int c = sss.col[j];
+			dot += sss.values[j] * inVector[c];
+			outVector[c] += sss.values[j] * inVector[r];
+		}
+		outVector[r] += dot;
+	}
+}
+
+// split of the rows of an sss matrix for parallelSpMV, with the private output vectors of the threads.
+// based on the local vectors method of "Improving the Performance of the Symmetric Sparse
+// Matrix-Vector Multiplication in Multicore": part t owns rows [bounds[t], bounds[t + 1]) of
+// outVector, so the only conflicting writes are the mirrored ones, outVector[c] += a(r, c) * inVector[r],
+// with c below the part's first row. these go to a local vector that only spans the touched range
+// [reach[t], bounds[t]) and are added to outVector afterwards.
+// compute it once per matrix and reuse it; it holds scratch memory, so one parallelSpMV at a time
+template<typename T>
+class SSSPartition {
+public:
+	SSSPartition() {}
+
+	SSSPartition(const int *rowptr, const int *col, int n, int numParts) : bounds(numParts + 1), reach(numParts) {
+		for (int t = 0; t <= numParts; t++) {
+			bounds[t] = balancedSplit(rowptr, n, numParts, t);
+		}
+		for (int t = 0; t < numParts; t++) {
+			reach[t] = bounds[t];
+			for (int j = rowptr[bounds[t]]; j < rowptr[bounds[t + 1]]; j++) {
+				reach[t] = std::min(reach[t], col[j]);
+			}
+			local.emplace_back(bounds[t] - reach[t]);
+		}
+	}
+
+	SSSPartition(const DynSparseSSS<T> &sss, int numParts) : SSSPartition(sss.rowptr.get(), sss.col.get(), sss.n, numParts) {}
+
+	template<int N, int LOWERNNZ>
+	SSSPartition(const SparseSSS<N, LOWERNNZ, T> &sss, int numParts) : SSSPartition(sss.rowptr, sss.col, N, numParts) {}
+
+	int numParts() const {
+		return (int) bounds.size() - 1;
+	}
+
+	std::vector<int> bounds;
+	std::vector<int> reach;
+	std::vector<AlignedArray<T>> local;
+};
+
+// sss spMV on raw arrays, with the row ranges of partition spread over the threads of pool
+template<typename T>
+void sssParallelSpMV(int n, const T *dvalues, const int *rowptr, const int *col, const T *values,
+		const T *inVector, T *outVector, SSSPartition<T> &partition, ThreadPool &pool) {
+	const int numParts = partition.numParts();
+
+	// 1) every part multiplies its rows, mirrored writes below its first row go to its local vector
+	pool.run([&](int tid) {
+		for (int t = tid; t < numParts; t += pool.size()) {
+			const int first = partition.bounds[t];
+			const int last = partition.bounds[t + 1];
+			const int reach = partition.reach[t];
+			T *local = partition.local[t].get();
+			std::fill(local, local + (first - reach), T(0));
+			for (int r = first; r < last; r++) {
+				outVector[r] = dvalues[r] * inVector[r];
+			}
+
+			for (int r = first; r < last; r++) {
+				T dot = 0;
+				for (int j = rowptr[r]; j < rowptr[r + 1]; j++) {
+					int c = col[j];
+					dot += values[j] * inVector[c];
+					if (c >= first) {
+						outVector[c] += values[j] * inVector[r];
+					} else {
+						local[c - reach] += values[j] * inVector[r];
+					}
+				}
+				outVector[r] += dot;
+			}
+		}
+	});
+
+	// 2) add the local vectors, every thread takes an equal slice of outVector and
+	// only visits the parts whose touched range overlaps it
+	pool.run([&](int tid) {
+		long begin, end;
+		splitRange(n, pool.size(), tid, begin, end);
+		for (int t = 0; t < numParts; t++) {
+			int lo = std::max((int) begin, partition.reach[t]);
+			int hi = std::min((int) end, partition.bounds[t]);
+			const T *local = partition.local[t].get() - partition.reach[t];
+			for (int i = lo; i < hi; i++) {
+				outVector[i] += local[i];
+			}
+		}
+	});
+}
+
+// multithreaded SSS spMV; partition is usually SSSPartition<T>(sss, pool.size())
+template<typename T>
+void parallelSpMV(const DynSparseSSS<T> &sss, const T *inVector, T *outVector, SSSPartition<T> &partition, ThreadPool &pool) {
+	sssParallelSpMV(sss.n, sss.dvalues.get(), sss.rowptr.get(), sss.col.get(), sss.values.get(), inVector, outVector,
+		partition, pool);
+}
+
+template<int N, int LOWERNNZ, typename T>
+void parallelSpMV(const SparseSSS<N, LOWERNNZ, T> &sss, const T inVector[N], T outVector[N],
+		SSSPartition<T> &partition, ThreadPool &pool) {
+	sssParallelSpMV(N, sss.dvalues, sss.rowptr, sss.col, sss.values, inVector, outVector, partition, pool);
+}
+
+// multiply runtime-sized sparse matrices with k dense vectors
+// denseIn is a row-major cols x k array, denseOut a row-major rows x k array
+template<typename T>
+void spMM(const DynSparseCOO<T> &coo, int k, const T *denseIn, T *denseOut) {
+	cooSpMM(coo.rows, coo.nnz, coo.row.get(), coo.col.get(), coo.data.get(), k, denseIn, denseOut);
+}
+
+template<typename T>
+void spMM(const DynSparseCSR<T> &csr, int k, const T *denseIn, T *denseOut) {
+	csrSpMMRows(csr.rowptr.get(), csr.col.get(), csr.data.get(), k, denseIn, denseOut, 0, csr.rows);
+}
+
+template<typename T>
+void spMM(const DynSparseBSR<T> &bsr, int k, const T *denseIn, T *denseOut) {
+	bsrSpMM(bsr.rows, bsr.cols, bsr.blockSize, bsr.blockRowptr.get(), bsr.blockCol.get(), bsr.data.get(),
+		k, denseIn, denseOut);
+}
+
+template<typename T>
+void spMM(const DynSparseELL<T> &ell, int k, const T *denseIn, T *denseOut) {
+	ellSpMM(ell.rows, ell.maxNnzCols, ell.col.get(), ell.data.get(), k, denseIn, denseOut);
+}
+
+template<typename T>
+void spMM(const DynSparseTJDS<T> &tjds, int k, const T *denseIn, T *denseOut) {
+	tjdsSpMM(tjds.rows, tjds.tjTiles, tjds.start.get(), tjds.row_index.get(), tjds.val.get(), tjds.perm.get(),
+		k, denseIn, denseOut);
+}
+
+template<typename T>
+void spMM(const DynSparseSSS<T> &sss, int k, const T *denseIn, T *denseOut) {
+	sssSpMM(sss.n, sss.dvalues.get(), sss.rowptr.get(), sss.col.get(), sss.values.get(), k, denseIn, denseOut);
+}
+
+// inner product dataflow for runtime-sized csr x csc, outMatrix is a row-major a.rows x b.cols array
+template<typename T>
+void innerProductSpMM(const DynSparseCSR<T> &csr, const DynSparseCSC<T> &csc, T *outMatrix) {
+	for (int i = 0; i < csr.rows; i++) {
+		for (int j = 0; j < csc.cols; j++) {
+
+			T dot = 0;
+			for (int ja = csr.rowptr[i], jb = csc.colptr[j]; ja < csr.rowptr[i + 1] && jb < csc.colptr[j + 1]; ) {
+				if (csr.col[ja] < csc.row[jb]) {
+					ja++;
+				} else if (csr.col[ja] == csc.row[jb]) {
+					dot += csr.data[ja] * csc.data[jb];
+					ja++;
+					jb++;
+				} else {
+					jb++;
+				}
+			}
+			outMatrix[(size_t) i * csc.cols + j] = dot;
+
+		}
+	}
+}
+
+// outer product dataflow for runtime-sized csc x csr, accumulates into a row-major csc.rows x csr.cols array
+template<typename T>
+void outerProductSpMM(const DynSparseCSC<T> &csc, const DynSparseCSR<T> &csr, T *outMatrix) {
+	for (int k = 0; k < csc.cols; k++) {
+		for (int i = csc.colptr[k]; i < csc.colptr[k + 1]; i++) {
+			for (int j = csr.rowptr[k]; j < csr.rowptr[k + 1]; j++) {
+				outMatrix[(size_t) csc.row[i] * csr.cols + csr.col[j]] += csc.data[i] * csr.data[j];
+			}
+		}
+	}
+}
+
+// gustavson dataflow for runtime-sized csr x csr, accumulates into a row-major a.rows x b.cols array
+template<typename T>
+void gustavsonProductSpMM(const DynSparseCSR<T> &a, const DynSparseCSR<T> &b, T *outMatrix) {
+	for (int i = 0; i < a.rows; i++) {
+		for (int k = a.rowptr[i]; k < a.rowptr[i + 1]; k++) {
+			for (int j = b.rowptr[a.col[k]]; j < b.rowptr[a.col[k] + 1]; j++) {
+				outMatrix[(size_t) i * b.cols + b.col[j]] += a.data[k] * b.data[j];
+			}
+		}
+	}
+}
+
+// column-wise dataflow for runtime-sized csc x csc, accumulates into a row-major a.rows x b.cols array
+template<typename T>
+void columnWiseProductSpMM(const DynSparseCSC<T> &a, const DynSparseCSC<T> &b, T *outMatrix) {
+	for (int j = 0; j < b.cols; j++) {
+		for (int k = b.colptr[j]; k < b.colptr[j + 1]; k++) {
+			for (int i = a.colptr[b.row[k]]; i < a.colptr[b.row[k] + 1]; i++) {
+				outMatrix[(size_t) a.row[i] * b.cols + j] += a.data[i] * b.data[k];
+			}
+		}
+	}
+}
+
 #endif // SPARSEALGS_H
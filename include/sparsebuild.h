@@ -0,0 +1,258 @@
+// sparsebuild.h
+#ifndef SPARSEBUILD_H
+#define SPARSEBUILD_H
+
+#include <functional>
+#include <stdexcept>
+#include <cstdint>
+#include <limits>
+#include <algorithm>
+#include "sparsematrix.h"
+#include "parallel.h"
+
+// ---building runtime-sized matrices from (row, col, value) triplets---
+// triplets may come in any order and may contain duplicates.
+// duplicates are combined with "reduce", applied in the order the triplets were given,
+// e.g. std::plus<T>() (default) sums them and [](T a, T b) { return b; } keeps the last one.
+// no dense staging matrix is ever formed: the work is a counting sort of the triplets by
+// their outer index (row for csr, col for csc), a short sort of every row/col by its inner index
+// and a prefix sum over the deduplicated counts, all split across numThreads threads.
+// the result is identical for every numThreads.
+
+// compress nnz triplets into ptr/idx/data arrays (csr when outer = row, csc when outer = col)
+// returns the number of elements left after combining duplicates.
+// the counting sort is done in two stable levels so that no thread ever needs atomics or a
+// histogram over all outer indices: triplets are first scattered to buckets of consecutive
+// outer indices, then every bucket is counting-sorted on its own by a single thread
+template<typename T, typename Reduce>
+int compressTriplets(int numOuter, int numInner, int nnz, const int *outerIdx, const int *innerIdx, const T *vals,
+		Reduce reduce, int numThreads, AlignedArray<int> &ptr, AlignedArray<int> &idx, AlignedArray<T> &data) {
+	numThreads = std::max(1, std::min(numThreads, nnz / 65536 + 1));
+	int numBuckets = std::max(1, std::min(numOuter, std::max(nnz / 16384, 4 * numThreads)));
+	int bucketWidth = numOuter / numBuckets + (numOuter % numBuckets != 0);
+	numBuckets = numOuter > 0 ? (numOuter + bucketWidth - 1) / bucketWidth : 1;
+
+	// 1) every thread counts the buckets of its slice of triplets (and validates them)
+	std::vector<int> bucketCount((size_t) numThreads * numBuckets, 0);
+	std::vector<char> outOfRange(numThreads, 0);
+	parallelRun(numThreads, [&](int t) {
+		long begin, end;
+		splitRange(nnz, numThreads, t, begin, end);
+		int *count = bucketCount.data() + (size_t) t * numBuckets;
+		for (long i = begin; i < end; i++) {
+			if (outerIdx[i] < 0 || outerIdx[i] >= numOuter || innerIdx[i] < 0 || innerIdx[i] >= numInner) {
+				outOfRange[t] = 1;
+				return;
+			}
+			count[outerIdx[i] / bucketWidth] += 1;
+		}
+	});
+	for (int t = 0; t < numThreads; t++) {
+		if (outOfRange[t]) {
+			throw std::out_of_range("compressTriplets: triplet index outside matrix dimensions");
+		}
+	}
+
+	// bucket-major, thread-minor prefix sum keeps the scatter stable
+	std::vector<int> bucketStart(numBuckets + 1, 0);
+	std::vector<int> cursor((size_t) numThreads * numBuckets);
+	for (int b = 0, sum = 0; b < numBuckets; b++) {
+		bucketStart[b] = sum;
+		for (int t = 0; t < numThreads; t++) {
+			cursor[(size_t) t * numBuckets + b] = sum;
+			sum += bucketCount[(size_t) t * numBuckets + b];
+		}
+		bucketStart[b + 1] = sum;
+	}
+
+	// 2) scatter the triplets to the buckets
+	AlignedArray<int> bucketOuter(nnz);
+	AlignedArray<int> bucketInner(nnz);
+	AlignedArray<T> bucketVals(nnz);
+	parallelRun(numThreads, [&](int t) {
+		long begin, end;
+		splitRange(nnz, numThreads, t, begin, end);
+		int *pos = cursor.data() + (size_t) t * numBuckets;
+		for (long i = begin; i < end; i++) {
+			int p = pos[outerIdx[i] / bucketWidth]++;
+			bucketOuter[p] = outerIdx[i];
+			bucketInner[p] = innerIdx[i];
+			bucketVals[p] = vals[i];
+		}
+	});
+
+	// 3) counting sort of every bucket by outer index, then sort every outer index by
+	// (inner index, position in bucket) and combine duplicates in place.
+	// the scatter was stable, so the position in the bucket follows the original triplet order
+	std::vector<int> offsets(numOuter + 1, 0);
+	std::vector<int> uniqueCount(numOuter + 1, 0);
+	AlignedArray<uint64_t> keys(nnz);
+	AlignedArray<T> combined(nnz);
+	parallelRun(numThreads, [&](int t) {
+		int firstBucket = balancedSplit(bucketStart.data(), numBuckets, numThreads, t);
+		int lastBucket = balancedSplit(bucketStart.data(), numBuckets, numThreads, t + 1);
+		for (int b = firstBucket; b < lastBucket; b++) {
+			int firstOuter = b * bucketWidth;
+			int lastOuter = std::min(numOuter, firstOuter + bucketWidth);
+
+			std::vector<int> start(lastOuter - firstOuter + 1, 0);
+			for (int p = bucketStart[b]; p < bucketStart[b + 1]; p++) {
+				start[bucketOuter[p] - firstOuter + 1] += 1;
+			}
+			start[0] = bucketStart[b];
+			for (int o = firstOuter; o < lastOuter; o++) {
+				start[o - firstOuter + 1] += start[o - firstOuter];
+				offsets[o] = start[o - firstOuter];
+			}
+			std::vector<int> pos(start.begin(), start.end() - 1);
+			for (int p = bucketStart[b]; p < bucketStart[b + 1]; p++) {
+				keys[pos[bucketOuter[p] - firstOuter]++] = ((uint64_t) bucketInner[p] << 32) | (uint32_t) p;
+			}
+
+			for (int o = firstOuter; o < lastOuter; o++) {
+				uint64_t *begin = keys.get() + start[o - firstOuter];
+				uint64_t *end = keys.get() + start[o - firstOuter + 1];
+				std::sort(begin, end);
+
+				int count = 0;
+				for (uint64_t *k = begin; k < end; k++) {
+					T val = bucketVals[(uint32_t) *k];
+					if (count > 0 && (begin[count - 1] >> 32) == (*k >> 32)) {
+						combined[offsets[o] + count - 1] = reduce(combined[offsets[o] + count - 1], val);
+					} else {
+						begin[count] = *k;
+						combined[offsets[o] + count] = val;
+						count += 1;
+					}
+				}
+				uniqueCount[o] = count;
+			}
+		}
+	});
+	offsets[numOuter] = nnz;
+
+	// 4) prefix sum over the deduplicated counts and copy everything to its final place
+	ptr = AlignedArray<int>(numOuter + 1);
+	parallelExclusiveScan(uniqueCount.data(), numOuter, ptr.get(), numThreads);
+	int total = ptr[numOuter];
+	idx = AlignedArray<int>(total);
+	data = AlignedArray<T>(total);
+	parallelRun(numThreads, [&](int t) {
+		int first = balancedSplit(offsets.data(), numOuter, numThreads, t);
+		int last = balancedSplit(offsets.data(), numOuter, numThreads, t + 1);
+		for (int o = first; o < last; o++) {
+			for (int k = 0; k < ptr[o + 1] - ptr[o]; k++) {
+				idx[ptr[o] + k] = (int) (keys[offsets[o] + k] >> 32);
+				data[ptr[o] + k] = combined[offsets[o] + k];
+			}
+		}
+	});
+
+	return total;
+}
+
+// build a rows x cols csr matrix from nnz triplets (row[i], col[i], vals[i])
+template<typename T, typename Reduce = std::plus<T>>
+DynSparseCSR<T> buildCSR(int rows, int cols, int nnz, const int *row, const int *col, const T *vals,
+		Reduce reduce = Reduce(), int numThreads = defaultNumThreads()) {
+	DynSparseCSR<T> csr;
+	csr.rows = rows;
+	csr.cols = cols;
+	csr.nnz = compressTriplets(rows, cols, nnz, row, col, vals, reduce, numThreads, csr.rowptr, csr.col, csr.data);
+	return csr;
+}
+
+// build a rows x cols csc matrix from nnz triplets (row[i], col[i], vals[i])
+template<typename T, typename Reduce = std::plus<T>>
+DynSparseCSC<T> buildCSC(int rows, int cols, int nnz, const int *row, const int *col, const T *vals,
+		Reduce reduce = Reduce(), int numThreads = defaultNumThreads()) {
+	DynSparseCSC<T> csc;
+	csc.rows = rows;
+	csc.cols = cols;
+	csc.nnz = compressTriplets(cols, rows, nnz, col, row, vals, reduce, numThreads, csc.colptr, csc.row, csc.data);
+	return csc;
+}
+
+// build a rows x cols coo matrix, sorted row-major like the dense-scan constructor,
+// from nnz triplets (row[i], col[i], vals[i])
+template<typename T, typename Reduce = std::plus<T>>
+DynSparseCOO<T> buildCOO(int rows, int cols, int nnz, const int *row, const int *col, const T *vals,
+		Reduce reduce = Reduce(), int numThreads = defaultNumThreads()) {
+	AlignedArray<int> rowptr;
+	DynSparseCOO<T> coo;
+	coo.rows = rows;
+	coo.cols = cols;
+	coo.nnz = compressTriplets(rows, cols, nnz, row, col, vals, reduce, numThreads, rowptr, coo.col, coo.data);
+
+	// expand rowptr back into one row index per element
+	coo.row = AlignedArray<int>(coo.nnz);
+	parallelRun(numThreads, [&](int t) {
+		int first = balancedSplit(rowptr.get(), rows, numThreads, t);
+		int last = balancedSplit(rowptr.get(), rows, numThreads, t + 1);
+		for (int i = first; i < last; i++) {
+			for (int j = rowptr[i]; j < rowptr[i + 1]; j++) {
+				coo.row[j] = i;
+			}
+		}
+	});
+	return coo;
+}
+
+// same builders, taking the triplets from an (unsorted, possibly duplicated) coo matrix
+template<typename T, typename Reduce = std::plus<T>>
+DynSparseCSR<T> buildCSR(const DynSparseCOO<T> &coo, Reduce reduce = Reduce(), int numThreads = defaultNumThreads()) {
+	return buildCSR(coo.rows, coo.cols, coo.nnz, coo.row.get(), coo.col.get(), coo.data.get(), reduce, numThreads);
+}
+
+template<typename T, typename Reduce = std::plus<T>>
+DynSparseCSC<T> buildCSC(const DynSparseCOO<T> &coo, Reduce reduce = Reduce(), int numThreads = defaultNumThreads()) {
+	return buildCSC(coo.rows, coo.cols, coo.nnz, coo.row.get(), coo.col.get(), coo.data.get(), reduce, numThreads);
+}
+
+template<typename T, typename Reduce = std::plus<T>>
+DynSparseCOO<T> buildCOO(const DynSparseCOO<T> &coo, Reduce reduce = Reduce(), int numThreads = defaultNumThreads()) {
+	return buildCOO(coo.rows, coo.cols, coo.nnz, coo.row.get(), coo.col.get(), coo.data.get(), reduce, numThreads);
+}
+
+// build a rows x cols csr matrix with index types I and P (see SparseIndexedCSR) straight from its
+// row lengths, without a DynSparseCSR in between: that one has an int row pointer, so this is the
+// way to a SparseIndexedCSR with more than 2^31 - 1 non-zero elements (P = int64_t).
+// length(i) returns the length of row i, then fill(i, len, col, data) writes its elements; both are
+// called concurrently for different rows. throws if the total does not fit in P
+template<typename T, typename I, typename P, typename Length, typename Fill>
+SparseIndexedCSR<T, I, P> buildIndexedCSR(int rows, int cols, Length length, Fill fill,
+		int numThreads = defaultNumThreads()) {
+	numThreads = std::max(1, std::min(numThreads, rows / 4096 + 1));
+	std::vector<long> rowptr(rows + 1, 0);
+	std::vector<char> negative(numThreads, 0);
+	parallelRun(numThreads, [&](int t) {
+		long begin, end;
+		splitRange(rows, numThreads, t, begin, end);
+		for (long i = begin; i < end; i++) {
+			rowptr[i] = (long) length((int) i);
+			negative[t] |= rowptr[i] < 0;
+		}
+	});
+	if (std::find(negative.begin(), negative.end(), 1) != negative.end()) {
+		throw std::invalid_argument("buildIndexedCSR: negative row length");
+	}
+	parallelExclusiveScan(rowptr.data(), rows, rowptr.data(), numThreads);
+	if (rowptr[rows] > (long) std::numeric_limits<P>::max()) {
+		throw std::out_of_range("buildIndexedCSR: non-zero elements do not fit the row pointer type");
+	}
+
+	SparseIndexedCSR<T, I, P> csr(rows, cols, (P) rowptr[rows]);
+	for (int i = 0; i <= rows; i++) {
+		csr.rowptr[i] = (P) rowptr[i];
+	}
+	parallelRun(numThreads, [&](int t) {
+		int first = balancedSplit(rowptr.data(), rows, numThreads, t);
+		int last = balancedSplit(rowptr.data(), rows, numThreads, t + 1);
+		for (int i = first; i < last; i++) {
+			fill(i, (long) (rowptr[i + 1] - rowptr[i]), csr.col.get() + rowptr[i], csr.data.get() + rowptr[i]);
+		}
+	});
+	return csr;
+}
+
+#endif // SPARSEBUILD_H
@@ -0,0 +1,387 @@
+// sparseconvert.h
+#ifndef SPARSECONVERT_H
+#define SPARSECONVERT_H
+
+#include <stdexcept>
+#include "sparsematrix.h"
+#include "sparsebuild.h"
+#include "parallel.h"
+
+// ---direct conversions between runtime-sized formats---
+// every conversion works on the stored elements only, in O(nnz) time and memory (plus the
+// size of the target format), so no dense rows x cols matrix is ever formed.
+// stored elements are kept as they are, explicit zeros included.
+// work is split across numThreads threads, the result is identical for every numThreads.
+// csr -> SELL-C-sigma, HYB and DIA are the SparseSELL(csr, sigma), SparseHYB(csr) and SparseDIA(csr) constructors
+
+// transpose of compressed arrays: csr -> csc (outer = row) or csc -> csr (outer = col).
+// every thread scatters a range of outer indices with its own histogram of inner indices, so the
+// inner indices of the result come out sorted. the threads are capped so that the histograms
+// stay in the order of nnz
+template<typename T>
+void transposeCompressed(int numOuter, int numInner, const int *ptr, const int *idx, const T *data, int numThreads,
+		AlignedArray<int> &outPtr, AlignedArray<int> &outIdx, AlignedArray<T> &outData) {
+	const int nnz = ptr[numOuter];
+	numThreads = std::max(1, std::min(numThreads, (int) std::min<long>(nnz / 65536 + 1, 2L * nnz / std::max(numInner, 1) + 1)));
+	std::vector<int> bounds(numThreads + 1);
+	for (int t = 0; t <= numThreads; t++) {
+		bounds[t] = balancedSplit(ptr, numOuter, numThreads, t);
+	}
+
+	// 1) per-thread histograms of inner indices
+	std::vector<int> count((size_t) numThreads * numInner, 0);
+	parallelRun(numThreads, [&](int t) {
+		int *local = count.data() + (size_t) t * numInner;
+		for (int j = ptr[bounds[t]]; j < ptr[bounds[t + 1]]; j++) {
+			local[idx[j]] += 1;
+		}
+	});
+
+	// 2) per inner index, the threads' start offsets within it, then a prefix sum over inner indices
+	outPtr = AlignedArray<int>(numInner + 1);
+	parallelRun(numThreads, [&](int t) {
+		long begin, end;
+		splitRange(numInner, numThreads, t, begin, end);
+		for (long i = begin; i < end; i++) {
+			int sum = 0;
+			for (int s = 0; s < numThreads; s++) {
+				int c = count[(size_t) s * numInner + i];
+				count[(size_t) s * numInner + i] = sum;
+				sum += c;
+			}
+			outPtr[i] = sum;
+		}
+	});
+	parallelExclusiveScan(outPtr.get(), numInner, outPtr.get(), numThreads);
+
+	// 3) scatter
+	outIdx = AlignedArray<int>(nnz);
+	outData = AlignedArray<T>(nnz);
+	parallelRun(numThreads, [&](int t) {
+		int *local = count.data() + (size_t) t * numInner;
+		for (int o = bounds[t]; o < bounds[t + 1]; o++) {
+			for (int j = ptr[o]; j < ptr[o + 1]; j++) {
+				int p = outPtr[idx[j]] + local[idx[j]]++;
+				outIdx[p] = o;
+				outData[p] = data[j];
+			}
+		}
+	});
+}
+
+// csr -> csc, a parallel transpose
+template<typename T>
+DynSparseCSC<T> csrToCSC(const DynSparseCSR<T> &csr, int numThreads = defaultNumThreads()) {
+	DynSparseCSC<T> csc;
+	csc.rows = csr.rows;
+	csc.cols = csr.cols;
+	csc.nnz = csr.nnz;
+	transposeCompressed(csr.rows, csr.cols, csr.rowptr.get(), csr.col.get(), csr.data.get(), numThreads,
+		csc.colptr, csc.row, csc.data);
+	return csc;
+}
+
+// csc -> csr, a parallel transpose
+template<typename T>
+DynSparseCSR<T> cscToCSR(const DynSparseCSC<T> &csc, int numThreads = defaultNumThreads()) {
+	DynSparseCSR<T> csr;
+	csr.rows = csc.rows;
+	csr.cols = csc.cols;
+	csr.nnz = csc.nnz;
+	transposeCompressed(csc.cols, csc.rows, csc.colptr.get(), csc.row.get(), csc.data.get(), numThreads,
+		csr.rowptr, csr.col, csr.data);
+	return csr;
+}
+
+// coo -> csr. a coo matrix sorted row-major without duplicates (as the dense-scan constructor and
+// buildCOO produce it) only needs its row indices compressed; anything else goes through buildCSR,
+// which sorts it and sums the duplicates
+template<typename T>
+DynSparseCSR<T> cooToCSR(const DynSparseCOO<T> &coo, int numThreads = defaultNumThreads()) {
+	numThreads = std::max(1, std::min(numThreads, coo.nnz / 65536 + 1));
+	std::vector<char> unsorted(numThreads, 0);
+	parallelRun(numThreads, [&](int t) {
+		long begin, end;
+		splitRange(coo.nnz, numThreads, t, begin, end);
+		for (long i = std::max(begin, 1L); i < end && !unsorted[t]; i++) {
+			unsorted[t] = coo.row[i - 1] > coo.row[i] || (coo.row[i - 1] == coo.row[i] && coo.col[i - 1] >= coo.col[i]);
+		}
+	});
+	if (std::find(unsorted.begin(), unsorted.end(), 1) != unsorted.end()) {
+		return buildCSR(coo, std::plus<T>(), numThreads);
+	}
+
+	DynSparseCSR<T> csr(coo.rows, coo.cols, coo.nnz);
+	parallelRun(numThreads, [&](int t) {
+		long begin, end;
+		splitRange(coo.rows + 1, numThreads, t, begin, end);
+		for (long i = begin; i < end; i++) {
+			csr.rowptr[i] = (int) (std::lower_bound(coo.row.get(), coo.row.get() + coo.nnz, (int) i) - coo.row.get());
+		}
+		splitRange(coo.nnz, numThreads, t, begin, end);
+		std::copy(coo.col.get() + begin, coo.col.get() + end, csr.col.get() + begin);
+		std::copy(coo.data.get() + begin, coo.data.get() + end, csr.data.get() + begin);
+	});
+	return csr;
+}
+
+// csr -> coo, sorted row-major
+template<typename T>
+DynSparseCOO<T> csrToCOO(const DynSparseCSR<T> &csr, int numThreads = defaultNumThreads()) {
+	DynSparseCOO<T> coo(csr.rows, csr.cols, csr.nnz);
+	numThreads = std::max(1, std::min(numThreads, csr.nnz / 65536 + 1));
+	parallelRun(numThreads, [&](int t) {
+		int first = balancedSplit(csr.rowptr.get(), csr.rows, numThreads, t);
+		int last = balancedSplit(csr.rowptr.get(), csr.rows, numThreads, t + 1);
+		for (int i = first; i < last; i++) {
+			for (int j = csr.rowptr[i]; j < csr.rowptr[i + 1]; j++) {
+				coo.row[j] = i;
+				coo.col[j] = csr.col[j];
+				coo.data[j] = csr.data[j];
+			}
+		}
+	});
+	return coo;
+}
+
+// csr -> bsr. the non-zero blocks of every block row are found with a marker array over the block
+// columns (one per thread): a first pass counts them, a second pass fills them after the prefix sum.
+// dimensions need not be multiples of blockSize, edge blocks are zero padded
+template<typename T>
+DynSparseBSR<T> csrToBSR(const DynSparseCSR<T> &csr, int blockSize, int numThreads = defaultNumThreads()) {
+	if (blockSize < 1) {
+		throw std::invalid_argument("csrToBSR: blockSize must be positive");
+	}
+	const int bs = blockSize;
+	const int blockRows = (csr.rows + bs - 1) / bs;
+	const int blockCols = (csr.cols + bs - 1) / bs;
+	numThreads = std::max(1, std::min(numThreads, csr.nnz / 65536 + 1));
+
+	// element count up to every block row, to split block rows by their elements
+	std::vector<int> weight(blockRows + 1);
+	for (int i = 0; i <= blockRows; i++) {
+		weight[i] = csr.rowptr[std::min(csr.rows, i * bs)];
+	}
+
+	// 1) non-zero blocks per block row
+	DynSparseBSR<T> bsr(csr.rows, csr.cols, bs, 0);
+	std::vector<int> blockCount(blockRows + 1, 0);
+	parallelRun(numThreads, [&](int t) {
+		std::vector<int> marker(blockCols, -1);
+		int first = balancedSplit(weight.data(), blockRows, numThreads, t);
+		int last = balancedSplit(weight.data(), blockRows, numThreads, t + 1);
+		for (int i = first; i < last; i++) {
+			int count = 0;
+			for (int j = csr.rowptr[i * bs]; j < csr.rowptr[std::min(csr.rows, (i + 1) * bs)]; j++) {
+				int bc = csr.col[j] / bs;
+				if (marker[bc] != i) {
+					marker[bc] = i;
+					count += 1;
+				}
+			}
+			blockCount[i] = count;
+		}
+	});
+	parallelExclusiveScan(blockCount.data(), blockRows, bsr.blockRowptr.get(), numThreads);
+	bsr.nnzBlocks = bsr.blockRowptr[blockRows];
+	bsr.blockCol = AlignedArray<int>(bsr.nnzBlocks);
+	bsr.data = AlignedArray<T>((size_t) bsr.nnzBlocks * bs * bs);
+
+	// 2) sorted block columns of every block row, then scatter the elements into their blocks
+	parallelRun(numThreads, [&](int t) {
+		std::vector<int> slot(blockCols, -1);
+		int first = balancedSplit(weight.data(), blockRows, numThreads, t);
+		int last = balancedSplit(weight.data(), blockRows, numThreads, t + 1);
+		for (int i = first; i < last; i++) {
+			int *cols = bsr.blockCol.get() + bsr.blockRowptr[i];
+			int count = 0;
+			for (int j = csr.rowptr[i * bs]; j < csr.rowptr[std::min(csr.rows, (i + 1) * bs)]; j++) {
+				int bc = csr.col[j] / bs;
+				if (slot[bc] < 0) {
+					slot[bc] = 0;
+					cols[count++] = bc;
+				}
+			}
+			std::sort(cols, cols + count);
+			for (int b = 0; b < count; b++) {
+				slot[cols[b]] = bsr.blockRowptr[i] + b;
+			}
+
+			T *blocks = bsr.data.get() + (size_t) bsr.blockRowptr[i] * bs * bs;
+			std::fill(blocks, blocks + (size_t) count * bs * bs, T(0));
+			for (int r = i * bs; r < std::min(csr.rows, (i + 1) * bs); r++) {
+				for (int j = csr.rowptr[r]; j < csr.rowptr[r + 1]; j++) {
+					int c = csr.col[j];
+					bsr.data[(size_t) slot[c / bs] * bs * bs + (r - i * bs) * bs + c % bs] = csr.data[j];
+				}
+			}
+			for (int b = 0; b < count; b++) {
+				slot[cols[b]] = -1;
+			}
+		}
+	});
+	return bsr;
+}
+
+// csr -> ell, padding is stored as 0 in data and -1 in col
+template<typename T>
+DynSparseELL<T> csrToELL(const DynSparseCSR<T> &csr, int numThreads = defaultNumThreads()) {
+	numThreads = std::max(1, std::min(numThreads, csr.rows / 4096 + 1));
+	std::vector<int> longest(numThreads, 0);
+	parallelRun(numThreads, [&](int t) {
+		long begin, end;
+		splitRange(csr.rows, numThreads, t, begin, end);
+		for (long i = begin; i < end; i++) {
+			longest[t] = std::max(longest[t], csr.rowptr[i + 1] - csr.rowptr[i]);
+		}
+	});
+
+	DynSparseELL<T> ell(csr.rows, csr.cols, *std::max_element(longest.begin(), longest.end()));
+	parallelRun(numThreads, [&](int t) {
+		long begin, end;
+		splitRange(csr.rows, numThreads, t, begin, end);
+		for (long i = begin; i < end; i++) {
+			size_t out = (size_t) i * ell.maxNnzCols;
+			for (int j = csr.rowptr[i]; j < csr.rowptr[i + 1]; j++, out++) {
+				ell.data[out] = csr.data[j];
+				ell.col[out] = csr.col[j];
+			}
+			for (; out < (size_t) (i + 1) * ell.maxNnzCols; out++) {
+				ell.data[out] = 0;
+				ell.col[out] = -1;
+			}
+		}
+	});
+	return ell;
+}
+
+// csr -> sss: the diagonal goes to dvalues and the strictly lower triangle to values/col.
+// the matrix must be square and is assumed symmetric, its upper triangle is ignored
+template<typename T>
+DynSparseSSS<T> csrToSSS(const DynSparseCSR<T> &csr, int numThreads = defaultNumThreads()) {
+	if (csr.rows != csr.cols) {
+		throw std::invalid_argument("csrToSSS: matrix is not square");
+	}
+	const int n = csr.rows;
+	numThreads = std::max(1, std::min(numThreads, csr.nnz / 65536 + 1));
+
+	// csr rows are sorted, so the lower part of every row is a prefix of it
+	std::vector<int> lowerEnd(n);
+	DynSparseSSS<T> sss(n, 0);
+	parallelRun(numThreads, [&](int t) {
+		int first = balancedSplit(csr.rowptr.get(), n, numThreads, t);
+		int last = balancedSplit(csr.rowptr.get(), n, numThreads, t + 1);
+		for (int i = first; i < last; i++) {
+			const int *begin = csr.col.get() + csr.rowptr[i];
+			const int *end = csr.col.get() + csr.rowptr[i + 1];
+			const int *diag = std::lower_bound(begin, end, i);
+			lowerEnd[i] = (int) (diag - csr.col.get());
+			sss.dvalues[i] = (diag != end && *diag == i) ? csr.data[diag - csr.col.get()] : T(0);
+			sss.rowptr[i] = (int) (diag - begin);
+		}
+	});
+	parallelExclusiveScan(sss.rowptr.get(), n, sss.rowptr.get(), numThreads);
+	sss.lowerNnz = sss.rowptr[n];
+	sss.values = AlignedArray<T>(sss.lowerNnz);
+	sss.col = AlignedArray<int>(sss.lowerNnz);
+
+	parallelRun(numThreads, [&](int t) {
+		int first = balancedSplit(csr.rowptr.get(), n, numThreads, t);
+		int last = balancedSplit(csr.rowptr.get(), n, numThreads, t + 1);
+		for (int i = first; i < last; i++) {
+			std::copy(csr.col.get() + csr.rowptr[i], csr.col.get() + lowerEnd[i], sss.col.get() + sss.rowptr[i]);
+			std::copy(csr.data.get() + csr.rowptr[i], csr.data.get() + lowerEnd[i], sss.values.get() + sss.rowptr[i]);
+		}
+	});
+	return sss;
+}
+
+// csc -> tjds in O(nnz + cols), the csc matrix is left untouched.
+// columns are ordered by their number of elements (most populated first, stable) and the order is
+// stored in tjds.perm, so spMV takes the input vector in its original order
+template<typename T>
+DynSparseTJDS<T> cscToTJDS(const DynSparseCSC<T> &csc, int numThreads = defaultNumThreads()) {
+	const int cols = csc.cols;
+
+	// stable counting sort of the columns by descending element count
+	int tjTiles = 0;
+	for (int j = 0; j < cols; j++) {
+		tjTiles = std::max(tjTiles, csc.colptr[j + 1] - csc.colptr[j]);
+	}
+	std::vector<int> bucket(tjTiles + 2, 0);
+	for (int j = 0; j < cols; j++) {
+		bucket[tjTiles - (csc.colptr[j + 1] - csc.colptr[j]) + 1] += 1;
+	}
+	for (int k = 0; k <= tjTiles; k++) {
+		bucket[k + 1] += bucket[k];
+	}
+	DynSparseTJDS<T> tjds(csc.rows, cols, csc.nnz, tjTiles);
+	for (int j = 0; j < cols; j++) {
+		tjds.perm[bucket[tjTiles - (csc.colptr[j + 1] - csc.colptr[j])]++] = j;
+	}
+
+	// jagged diagonal k holds the k-th element of every column that has more than k
+	tjds.start[0] = 0;
+	for (int k = 0, sortedCols = cols; k < tjTiles; k++) {
+		while (sortedCols > 0 && csc.colptr[tjds.perm[sortedCols - 1] + 1] - csc.colptr[tjds.perm[sortedCols - 1]] <= k) {
+			sortedCols -= 1;
+		}
+		tjds.start[k + 1] = tjds.start[k] + sortedCols;
+	}
+
+	numThreads = std::max(1, std::min(numThreads, csc.nnz / 65536 + 1));
+	parallelRun(numThreads, [&](int t) {
+		long begin, end;
+		splitRange(cols, numThreads, t, begin, end);
+		for (long p = begin; p < end; p++) {
+			int j = tjds.perm[p];
+			for (int k = 0; k < csc.colptr[j + 1] - csc.colptr[j]; k++) {
+				tjds.val[tjds.start[k] + p] = csc.data[csc.colptr[j] + k];
+				tjds.row_index[tjds.start[k] + p] = csc.row[csc.colptr[j] + k];
+			}
+		}
+	});
+	return tjds;
+}
+
+// csr -> tjds, through a parallel transpose to csc
+template<typename T>
+DynSparseTJDS<T> csrToTJDS(const DynSparseCSR<T> &csr, int numThreads = defaultNumThreads()) {
+	return cscToTJDS(csrToCSC(csr, numThreads), numThreads);
+}
+
+// what converting a csr matrix to DIA would cost and save
+struct DIAReport {
+	int numDiags;
+	size_t storedNnz;	// numDiags * rows, including padding
+	double fill;		// storedNnz / nnz
+	size_t csrBytes;	// bytes moved by one csr spMV: values, col, rowptr, inVector and outVector
+	size_t diaBytes;	// the same for DIA: values, offsets, inVector and outVector
+	bool worthConverting;
+};
+
+// counts the occupied diagonals of a csr matrix in O(nnz + rows + cols) without building the DIA matrix.
+// DIA pays for its padding but stores no column indices, so it is worth converting when it moves
+// fewer bytes per spMV than csr. stencil matrices have a fill close to 1, there DIA drops the column
+// indices, which are a third (double) to half (float) of the bytes of the csr matrix
+template<typename T>
+DIAReport analyzeDiagonals(const DynSparseCSR<T> &csr) {
+	std::vector<char> used(csr.rows + csr.cols, 0);
+	DIAReport report = {};
+	for (int i = 0; i < csr.rows; i++) {
+		for (int j = csr.rowptr[i]; j < csr.rowptr[i + 1]; j++) {
+			char &u = used[csr.col[j] - i + csr.rows - 1];
+			report.numDiags += u == 0;
+			u = 1;
+		}
+	}
+	size_t vectors = ((size_t) csr.rows + csr.cols) * sizeof(T);
+	report.storedNnz = (size_t) report.numDiags * csr.rows;
+	report.fill = csr.nnz > 0 ? (double) report.storedNnz / csr.nnz : 0;
+	report.csrBytes = (size_t) csr.nnz * (sizeof(T) + sizeof(int)) + ((size_t) csr.rows + 1) * sizeof(int) + vectors;
+	report.diaBytes = report.storedNnz * sizeof(T) + (size_t) report.numDiags * sizeof(int) + vectors;
+	report.worthConverting = report.diaBytes < report.csrBytes;
+	return report;
+}
+
+#endif // SPARSECONVERT_H
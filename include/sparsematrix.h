@@ -3,6 +3,16 @@
 #define SPARSEMATRIX_H
 
 #include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <utility>
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <cstdint>
+#include <unistd.h>
 
 // COO sparse matrix format
 // ROWS: number of rows of original dense matrix
@@ -93,7 +103,8 @@ public:
 };
 
 // BSR sparse matrix format
-// IMPORTANT NOTE: assumes that matrix dimensions are multiples of BLOCKSIZE
+// if a matrix dimension is not a multiple of BLOCKSIZE, the last block row/col is an edge block
+// padded with zeros past the end of the matrix
 // ROWS: num. of rows of original dense matrix
 // COLS: num. of cols of original dense matrix
 // BLOCKSIZE: dimension of blocks
@@ -101,6 +112,8 @@ public:
 template<int ROWS, int COLS, int BLOCKSIZE, int NNZBLOCKS, typename T>
 class SparseBSR {
 public: 
+	static const int BLOCKROWS = (ROWS + BLOCKSIZE - 1) / BLOCKSIZE;
+
 	SparseBSR(T denseMatrix[ROWS][COLS]) {
 		blockRowptr[0] = 0;
 		int countNNZblocks = 0;
@@ -111,8 +124,8 @@ public:
 			for (int j = 0; j < COLS; j += BLOCKSIZE) {
 
 				bool foundNonZero = false;
-				for (int block_i = i; (block_i < i + BLOCKSIZE) && (!foundNonZero); block_i++)  {
-					for (int block_j = j; (block_j < j + BLOCKSIZE) && (!foundNonZero); block_j++) {
+				for (int block_i = i; (block_i < i + BLOCKSIZE) && (block_i < ROWS) && (!foundNonZero); block_i++)  {
+					for (int block_j = j; (block_j < j + BLOCKSIZE) && (block_j < COLS) && (!foundNonZero); block_j++) {
 						if (denseMatrix[block_i][block_j] != 0.0) {
 							foundNonZero = true;
 						}
@@ -124,7 +137,7 @@ public:
 					for (int block_i = i; block_i < i + BLOCKSIZE; block_i++) {
 						for (int block_j = j; block_j < j + BLOCKSIZE; block_j++) {
 							int idx = countNNZblocks * BLOCKSIZE * BLOCKSIZE + (block_i % BLOCKSIZE) * BLOCKSIZE + block_j % BLOCKSIZE;
-							data[idx] = denseMatrix[block_i][block_j];
+							data[idx] = (block_i < ROWS && block_j < COLS) ? denseMatrix[block_i][block_j] : 0;
 						}
 					}
 					countNNZblocks += 1;
@@ -135,7 +148,7 @@ public:
 		}
 	}
 	
-	int blockRowptr[ROWS  / BLOCKSIZE + 1];
+	int blockRowptr[BLOCKROWS + 1];
 	int blockCol[NNZBLOCKS];
 	T data[NNZBLOCKS * BLOCKSIZE * BLOCKSIZE];
 };
@@ -179,91 +192,43 @@ public:
 // COLS: num. of cols of original dense matrix
 // NNZ: num. of non-zero elements
 // TJ_TILES: equal to the number of coefficients in the most populated column
+// perm[p] is the original column stored at position p, spMV uses it to read the input vector
 template<int ROWS, int COLS, int NNZ, int TJ_TILES, typename T>
 class SparseTJDS {
 public:
-	// "vector" argument is responsible for reordering an input vector along with elements
-	// during the encoding process. This is useful for SpMV using this format.
-	SparseTJDS(T denseMatrix[ROWS][COLS], T vector[COLS] = NULL) {
-		// create matrix of row indices (use -1 instead of 0 because C++ is 0-based)
-		int Ids[ROWS][COLS];
-		for (int i = 0; i < ROWS; i++) {
-			for (int j = 0; j < COLS; j++) {
-				Ids[i][j] = (denseMatrix[i][j] != 0) ? i : -1;
-			}
-		}
-		
-		// compress denseMatrix and Ids arrays column-wise
+	// sparsify a dense matrix through a column-wise (csc) scan, denseMatrix is left untouched
+	SparseTJDS(T denseMatrix[ROWS][COLS]) : SparseTJDS(SparseCSC<ROWS, COLS, NNZ, T>(denseMatrix)) {}
+
+	// build from a csc matrix without touching it: columns are stable-sorted by their number of
+	// non-zero elements (most populated first) and jagged diagonal k takes the k-th element of
+	// every column that has more than k
+	SparseTJDS(const SparseCSC<ROWS, COLS, NNZ, T> &csc) {
 		for (int j = 0; j < COLS; j++) {
-			int currentRow = 0;
-			for (int i = 0; i < ROWS; i++) {
-				if (denseMatrix[i][j] != 0.0) {
-					denseMatrix[currentRow][j] = denseMatrix[i][j];
-					Ids[currentRow][j] = Ids[i][j];
-					currentRow += 1;
-				}
-			}
-			
-			while(currentRow < ROWS) {
-				denseMatrix[currentRow][j] = 0.0;
-				Ids[currentRow][j] = -1;
-				currentRow += 1;
-			}
-		}
-		
-		// reorder columns based on number of non-zero elements per column
-		// do this by scanning from bottom to top and from left to right
-		// if you encounter nonzero element in a column, place that column
-		// left and increment sortedCols counter
-		T denseTemp;
-		T vectorTemp;
-		int IdsTemp;
-		int sortedCols = 0;
-		for (int i = ROWS - 1; i >= 0; i--) {
-			for (int j = sortedCols; j < COLS && sortedCols < COLS - 1; j++) {
-				if (denseMatrix[i][j] != 0.0) {
-					if (sortedCols != j) {
-						for (int k = 0; k < ROWS; k++) {
-							denseTemp = denseMatrix[k][j];
-							denseMatrix[k][j] = denseMatrix[k][sortedCols];
-							denseMatrix[k][sortedCols] = denseTemp;
-	
-							IdsTemp = Ids[k][j];
-							Ids[k][j] = Ids[k][sortedCols];
-							Ids[k][sortedCols] = IdsTemp;	
-						}
-						
-						if (vector != NULL) {
-							vectorTemp = vector[j];
-							vector[j] = vector[sortedCols];
-							vector[sortedCols] = vectorTemp;
-						}
-						
-					}
-					sortedCols += 1;
-				}
-			}
+			perm[j] = j;
 		}
-		
-		// finally, store the above arrays as rows
+		std::stable_sort(perm, perm + COLS, [&](int a, int b) {
+			return csc.colptr[a + 1] - csc.colptr[a] > csc.colptr[b + 1] - csc.colptr[b];
+		});
+
 		start[0] = 0;
-		int nonZeroCount = 0;
-		for (int i = 0; i < TJ_TILES; i++) {
-			for (int j = 0; j < COLS; j++) {
-				if (denseMatrix[i][j] != 0.0) {
-					val[nonZeroCount] = denseMatrix[i][j];
-					row_index[nonZeroCount] = Ids[i][j];
-					nonZeroCount += 1;
-				}
+		for (int k = 0, sortedCols = COLS; k < TJ_TILES; k++) {
+			while (sortedCols > 0 && csc.colptr[perm[sortedCols - 1] + 1] - csc.colptr[perm[sortedCols - 1]] <= k) {
+				sortedCols -= 1;
+			}
+			start[k + 1] = start[k] + sortedCols;
+		}
+		for (int p = 0; p < COLS; p++) {
+			for (int k = 0; k < csc.colptr[perm[p] + 1] - csc.colptr[perm[p]]; k++) {
+				val[start[k] + p] = csc.data[csc.colptr[perm[p]] + k];
+				row_index[start[k] + p] = csc.row[csc.colptr[perm[p]] + k];
 			}
-			start[i + 1] = nonZeroCount;
 		}
-
 	}
 	
 	T val[NNZ];
 	int row_index[NNZ];
 	int start[TJ_TILES + 1];
+	int perm[COLS];
 };
 
 // Sparse Symmetric Skyline format
@@ -368,7 +333,7 @@ std::ostream &operator<<(std::ostream &os, const SparseBSR<ROWS, COLS, BLOCKSIZE
 		std::cout << bsr.data[i] << " ";
 	}
 	std::cout << "]\nblockRowptr = [ ";
-	for (int i = 0; i < ROWS / BLOCKSIZE + 1; i++) {
+	for (int i = 0; i < (ROWS + BLOCKSIZE - 1) / BLOCKSIZE + 1; i++) {
 		std::cout << bsr.blockRowptr[i] << " ";
 	}
 	std::cout << "]\nblockCol = [ ";
@@ -411,6 +376,10 @@ std::ostream &operator<<(std::ostream &os, const SparseTJDS<ROWS, COLS, NNZ, TJ_
 	for (int i = 0; i < TJ_TILES + 1; i++) {
 		std::cout << tjds.start[i] << " ";
 	}
+	std::cout << "]\nperm = [ ";
+	for (int i = 0; i < COLS; i++) {
+		std::cout << tjds.perm[i] << " ";
+	}
 	std::cout << "]\n";
 
 	return os;
@@ -440,4 +409,1097 @@ std::ostream &operator<<(std::ostream &os, const SparseSSS<N, LOWERNNZ, T> &sss)
 	return os;
 }
 
+// ---runtime-sized sparse matrix formats---
+// the formats above fix their dimensions at compile time and store everything
+// in in-object arrays, which is only practical for small matrices.
+// the formats below take their dimensions at run time and own aligned heap buffers.
+// they are move-only, so large matrices are never copied by accident.
+
+// alignment (in bytes) of all heap buffers owned by runtime-sized formats
+const size_t SPARSE_ALIGNMENT = 64;
+
+// owning, move-only, SPARSE_ALIGNMENT-aligned heap array
+// elements are left uninitialized, like the in-object arrays of the fixed-size formats
+template<typename T>
+class AlignedArray {
+public:
+	AlignedArray() : ptr(nullptr), len(0) {}
+
+	explicit AlignedArray(size_t n) : ptr(nullptr), len(n) {
+		if (n > 0) {
+			size_t bytes = (n * sizeof(T) + SPARSE_ALIGNMENT - 1) / SPARSE_ALIGNMENT * SPARSE_ALIGNMENT;
+			ptr = static_cast<T *>(std::aligned_alloc(SPARSE_ALIGNMENT, bytes));
+			if (ptr == nullptr) {
+				throw std::bad_alloc();
+			}
+		}
+	}
+
+	AlignedArray(const AlignedArray &) = delete;
+	AlignedArray &operator=(const AlignedArray &) = delete;
+
+	AlignedArray(AlignedArray &&other) noexcept : ptr(other.ptr), len(other.len) {
+		other.ptr = nullptr;
+		other.len = 0;
+	}
+
+	AlignedArray &operator=(AlignedArray &&other) noexcept {
+		if (this != &other) {
+			std::free(ptr);
+			ptr = other.ptr;
+			len = other.len;
+			other.ptr = nullptr;
+			other.len = 0;
+		}
+		return *this;
+	}
+
+	~AlignedArray() {
+		std::free(ptr);
+	}
+
+	T &operator[](size_t i) { return ptr[i]; }
+	const T &operator[](size_t i) const { return ptr[i]; }
+
+	T *get() { return ptr; }
+	const T *get() const { return ptr; }
+	size_t size() const { return len; }
+
+private:
+	T *ptr;
+	size_t len;
+};
+
+// runtime-sized COO sparse matrix format
+// rows, cols: dimensions of original dense matrix
+// nnz: number of non-zero elements
+template<typename T>
+class DynSparseCOO {
+public:
+	DynSparseCOO() : rows(0), cols(0), nnz(0) {}
+
+	// allocate (uninitialized) storage for a rows x cols matrix with nnz elements
+	DynSparseCOO(int rows, int cols, int nnz)
+		: rows(rows), cols(cols), nnz(nnz), data(nnz), row(nnz), col(nnz) {}
+
+	// sparsify a row-major rows x cols dense matrix
+	DynSparseCOO(int rows, int cols, const T *denseMatrix) : rows(rows), cols(cols), nnz(0) {
+		for (size_t i = 0; i < (size_t) rows * cols; i++) {
+			if (denseMatrix[i] != 0.0) {
+				nnz += 1;
+			}
+		}
+		data = AlignedArray<T>(nnz);
+		row = AlignedArray<int>(nnz);
+		col = AlignedArray<int>(nnz);
+
+		int countNNZ = 0;
+		for (int i = 0; i < rows; i++) {
+			for (int j = 0; j < cols; j++) {
+				if (denseMatrix[(size_t) i * cols + j] != 0.0) {
+					data[countNNZ] = denseMatrix[(size_t) i * cols + j];
+					row[countNNZ] = i;
+					col[countNNZ] = j;
+					countNNZ += 1;
+				}
+			}
+		}
+	}
+
+	// copy a fixed-size coo matrix to the heap
+	template<int ROWS, int COLS, int NNZ>
+	explicit DynSparseCOO(const SparseCOO<ROWS, COLS, NNZ, T> &coo) : DynSparseCOO(ROWS, COLS, NNZ) {
+		std::copy(coo.data, coo.data + NNZ, data.get());
+		std::copy(coo.row, coo.row + NNZ, row.get());
+		std::copy(coo.col, coo.col + NNZ, col.get());
+	}
+
+	int rows;
+	int cols;
+	int nnz;
+	AlignedArray<T> data;
+	AlignedArray<int> row;
+	AlignedArray<int> col;
+};
+
+// runtime-sized CSR sparse matrix format
+// rows, cols: dimensions of original dense matrix
+// nnz: number of non-zero elements
+template<typename T>
+class DynSparseCSR {
+public:
+	DynSparseCSR() : rows(0), cols(0), nnz(0) {}
+
+	// allocate (uninitialized) storage for a rows x cols matrix with nnz elements
+	DynSparseCSR(int rows, int cols, int nnz)
+		: rows(rows), cols(cols), nnz(nnz), data(nnz), col(nnz), rowptr(rows + 1) {}
+
+	// sparsify a row-major rows x cols dense matrix, scanning it row-wise
+	DynSparseCSR(int rows, int cols, const T *denseMatrix)
+		: rows(rows), cols(cols), nnz(0), rowptr(rows + 1) {
+		rowptr[0] = 0;
+		for (int i = 0; i < rows; i++) {
+			for (int j = 0; j < cols; j++) {
+				if (denseMatrix[(size_t) i * cols + j] != 0.0) {
+					nnz += 1;
+				}
+			}
+			rowptr[i + 1] = nnz;
+		}
+		data = AlignedArray<T>(nnz);
+		col = AlignedArray<int>(nnz);
+
+		int countNNZ = 0;
+		for (int i = 0; i < rows; i++) {
+			for (int j = 0; j < cols; j++) {
+				if (denseMatrix[(size_t) i * cols + j] != 0.0) {
+					data[countNNZ] = denseMatrix[(size_t) i * cols + j];
+					col[countNNZ] = j;
+					countNNZ += 1;
+				}
+			}
+		}
+	}
+
+	// copy a fixed-size csr matrix to the heap
+	template<int ROWS, int COLS, int NNZ>
+	explicit DynSparseCSR(const SparseCSR<ROWS, COLS, NNZ, T> &csr) : DynSparseCSR(ROWS, COLS, NNZ) {
+		std::copy(csr.data, csr.data + NNZ, data.get());
+		std::copy(csr.col, csr.col + NNZ, col.get());
+		std::copy(csr.rowptr, csr.rowptr + ROWS + 1, rowptr.get());
+	}
+
+	int rows;
+	int cols;
+	int nnz;
+	AlignedArray<T> data;
+	AlignedArray<int> col;
+	AlignedArray<int> rowptr;
+};
+
+// runtime-sized CSC sparse matrix format
+// rows, cols: dimensions of original dense matrix
+// nnz: number of non-zero elements
+template<typename T>
+class DynSparseCSC {
+public:
+	DynSparseCSC() : rows(0), cols(0), nnz(0) {}
+
+	// allocate (uninitialized) storage for a rows x cols matrix with nnz elements
+	DynSparseCSC(int rows, int cols, int nnz)
+		: rows(rows), cols(cols), nnz(nnz), data(nnz), row(nnz), colptr(cols + 1) {}
+
+	// sparsify a row-major rows x cols dense matrix, scanning it column-wise
+	DynSparseCSC(int rows, int cols, const T *denseMatrix)
+		: rows(rows), cols(cols), nnz(0), colptr(cols + 1) {
+		colptr[0] = 0;
+		for (int j = 0; j < cols; j++) {
+			for (int i = 0; i < rows; i++) {
+				if (denseMatrix[(size_t) i * cols + j] != 0.0) {
+					nnz += 1;
+				}
+			}
+			colptr[j + 1] = nnz;
+		}
+		data = AlignedArray<T>(nnz);
+		row = AlignedArray<int>(nnz);
+
+		int countNNZ = 0;
+		for (int j = 0; j < cols; j++) {
+			for (int i = 0; i < rows; i++) {
+				if (denseMatrix[(size_t) i * cols + j] != 0.0) {
+					data[countNNZ] = denseMatrix[(size_t) i * cols + j];
+					row[countNNZ] = i;
+					countNNZ += 1;
+				}
+			}
+		}
+	}
+
+	// copy a fixed-size csc matrix to the heap
+	template<int ROWS, int COLS, int NNZ>
+	explicit DynSparseCSC(const SparseCSC<ROWS, COLS, NNZ, T> &csc) : DynSparseCSC(ROWS, COLS, NNZ) {
+		std::copy(csc.data, csc.data + NNZ, data.get());
+		std::copy(csc.row, csc.row + NNZ, row.get());
+		std::copy(csc.colptr, csc.colptr + COLS + 1, colptr.get());
+	}
+
+	int rows;
+	int cols;
+	int nnz;
+	AlignedArray<T> data;
+	AlignedArray<int> row;
+	AlignedArray<int> colptr;
+};
+
+// runtime-sized BSR sparse matrix format
+// if a matrix dimension is not a multiple of blockSize, the last block row/col is an edge block
+// padded with zeros past the end of the matrix
+// rows, cols: dimensions of original dense matrix
+// blockSize: dimension of blocks
+// nnzBlocks: number of blocks that contain nonzero elements
+template<typename T>
+class DynSparseBSR {
+public:
+	DynSparseBSR() : rows(0), cols(0), blockSize(1), nnzBlocks(0) {}
+
+	// allocate (uninitialized) storage for a rows x cols matrix with nnzBlocks blocks
+	DynSparseBSR(int rows, int cols, int blockSize, int nnzBlocks)
+		: rows(rows), cols(cols), blockSize(blockSize), nnzBlocks(nnzBlocks),
+		  blockRowptr((rows + blockSize - 1) / blockSize + 1), blockCol(nnzBlocks),
+		  data((size_t) nnzBlocks * blockSize * blockSize) {}
+
+	// sparsify a row-major rows x cols dense matrix block by block
+	DynSparseBSR(int rows, int cols, int blockSize, const T *denseMatrix)
+		: rows(rows), cols(cols), blockSize(blockSize), nnzBlocks(0),
+		  blockRowptr((rows + blockSize - 1) / blockSize + 1) {
+		// first pass finds the non-zero blocks, second pass copies them (in row-major order)
+		std::vector<int> nonZeroBlockCols;
+		blockRowptr[0] = 0;
+		for (int i = 0; i < rows; i += blockSize) {
+			for (int j = 0; j < cols; j += blockSize) {
+				bool foundNonZero = false;
+				for (int block_i = i; (block_i < std::min(rows, i + blockSize)) && (!foundNonZero); block_i++) {
+					for (int block_j = j; (block_j < std::min(cols, j + blockSize)) && (!foundNonZero); block_j++) {
+						if (denseMatrix[(size_t) block_i * cols + block_j] != 0.0) {
+							foundNonZero = true;
+						}
+					}
+				}
+				if (foundNonZero) {
+					nonZeroBlockCols.push_back(j / blockSize);
+				}
+			}
+			blockRowptr[i / blockSize + 1] = (int) nonZeroBlockCols.size();
+		}
+
+		nnzBlocks = (int) nonZeroBlockCols.size();
+		blockCol = AlignedArray<int>(nnzBlocks);
+		data = AlignedArray<T>((size_t) nnzBlocks * blockSize * blockSize);
+		for (int i = 0; i < (rows + blockSize - 1) / blockSize; i++) {
+			for (int b = blockRowptr[i]; b < blockRowptr[i + 1]; b++) {
+				blockCol[b] = nonZeroBlockCols[b];
+				for (int block_i = 0; block_i < blockSize; block_i++) {
+					for (int block_j = 0; block_j < blockSize; block_j++) {
+						size_t idx = (size_t) b * blockSize * blockSize + block_i * blockSize + block_j;
+						int r = i * blockSize + block_i;
+						int c = blockCol[b] * blockSize + block_j;
+						data[idx] = (r < rows && c < cols) ? denseMatrix[(size_t) r * cols + c] : T(0);
+					}
+				}
+			}
+		}
+	}
+
+	// copy a fixed-size bsr matrix to the heap
+	template<int ROWS, int COLS, int BLOCKSIZE, int NNZBLOCKS>
+	explicit DynSparseBSR(const SparseBSR<ROWS, COLS, BLOCKSIZE, NNZBLOCKS, T> &bsr)
+		: DynSparseBSR(ROWS, COLS, BLOCKSIZE, NNZBLOCKS) {
+		std::copy(bsr.blockRowptr, bsr.blockRowptr + (ROWS + BLOCKSIZE - 1) / BLOCKSIZE + 1, blockRowptr.get());
+		std::copy(bsr.blockCol, bsr.blockCol + NNZBLOCKS, blockCol.get());
+		std::copy(bsr.data, bsr.data + NNZBLOCKS * BLOCKSIZE * BLOCKSIZE, data.get());
+	}
+
+	int rows;
+	int cols;
+	int blockSize;
+	int nnzBlocks;
+	AlignedArray<int> blockRowptr;
+	AlignedArray<int> blockCol;
+	AlignedArray<T> data;
+};
+
+// runtime-sized ELL sparse matrix format
+// rows, cols: dimensions of original dense matrix
+// maxNnzCols: the maximum number of non-zero elements in one row
+template<typename T>
+class DynSparseELL {
+public:
+	DynSparseELL() : rows(0), cols(0), maxNnzCols(0) {}
+
+	// allocate (uninitialized) storage for a rows x cols matrix
+	DynSparseELL(int rows, int cols, int maxNnzCols)
+		: rows(rows), cols(cols), maxNnzCols(maxNnzCols),
+		  data((size_t) rows * maxNnzCols), col((size_t) rows * maxNnzCols) {}
+
+	// sparsify a row-major rows x cols dense matrix
+	// padding is stored as 0 in data and -1 in col
+	DynSparseELL(int rows, int cols, const T *denseMatrix) : rows(rows), cols(cols), maxNnzCols(0) {
+		for (int i = 0; i < rows; i++) {
+			int rowNNZ = 0;
+			for (int j = 0; j < cols; j++) {
+				if (denseMatrix[(size_t) i * cols + j] != 0.0) {
+					rowNNZ += 1;
+				}
+			}
+			maxNnzCols = std::max(maxNnzCols, rowNNZ);
+		}
+		data = AlignedArray<T>((size_t) rows * maxNnzCols);
+		col = AlignedArray<int>((size_t) rows * maxNnzCols);
+
+		for (int i = 0; i < rows; i++) {
+			size_t currentCol = (size_t) i * maxNnzCols;
+			for (int j = 0; j < cols; j++) {
+				if (denseMatrix[(size_t) i * cols + j] != 0.0) {
+					data[currentCol] = denseMatrix[(size_t) i * cols + j];
+					col[currentCol] = j;
+					currentCol += 1;
+				}
+			}
+
+			while (currentCol < (size_t) (i + 1) * maxNnzCols) {
+				data[currentCol] = 0;
+				col[currentCol] = -1;
+				currentCol += 1;
+			}
+		}
+	}
+
+	// copy a fixed-size ell matrix to the heap
+	template<int ROWS, int COLS, int MAXNNZCOLS>
+	explicit DynSparseELL(const SparseELL<ROWS, COLS, MAXNNZCOLS, T> &ell) : DynSparseELL(ROWS, COLS, MAXNNZCOLS) {
+		std::copy(ell.data, ell.data + ROWS * MAXNNZCOLS, data.get());
+		std::copy(ell.col, ell.col + ROWS * MAXNNZCOLS, col.get());
+	}
+
+	int rows;
+	int cols;
+	int maxNnzCols;
+	AlignedArray<T> data;
+	AlignedArray<int> col;
+};
+
+// runtime-sized TJDS sparse matrix format
+// rows, cols: dimensions of original dense matrix
+// nnz: num. of non-zero elements
+// tjTiles: equal to the number of coefficients in the most populated column
+template<typename T>
+class DynSparseTJDS {
+public:
+	DynSparseTJDS() : rows(0), cols(0), nnz(0), tjTiles(0) {}
+
+	// allocate (uninitialized) storage for a rows x cols matrix
+	DynSparseTJDS(int rows, int cols, int nnz, int tjTiles)
+		: rows(rows), cols(cols), nnz(nnz), tjTiles(tjTiles),
+		  val(nnz), row_index(nnz), start(tjTiles + 1), perm(cols) {}
+
+	// sparsify a row-major rows x cols dense matrix, denseMatrix is left untouched.
+	// spMV reads the input vector through perm, so it is passed in its original order
+	DynSparseTJDS(int rows, int cols, const T *denseMatrix)
+		: rows(rows), cols(cols), nnz(0), tjTiles(0) {
+		// sort columns by their number of non-zero elements (most populated first)
+		std::vector<int> colNNZ(cols, 0);
+		for (int i = 0; i < rows; i++) {
+			for (int j = 0; j < cols; j++) {
+				if (denseMatrix[(size_t) i * cols + j] != 0.0) {
+					colNNZ[j] += 1;
+				}
+			}
+		}
+		std::vector<int> order(cols);
+		for (int j = 0; j < cols; j++) {
+			order[j] = j;
+			nnz += colNNZ[j];
+			tjTiles = std::max(tjTiles, colNNZ[j]);
+		}
+		std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return colNNZ[a] > colNNZ[b]; });
+
+		// jagged diagonal k holds the k-th non-zero element of every column that has more than k
+		val = AlignedArray<T>(nnz);
+		row_index = AlignedArray<int>(nnz);
+		start = AlignedArray<int>(tjTiles + 1);
+		start[0] = 0;
+		for (int k = 0, sortedCols = cols; k < tjTiles; k++) {
+			while (sortedCols > 0 && colNNZ[order[sortedCols - 1]] <= k) {
+				sortedCols -= 1;
+			}
+			start[k + 1] = start[k] + sortedCols;
+		}
+
+		for (int p = 0; p < cols; p++) {
+			int j = order[p];
+			int k = 0;
+			for (int i = 0; i < rows; i++) {
+				if (denseMatrix[(size_t) i * cols + j] != 0.0) {
+					val[start[k] + p] = denseMatrix[(size_t) i * cols + j];
+					row_index[start[k] + p] = i;
+					k += 1;
+				}
+			}
+		}
+
+		perm = AlignedArray<int>(cols);
+		std::copy(order.begin(), order.end(), perm.get());
+	}
+
+	// copy a fixed-size tjds matrix to the heap
+	template<int ROWS, int COLS, int NNZ, int TJ_TILES>
+	explicit DynSparseTJDS(const SparseTJDS<ROWS, COLS, NNZ, TJ_TILES, T> &tjds)
+		: DynSparseTJDS(ROWS, COLS, NNZ, TJ_TILES) {
+		std::copy(tjds.val, tjds.val + NNZ, val.get());
+		std::copy(tjds.row_index, tjds.row_index + NNZ, row_index.get());
+		std::copy(tjds.start, tjds.start + TJ_TILES + 1, start.get());
+		std::copy(tjds.perm, tjds.perm + COLS, perm.get());
+	}
+
+	int rows;
+	int cols;
+	int nnz;
+	int tjTiles;
+	AlignedArray<T> val;
+	AlignedArray<int> row_index;
+	AlignedArray<int> start;
+	AlignedArray<int> perm;     // perm[p]: original column stored at position p
+};
+
+// runtime-sized Sparse Symmetric Skyline format
+// n: original matrix dimension (same for num. of rows and cols)
+// lowerNnz: number of non-zero elements of the lower triangular submatrix
+template<typename T>
+class DynSparseSSS {
+public:
+	DynSparseSSS() : n(0), lowerNnz(0) {}
+
+	// allocate (uninitialized) storage for an n x n matrix
+	DynSparseSSS(int n, int lowerNnz)
+		: n(n), lowerNnz(lowerNnz), dvalues(n), values(lowerNnz), rowptr(n + 1), col(lowerNnz) {}
+
+	// sparsify a row-major, symmetric n x n dense matrix
+	DynSparseSSS(int n, const T *denseMatrix) : n(n), lowerNnz(0), dvalues(n), rowptr(n + 1) {
+		rowptr[0] = 0;
+		for (int i = 0; i < n; i++) {
+			dvalues[i] = denseMatrix[(size_t) i * n + i];
+			for (int j = 0; j < i; j++) {
+				if (denseMatrix[(size_t) i * n + j] != 0) {
+					lowerNnz += 1;
+				}
+			}
+			rowptr[i + 1] = lowerNnz;
+		}
+		values = AlignedArray<T>(lowerNnz);
+		col = AlignedArray<int>(lowerNnz);
+
+		int countNNZ = 0;
+		for (int i = 0; i < n; i++) {
+			for (int j = 0; j < i; j++) {
+				if (denseMatrix[(size_t) i * n + j] != 0) {
+					values[countNNZ] = denseMatrix[(size_t) i * n + j];
+					col[countNNZ] = j;
+					countNNZ += 1;
+				}
+			}
+		}
+	}
+
+	// copy a fixed-size sss matrix to the heap
+	template<int N, int LOWERNNZ>
+	explicit DynSparseSSS(const SparseSSS<N, LOWERNNZ, T> &sss) : DynSparseSSS(N, LOWERNNZ) {
+		std::copy(sss.dvalues, sss.dvalues + N, dvalues.get());
+		std::copy(sss.values, sss.values + LOWERNNZ, values.get());
+		std::copy(sss.rowptr, sss.rowptr + N + 1, rowptr.get());
+		std::copy(sss.col, sss.col + LOWERNNZ, col.get());
+	}
+
+	int n;
+	int lowerNnz;
+	AlignedArray<T> dvalues;
+	AlignedArray<T> values;
+	AlignedArray<int> rowptr;
+	AlignedArray<int> col;
+};
+
+// number of values of type T in one SIMD register of the target (at least 4)
+// the natural chunk height C of SparseSELL
+template<typename T>
+constexpr int simdWidth() {
+#if defined(__AVX512F__)
+	return 64 / sizeof(T) >= 4 ? (int) (64 / sizeof(T)) : 4;
+#elif defined(__AVX2__)
+	return 32 / sizeof(T) >= 4 ? (int) (32 / sizeof(T)) : 4;
+#else
+	return 4;
+#endif
+}
+
+// SELL-C-sigma sparse matrix format
+// based on "A unified sparse matrix data format for efficient general sparse matrix-vector
+// multiplication on modern processors with wide SIMD units" (Kreutzer et al.)
+// rows are sorted by length (longest first) within windows of sigma rows, then grouped into
+// chunks of C rows. every chunk is padded only to its own longest row and stored column-major,
+// so one SIMD instruction processes element j of C rows at once.
+// C: chunk height, normally simdWidth<T>()
+// rowPerm[k]: original row of the k-th sorted row
+// chunkPtr[c]: offset of chunk c in data/col, chunkLen[c]: width of chunk c. the offsets are long,
+// as the padded storage of a skewed matrix can exceed 2^31 - 1 elements while nnz does not
+// padding is stored as 0 in data and a valid column in col (the last column of the row, column 0 for
+// empty rows), so kernels never branch on it. the padding still multiplies the input element at that
+// column: an Inf or NaN there turns the result of the padded row into NaN, also for an empty row
+template<typename T, int C = simdWidth<T>()>
+class SparseSELL {
+public:
+	SparseSELL() : rows(0), cols(0), nnz(0), sigma(1), numChunks(0) {}
+
+	SparseSELL(const DynSparseCSR<T> &csr, int sigma)
+		: rows(csr.rows), cols(csr.cols), nnz(csr.nnz), sigma(std::max(1, sigma)),
+		  numChunks((csr.rows + C - 1) / C), rowPerm(csr.rows), chunkPtr(numChunks + 1), chunkLen(numChunks) {
+		// sort rows by length within every window of sigma rows
+		for (int i = 0; i < rows; i++) {
+			rowPerm[i] = i;
+		}
+		for (int w = 0; w < rows; w += this->sigma) {
+			int *first = rowPerm.get() + w;
+			int *last = rowPerm.get() + std::min(rows, w + this->sigma);
+			std::stable_sort(first, last, [&](int a, int b) {
+				return csr.rowptr[a + 1] - csr.rowptr[a] > csr.rowptr[b + 1] - csr.rowptr[b];
+			});
+		}
+
+		// width of every chunk is the length of its longest row
+		chunkPtr[0] = 0;
+		for (int c = 0; c < numChunks; c++) {
+			int width = 0;
+			for (int k = c * C; k < std::min(rows, (c + 1) * C); k++) {
+				width = std::max(width, csr.rowptr[rowPerm[k] + 1] - csr.rowptr[rowPerm[k]]);
+			}
+			chunkLen[c] = width;
+			chunkPtr[c + 1] = chunkPtr[c] + (long) width * C;
+		}
+
+		// fill chunks column-major
+		data = AlignedArray<T>(chunkPtr[numChunks]);
+		col = AlignedArray<int>(chunkPtr[numChunks]);
+		for (int c = 0; c < numChunks; c++) {
+			for (int r = 0; r < C; r++) {
+				int k = c * C + r;
+				int first = k < rows ? csr.rowptr[rowPerm[k]] : 0;
+				int len = k < rows ? csr.rowptr[rowPerm[k] + 1] - first : 0;
+				for (int j = 0; j < chunkLen[c]; j++) {
+					size_t idx = chunkPtr[c] + (size_t) j * C + r;
+					data[idx] = j < len ? csr.data[first + j] : T(0);
+					col[idx] = j < len ? csr.col[first + j] : (len > 0 ? csr.col[first + len - 1] : 0);
+				}
+			}
+		}
+	}
+
+	// stored elements including padding
+	size_t paddedNnz() const {
+		return numChunks > 0 ? chunkPtr[numChunks] : 0;
+	}
+
+	int rows;
+	int cols;
+	int nnz;
+	int sigma;
+	int numChunks;
+	AlignedArray<int> rowPerm;
+	AlignedArray<long> chunkPtr;
+	AlignedArray<int> chunkLen;
+	AlignedArray<T> data;
+	AlignedArray<int> col;
+};
+
+// hybrid ELL + COO sparse matrix format
+// the first k elements of every row are stored in an ELL part, column-major over all rows
+// (element j of row i at j * rows + i), so spMV runs down the rows with SIMD; the remaining
+// elements of rows longer than k spill into a row-sorted COO tail, so one long row no longer
+// pads every other row.
+// by default k is picked from the row-length histogram to minimize the bytes spMV moves: one more
+// ELL column costs rows * (sizeof(T) + sizeof(int)) and saves sizeof(T) + 2 * sizeof(int) for
+// every row still longer than k
+// ELL padding is stored as 0 in data and a valid column in col (the last column of the row, column 0
+// for empty rows), so kernels never branch on it. the padding still multiplies the input element at
+// that column: an Inf or NaN there turns the result of the padded row into NaN, also for an empty
+// row, whose exact result would be 0. spMV on non-finite input vectors needs csr instead
+template<typename T>
+class SparseHYB {
+public:
+	SparseHYB() : rows(0), cols(0), nnz(0), k(0), cooNnz(0) {}
+
+	explicit SparseHYB(const DynSparseCSR<T> &csr) : SparseHYB(csr, chooseWidth(csr)) {}
+
+	SparseHYB(const DynSparseCSR<T> &csr, int k)
+		: rows(csr.rows), cols(csr.cols), nnz(csr.nnz), k(std::max(0, k)), cooNnz(0),
+		  data((size_t) csr.rows * this->k), col((size_t) csr.rows * this->k) {
+		for (int i = 0; i < rows; i++) {
+			cooNnz += std::max(0, csr.rowptr[i + 1] - csr.rowptr[i] - this->k);
+		}
+		cooRow = AlignedArray<int>(cooNnz);
+		cooCol = AlignedArray<int>(cooNnz);
+		cooData = AlignedArray<T>(cooNnz);
+
+		for (int i = 0, tail = 0; i < rows; i++) {
+			int first = csr.rowptr[i];
+			int len = csr.rowptr[i + 1] - first;
+			for (int j = 0; j < this->k; j++) {
+				size_t idx = (size_t) j * rows + i;
+				data[idx] = j < len ? csr.data[first + j] : T(0);
+				col[idx] = j < len ? csr.col[first + j] : (len > 0 ? csr.col[first + len - 1] : 0);
+			}
+			for (int j = this->k; j < len; j++, tail++) {
+				cooRow[tail] = i;
+				cooCol[tail] = csr.col[first + j];
+				cooData[tail] = csr.data[first + j];
+			}
+		}
+	}
+
+	// ELL width with the fewest bytes moved by spMV
+	static int chooseWidth(const DynSparseCSR<T> &csr) {
+		int longest = 0;
+		for (int i = 0; i < csr.rows; i++) {
+			longest = std::max(longest, csr.rowptr[i + 1] - csr.rowptr[i]);
+		}
+		std::vector<int> histogram(longest + 1, 0);
+		for (int i = 0; i < csr.rows; i++) {
+			histogram[csr.rowptr[i + 1] - csr.rowptr[i]] += 1;
+		}
+
+		const long ellColumn = (long) csr.rows * (sizeof(T) + sizeof(int));
+		const long cooElement = sizeof(T) + 2 * sizeof(int);
+		long bytes = (long) csr.nnz * cooElement;
+		long bestBytes = bytes;
+		int best = 0;
+		// rows longer than w, i.e. the elements that move from the tail to the ELL part when w grows by one
+		long longer = csr.rows - histogram[0];
+		for (int w = 1; w <= longest; w++) {
+			bytes += ellColumn - longer * cooElement;
+			longer -= histogram[w];
+			if (bytes < bestBytes) {
+				bestBytes = bytes;
+				best = w;
+			}
+		}
+		return best;
+	}
+
+	// stored ELL elements including padding
+	size_t paddedEllNnz() const {
+		return (size_t) rows * k;
+	}
+
+	int rows;
+	int cols;
+	int nnz;
+	int k;
+	int cooNnz;
+	AlignedArray<T> data;
+	AlignedArray<int> col;
+	AlignedArray<int> cooRow;
+	AlignedArray<int> cooCol;
+	AlignedArray<T> cooData;
+};
+
+// DIA (diagonal) sparse matrix format for banded matrices
+// stores the offsets of the diagonals holding non-zero elements (offset = col - row, ascending)
+// and one value array of length rows per diagonal: element (i, i + offsets[d]) is at data[d * rows + i].
+// positions outside the matrix and zeros on a stored diagonal are stored as 0.
+// no column index is stored, so spMV streams values and the input vector without gathers.
+// the storage grows with numDiags * rows, so an unstructured matrix would need about rows times its nnz;
+// matrices with more than DIA_MAX_FILL stored elements per non-zero element are refused.
+// check analyzeDiagonals(csr).worthConverting before converting
+const double DIA_MAX_FILL = 8;
+
+template<typename T>
+class SparseDIA {
+public:
+	SparseDIA() : rows(0), cols(0), nnz(0), numDiags(0) {}
+
+	explicit SparseDIA(const DynSparseCSR<T> &csr) : rows(csr.rows), cols(csr.cols), nnz(csr.nnz), numDiags(0) {
+		// marker over all possible offsets -(rows - 1) ... cols - 1
+		std::vector<int> slot(rows + cols, -1);
+		for (int i = 0; i < rows; i++) {
+			for (int j = csr.rowptr[i]; j < csr.rowptr[i + 1]; j++) {
+				slot[csr.col[j] - i + rows - 1] = 0;
+			}
+		}
+		for (int s = 0; s < rows + cols - 1; s++) {
+			if (slot[s] == 0) {
+				numDiags += 1;
+			}
+		}
+		if ((double) numDiags * rows > DIA_MAX_FILL * std::max(nnz, rows)) {
+			throw std::invalid_argument("SparseDIA: too many diagonals, the padding would exceed DIA_MAX_FILL");
+		}
+		offsets = AlignedArray<int>(numDiags);
+		data = AlignedArray<T>((size_t) numDiags * rows);
+		for (int s = 0, d = 0; s < rows + cols - 1; s++) {
+			if (slot[s] == 0) {
+				offsets[d] = s - (rows - 1);
+				slot[s] = d++;
+			}
+		}
+		for (size_t k = 0; k < (size_t) numDiags * rows; k++) {
+			data[k] = 0;
+		}
+		for (int i = 0; i < rows; i++) {
+			for (int j = csr.rowptr[i]; j < csr.rowptr[i + 1]; j++) {
+				data[(size_t) slot[csr.col[j] - i + rows - 1] * rows + i] += csr.data[j];
+			}
+		}
+	}
+
+	// stored elements including padding
+	size_t storedNnz() const {
+		return (size_t) numDiags * rows;
+	}
+
+	int rows;
+	int cols;
+	int nnz;
+	int numDiags;
+	AlignedArray<int> offsets;
+	AlignedArray<T> data;
+};
+
+// size in bytes of the per-core L2 cache, 1 MiB where it cannot be queried
+inline long l2CacheSize() {
+#if defined(_SC_LEVEL2_CACHE_SIZE)
+	long bytes = sysconf(_SC_LEVEL2_CACHE_SIZE);
+	if (bytes > 0) {
+		return bytes;
+	}
+#endif
+	return 1L << 20;
+}
+
+// column-tiled CSR sparse matrix format for matrices whose input vector does not fit in cache
+// the columns are cut into panels of panelWidth columns and every panel is stored as its own csr
+// sub-matrix, so spMV sweeps the rows once per panel and only gathers from a cache-sized slice
+// of the input vector. a panel only lists the rows that have elements in it (rowIdx), so the
+// storage stays O(nnz + numPanels) however many panels there are.
+// panels are stored one after another: the rows of panel p are rowIdx[panelPtr[p] ... panelPtr[p + 1] - 1]
+// (ascending), and the k-th listed row holds col/data[rowptr[k] ... rowptr[k + 1] - 1]
+// I: type of the column indices, which are relative to the first column of their panel, so uint16_t
+// halves the index bytes of panels up to 65536 columns wide
+template<typename T, typename I = int>
+class SparseTiledCSR {
+public:
+	SparseTiledCSR() : rows(0), cols(0), nnz(0), panelWidth(1), numPanels(0) {}
+
+	// panels sized for the L2 cache of this machine
+	explicit SparseTiledCSR(const DynSparseCSR<T> &csr) : SparseTiledCSR(csr, choosePanelWidth(csr.cols)) {}
+
+	SparseTiledCSR(const DynSparseCSR<T> &csr, int panelWidth)
+		: rows(csr.rows), cols(csr.cols), nnz(csr.nnz), panelWidth(std::max(1, panelWidth)),
+		  numPanels((csr.cols + this->panelWidth - 1) / this->panelWidth), panelPtr(numPanels + 1),
+		  col(csr.nnz), data(csr.nnz), totalRowptr(csr.rows + 1) {
+		if ((unsigned long long) (this->panelWidth - 1) > (unsigned long long) std::numeric_limits<I>::max()) {
+			throw std::out_of_range("SparseTiledCSR: panel-relative column indices do not fit the index type");
+		}
+		// count the listed rows and the elements of every panel
+		std::vector<int> lastRow(numPanels, -1), panelRows(numPanels, 0), panelNnz(numPanels, 0);
+		for (int i = 0; i < rows; i++) {
+			for (int j = csr.rowptr[i]; j < csr.rowptr[i + 1]; j++) {
+				int p = csr.col[j] / this->panelWidth;
+				if (lastRow[p] != i) {
+					lastRow[p] = i;
+					panelRows[p] += 1;
+				}
+				panelNnz[p] += 1;
+			}
+		}
+		std::vector<int> rowCursor(numPanels), nnzCursor(numPanels);
+		panelPtr[0] = 0;
+		for (int p = 0, offset = 0; p < numPanels; p++) {
+			panelPtr[p + 1] = panelPtr[p] + panelRows[p];
+			rowCursor[p] = panelPtr[p];
+			nnzCursor[p] = offset;
+			offset += panelNnz[p];
+		}
+		int listed = numPanels > 0 ? panelPtr[numPanels] : 0;
+		rowIdx = AlignedArray<int>(listed);
+		rowptr = AlignedArray<int>(listed + 1);
+
+		// rows are visited in order, so the rows of a panel are listed ascending and the elements of
+		// one listed row are contiguous
+		std::fill(lastRow.begin(), lastRow.end(), -1);
+		for (int i = 0; i < rows; i++) {
+			for (int j = csr.rowptr[i]; j < csr.rowptr[i + 1]; j++) {
+				int p = csr.col[j] / this->panelWidth;
+				if (lastRow[p] != i) {
+					lastRow[p] = i;
+					rowIdx[rowCursor[p]] = i;
+					rowptr[rowCursor[p]] = nnzCursor[p];
+					rowCursor[p] += 1;
+				}
+				col[nnzCursor[p]] = (I) (csr.col[j] - p * this->panelWidth);
+				data[nnzCursor[p]] = csr.data[j];
+				nnzCursor[p] += 1;
+			}
+		}
+		rowptr[listed] = nnz;
+		for (int i = 0; i <= rows; i++) {
+			totalRowptr[i] = csr.rowptr[i];
+		}
+	}
+
+	// bytes of index data spMV reads (col, rowIdx, rowptr, panelPtr)
+	size_t indexBytes() const {
+		size_t listed = numPanels > 0 ? panelPtr[numPanels] : 0;
+		return (size_t) nnz * sizeof(I) + (2 * listed + 1) * sizeof(int) + ((size_t) numPanels + 1) * sizeof(int);
+	}
+
+	// widest panel whose slice of the input vector fills half of cacheBytes, leaving the other half
+	// to the streamed matrix and output vector; a multiple of 64 columns that I can index
+	static int choosePanelWidth(int cols, long cacheBytes = l2CacheSize()) {
+		long width = cacheBytes / 2 / (long) sizeof(T) / 64 * 64;
+		long indexable = (long) std::min<unsigned long long>(std::numeric_limits<I>::max(), std::numeric_limits<int>::max()) + 1;
+		width = std::min(width, indexable / 64 * 64);
+		width = std::max(64L, width);
+		return (int) std::min(width, (long) std::max(1, cols));
+	}
+
+	int rows;
+	int cols;
+	int nnz;
+	int panelWidth;
+	int numPanels;
+	AlignedArray<int> panelPtr;
+	AlignedArray<int> rowIdx;
+	AlignedArray<int> rowptr;
+	// column minus p * panelWidth for the elements of panel p
+	AlignedArray<I> col;
+	AlignedArray<T> data;
+	// row pointer of the untiled matrix, for nnz-balanced row partitions
+	AlignedArray<int> totalRowptr;
+};
+
+// CSR sparse matrix format with configurable index types
+// I: type of the column indices, e.g. uint16_t for tiles or matrices with at most 65536 columns,
+// which halves the index bytes spMV reads
+// P: type of the row pointer, e.g. int64_t for matrices with more than 2^31 - 1 non-zero elements.
+// the DynSparseCSR constructor is limited to int nnz like its source, such matrices come from
+// buildIndexedCSR (sparsebuild.h), which sums the row lengths in P
+template<typename T, typename I = int, typename P = int>
+class SparseIndexedCSR {
+public:
+	SparseIndexedCSR() : rows(0), cols(0), nnz(0) {}
+
+	// empty matrix with room for nnz elements, to be filled by the caller
+	SparseIndexedCSR(int rows, int cols, P nnz) : rows(rows), cols(cols), nnz(nnz), rowptr(rows + 1), col(nnz), data(nnz) {
+		if (cols > 0 && (unsigned long long) (cols - 1) > (unsigned long long) std::numeric_limits<I>::max()) {
+			throw std::out_of_range("SparseIndexedCSR: column indices do not fit the index type");
+		}
+	}
+
+	explicit SparseIndexedCSR(const DynSparseCSR<T> &csr) : SparseIndexedCSR(csr.rows, csr.cols, (P) csr.nnz) {
+		for (int i = 0; i <= rows; i++) {
+			rowptr[i] = csr.rowptr[i];
+		}
+		for (int j = 0; j < csr.nnz; j++) {
+			col[j] = (I) csr.col[j];
+			data[j] = csr.data[j];
+		}
+	}
+
+	// bytes of index data spMV reads (col, rowptr)
+	size_t indexBytes() const {
+		return (size_t) nnz * sizeof(I) + (size_t) (rows + 1) * sizeof(P);
+	}
+
+	int rows;
+	int cols;
+	P nnz;
+	AlignedArray<P> rowptr;
+	AlignedArray<I> col;
+	AlignedArray<T> data;
+};
+
+// CSR sparse matrix format with delta-compressed column indices
+// the first column of every row is stored in full (as sizeof(int) / sizeof(D) units), every
+// following one as the difference to the previous column in one unit of D (uint8_t or uint16_t).
+// a difference that is negative or does not fit below the escape code ESCAPE is stored as ESCAPE
+// followed by the full difference. rows with sorted, clustered columns (banded, stencil or
+// block-structured matrices) then need about one unit per element instead of four bytes.
+// rowptr[i]: offset of row i in data, deltaPtr[i]: offset of row i in deltas
+template<typename T, typename D = uint8_t>
+class SparseDeltaCSR {
+public:
+	static constexpr D ESCAPE = std::numeric_limits<D>::max();
+	static constexpr int FULL_UNITS = sizeof(int) / sizeof(D);
+
+	SparseDeltaCSR() : rows(0), cols(0), nnz(0), numUnits(0) {}
+
+	explicit SparseDeltaCSR(const DynSparseCSR<T> &csr)
+		: rows(csr.rows), cols(csr.cols), nnz(csr.nnz), numUnits(0), rowptr(csr.rows + 1), deltaPtr(csr.rows + 1), data(csr.nnz) {
+		// size of every row, then the encoding
+		for (int i = 0; i < rows; i++) {
+			deltaPtr[i] = numUnits;
+			for (int j = csr.rowptr[i]; j < csr.rowptr[i + 1]; j++) {
+				numUnits += j == csr.rowptr[i] ? FULL_UNITS : unitsOf(csr.col[j] - csr.col[j - 1]);
+			}
+		}
+		deltaPtr[rows] = numUnits;
+		deltas = AlignedArray<D>(numUnits);
+
+		for (int i = 0; i <= rows; i++) {
+			rowptr[i] = csr.rowptr[i];
+		}
+		for (int i = 0; i < rows; i++) {
+			long p = deltaPtr[i];
+			for (int j = csr.rowptr[i]; j < csr.rowptr[i + 1]; j++) {
+				int delta = j == csr.rowptr[i] ? csr.col[j] : csr.col[j] - csr.col[j - 1];
+				if (j > csr.rowptr[i] && unitsOf(delta) == 1) {
+					deltas[p++] = (D) delta;
+				} else {
+					if (j > csr.rowptr[i]) {
+						deltas[p++] = ESCAPE;
+					}
+					std::memcpy(&deltas[p], &delta, sizeof(int));
+					p += FULL_UNITS;
+				}
+				data[j] = csr.data[j];
+			}
+		}
+	}
+
+	// units needed for a difference between consecutive columns
+	static int unitsOf(int delta) {
+		return delta >= 0 && delta < (int) ESCAPE ? 1 : 1 + FULL_UNITS;
+	}
+
+	// bytes of index data spMV reads (deltas, rowptr, deltaPtr)
+	size_t indexBytes() const {
+		return (size_t) numUnits * sizeof(D) + (size_t) (rows + 1) * (sizeof(int) + sizeof(long));
+	}
+
+	int rows;
+	int cols;
+	int nnz;
+	long numUnits;
+	AlignedArray<int> rowptr;
+	AlignedArray<long> deltaPtr;
+	AlignedArray<D> deltas;
+	AlignedArray<T> data;
+};
+
+// prints the first n elements of a runtime-sized array as "name = [ ... ]"
+template<typename T>
+void printArray(std::ostream &os, const char *name, const AlignedArray<T> &arr, size_t n) {
+	os << name << " = [ ";
+	for (size_t i = 0; i < n; i++) {
+		os << arr[i] << " ";
+	}
+	os << "]\n";
+}
+
+// print runtime-sized matrices using << operator, in the same layout as the fixed-size ones
+template<typename T>
+std::ostream &operator<<(std::ostream &os, const DynSparseCOO<T> &coo) {
+	printArray(os, "data", coo.data, coo.nnz);
+	printArray(os, "row", coo.row, coo.nnz);
+	printArray(os, "col", coo.col, coo.nnz);
+	return os;
+}
+
+template<typename T>
+std::ostream &operator<<(std::ostream &os, const DynSparseCSR<T> &csr) {
+	printArray(os, "data", csr.data, csr.nnz);
+	printArray(os, "col", csr.col, csr.nnz);
+	printArray(os, "rowptr", csr.rowptr, csr.rows + 1);
+	return os;
+}
+
+template<typename T>
+std::ostream &operator<<(std::ostream &os, const DynSparseCSC<T> &csc) {
+	printArray(os, "data", csc.data, csc.nnz);
+	printArray(os, "row", csc.row, csc.nnz);
+	printArray(os, "colptr", csc.colptr, csc.cols + 1);
+	return os;
+}
+
+template<typename T>
+std::ostream &operator<<(std::ostream &os, const DynSparseBSR<T> &bsr) {
+	printArray(os, "data", bsr.data, bsr.data.size());
+	printArray(os, "blockRowptr", bsr.blockRowptr, bsr.blockRowptr.size());
+	printArray(os, "blockCol", bsr.blockCol, bsr.nnzBlocks);
+	return os;
+}
+
+template<typename T>
+std::ostream &operator<<(std::ostream &os, const DynSparseELL<T> &ell) {
+	printArray(os, "data", ell.data, ell.data.size());
+	printArray(os, "col", ell.col, ell.col.size());
+	return os;
+}
+
+template<typename T>
+std::ostream &operator<<(std::ostream &os, const DynSparseTJDS<T> &tjds) {
+	printArray(os, "val", tjds.val, tjds.nnz);
+	printArray(os, "row_index", tjds.row_index, tjds.nnz);
+	printArray(os, "start", tjds.start, tjds.tjTiles + 1);
+	printArray(os, "perm", tjds.perm, tjds.cols);
+	return os;
+}
+
+template<typename T>
+std::ostream &operator<<(std::ostream &os, const DynSparseSSS<T> &sss) {
+	printArray(os, "dvalues", sss.dvalues, sss.n);
+	printArray(os, "values", sss.values, sss.lowerNnz);
+	printArray(os, "col", sss.col, sss.lowerNnz);
+	printArray(os, "rowptr", sss.rowptr, sss.n + 1);
+	return os;
+}
+
+template<typename T, int C>
+std::ostream &operator<<(std::ostream &os, const SparseSELL<T, C> &sell) {
+	printArray(os, "data", sell.data, sell.paddedNnz());
+	printArray(os, "col", sell.col, sell.paddedNnz());
+	printArray(os, "chunkPtr", sell.chunkPtr, sell.numChunks + 1);
+	printArray(os, "chunkLen", sell.chunkLen, sell.numChunks);
+	printArray(os, "rowPerm", sell.rowPerm, sell.rows);
+	return os;
+}
+
+template<typename T>
+std::ostream &operator<<(std::ostream &os, const SparseHYB<T> &hyb) {
+	printArray(os, "data", hyb.data, hyb.paddedEllNnz());
+	printArray(os, "col", hyb.col, hyb.paddedEllNnz());
+	printArray(os, "cooData", hyb.cooData, hyb.cooNnz);
+	printArray(os, "cooRow", hyb.cooRow, hyb.cooNnz);
+	printArray(os, "cooCol", hyb.cooCol, hyb.cooNnz);
+	return os;
+}
+
+template<typename T>
+std::ostream &operator<<(std::ostream &os, const SparseDIA<T> &dia) {
+	printArray(os, "offsets", dia.offsets, dia.numDiags);
+	printArray(os, "data", dia.data, dia.storedNnz());
+	return os;
+}
+
+template<typename T>
+std::ostream &operator<<(std::ostream &os, const SparseTiledCSR<T> &tiled) {
+	int listed = tiled.numPanels > 0 ? tiled.panelPtr[tiled.numPanels] : 0;
+	printArray(os, "panelPtr", tiled.panelPtr, tiled.numPanels + 1);
+	printArray(os, "rowIdx", tiled.rowIdx, listed);
+	printArray(os, "rowptr", tiled.rowptr, listed + 1);
+	printArray(os, "col", tiled.col, tiled.nnz);
+	printArray(os, "data", tiled.data, tiled.nnz);
+	return os;
+}
+
+template<typename T, typename I, typename P>
+std::ostream &operator<<(std::ostream &os, const SparseIndexedCSR<T, I, P> &csr) {
+	printArray(os, "data", csr.data, csr.nnz);
+	printArray(os, "col", csr.col, csr.nnz);
+	printArray(os, "rowptr", csr.rowptr, csr.rows + 1);
+	return os;
+}
+
+template<typename T, typename D>
+std::ostream &operator<<(std::ostream &os, const SparseDeltaCSR<T, D> &csr) {
+	printArray(os, "data", csr.data, csr.nnz);
+	printArray(os, "rowptr", csr.rowptr, csr.rows + 1);
+	printArray(os, "deltaPtr", csr.deltaPtr, csr.rows + 1);
+	// units of uint8_t would print as characters
+	os << "deltas = [ ";
+	for (long u = 0; u < csr.numUnits; u++) {
+		os << (unsigned long) csr.deltas[u] << " ";
+	}
+	os << "]\n";
+	return os;
+}
+
 #endif //SPARSEMATRIX_H
@@ -0,0 +1,469 @@
+// spgemm.h
+#ifndef SPGEMM_H
+#define SPGEMM_H
+
+#include <stdexcept>
+#include <climits>
+#include <vector>
+#include <algorithm>
+#include "sparsematrix.h"
+#include "parallel.h"
+
+// ---sparse-output sparse matrix multiplication (SpGEMM)---
+// C = A * B with a sparse result, so memory is O(nnz(C)) instead of the O(M * N) of the dense-output
+// dataflows in sparsealgs.h. gustavson (row-by-row) dataflow for csr, column-by-column for csc.
+// a symbolic pass counts the non-zero elements of every row of C so that rowptr is sized exactly,
+// then a numeric pass writes values and sorted column indices straight into their final place.
+// every row is accumulated by one of three accumulators, chosen from its flop count
+// (the number of products a(i, k) * b(k, j) the row needs):
+// - dense: value array over all columns + marker array (sparse accumulator, SPA),
+//   for rows that are expected to touch a sizable fraction of the columns
+// - hash: open addressing table sized from the flop count, for medium rows of wide matrices
+// - heap: k-way merge of the selected rows of B, for short rows of A; output comes out sorted
+
+enum SpGEMMAccumulator {
+	SPGEMM_AUTO = 0,
+	SPGEMM_DENSE = 1,
+	SPGEMM_HASH = 2,
+	SPGEMM_HEAP = 3
+};
+
+// rows of A with at most this many elements are merged with a heap
+const int SPGEMM_HEAP_MAX_LISTS = 4;
+// rows with flops * SPGEMM_DENSE_RATIO >= row length of the result use the dense accumulator
+const int SPGEMM_DENSE_RATIO = 4;
+
+// raw operands of a row-by-row product: row i of the result is the sum over k in row i of a
+// of aData[k] times row aIdx[k] of b. width is the row length of the result
+template<typename T>
+struct SpGEMMOperands {
+	int width;
+	const int *aPtr;
+	const int *aIdx;
+	const T *aData;
+	const int *bPtr;
+	const int *bIdx;
+	const T *bData;
+};
+
+// scratch space of the accumulators, reused from row to row (and from product to product)
+template<typename T>
+class SpGEMMWorkspace {
+public:
+	SpGEMMWorkspace() : stamp(0) {}
+
+	// number of products needed by row i
+	static long rowFlops(const SpGEMMOperands<T> &op, int i) {
+		long flops = 0;
+		for (int k = op.aPtr[i]; k < op.aPtr[i + 1]; k++) {
+			flops += op.bPtr[op.aIdx[k] + 1] - op.bPtr[op.aIdx[k]];
+		}
+		return flops;
+	}
+
+	// accumulator used for row i when kind is SPGEMM_AUTO
+	static SpGEMMAccumulator choose(const SpGEMMOperands<T> &op, int i, long flops) {
+		if (flops * SPGEMM_DENSE_RATIO >= op.width) {
+			return SPGEMM_DENSE;
+		}
+		if (op.aPtr[i + 1] - op.aPtr[i] <= SPGEMM_HEAP_MAX_LISTS) {
+			return SPGEMM_HEAP;
+		}
+		return SPGEMM_HASH;
+	}
+
+	// number of distinct columns in row i of the result
+	int symbolicRow(const SpGEMMOperands<T> &op, int i, long flops, SpGEMMAccumulator kind) {
+		return accumulateRow<false>(op, i, flops, kind, nullptr, nullptr);
+	}
+
+	// row i of the result with sorted column indices, writes symbolicRow(...) elements to idx/data
+	int numericRow(const SpGEMMOperands<T> &op, int i, long flops, SpGEMMAccumulator kind, int *idx, T *data) {
+		return accumulateRow<true>(op, i, flops, kind, idx, data);
+	}
+
+private:
+	struct HeapEntry {
+		int col;
+		int pos;
+		int end;
+		T a;
+	};
+
+	template<bool NUMERIC>
+	int accumulateRow(const SpGEMMOperands<T> &op, int i, long flops, SpGEMMAccumulator kind, int *idx, T *data) {
+		if (flops == 0) {
+			return 0;
+		}
+		switch (kind == SPGEMM_AUTO ? choose(op, i, flops) : kind) {
+		case SPGEMM_DENSE:
+			return denseRow<NUMERIC>(op, i, idx, data);
+		case SPGEMM_HEAP:
+			return heapRow<NUMERIC>(op, i, idx, data);
+		default:
+			return hashRow<NUMERIC>(op, i, flops, idx, data);
+		}
+	}
+
+	template<bool NUMERIC>
+	int denseRow(const SpGEMMOperands<T> &op, int i, int *idx, T *data) {
+		if ((int) marker.size() < op.width || stamp == INT_MAX) {
+			marker.assign(std::max((int) marker.size(), op.width), 0);
+			values.resize(marker.size());
+			stamp = 0;
+		}
+		stamp += 1;
+		touched.clear();
+		for (int k = op.aPtr[i]; k < op.aPtr[i + 1]; k++) {
+			int row = op.aIdx[k];
+			for (int j = op.bPtr[row]; j < op.bPtr[row + 1]; j++) {
+				int c = op.bIdx[j];
+				if (marker[c] != stamp) {
+					marker[c] = stamp;
+					touched.push_back(c);
+					if (NUMERIC) {
+						values[c] = op.aData[k] * op.bData[j];
+					}
+				} else if (NUMERIC) {
+					values[c] += op.aData[k] * op.bData[j];
+				}
+			}
+		}
+
+		int count = (int) touched.size();
+		if (NUMERIC) {
+			// a dense scan of the marker array is cheaper than sorting a well filled row
+			if ((long) count * 8 >= op.width) {
+				for (int c = 0, n = 0; n < count; c++) {
+					if (marker[c] == stamp) {
+						idx[n] = c;
+						data[n] = values[c];
+						n += 1;
+					}
+				}
+			} else {
+				std::sort(touched.begin(), touched.end());
+				for (int n = 0; n < count; n++) {
+					idx[n] = touched[n];
+					data[n] = values[touched[n]];
+				}
+			}
+		}
+		return count;
+	}
+
+	template<bool NUMERIC>
+	int hashRow(const SpGEMMOperands<T> &op, int i, long flops, int *idx, T *data) {
+		size_t size = 16;
+		while (size < (size_t) flops * 2) {
+			size *= 2;
+		}
+		const size_t mask = size - 1;
+		if (hashKeys.size() < size) {
+			hashKeys.resize(size);
+			hashValues.resize(size);
+		}
+		std::fill(hashKeys.begin(), hashKeys.begin() + size, -1);
+
+		touched.clear();
+		for (int k = op.aPtr[i]; k < op.aPtr[i + 1]; k++) {
+			int row = op.aIdx[k];
+			for (int j = op.bPtr[row]; j < op.bPtr[row + 1]; j++) {
+				int c = op.bIdx[j];
+				size_t h = ((size_t) c * 2654435761u) & mask;
+				while (hashKeys[h] != -1 && hashKeys[h] != c) {
+					h = (h + 1) & mask;
+				}
+				if (hashKeys[h] == -1) {
+					hashKeys[h] = c;
+					touched.push_back((int) h);
+					if (NUMERIC) {
+						hashValues[h] = op.aData[k] * op.bData[j];
+					}
+				} else if (NUMERIC) {
+					hashValues[h] += op.aData[k] * op.bData[j];
+				}
+			}
+		}
+
+		int count = (int) touched.size();
+		if (NUMERIC) {
+			std::sort(touched.begin(), touched.end(), [&](int s, int t) { return hashKeys[s] < hashKeys[t]; });
+			for (int n = 0; n < count; n++) {
+				idx[n] = hashKeys[touched[n]];
+				data[n] = hashValues[touched[n]];
+			}
+		}
+		return count;
+	}
+
+	template<bool NUMERIC>
+	int heapRow(const SpGEMMOperands<T> &op, int i, int *idx, T *data) {
+		auto later = [](const HeapEntry &x, const HeapEntry &y) { return x.col > y.col; };
+		heap.clear();
+		for (int k = op.aPtr[i]; k < op.aPtr[i + 1]; k++) {
+			int row = op.aIdx[k];
+			if (op.bPtr[row] < op.bPtr[row + 1]) {
+				heap.push_back({ op.bIdx[op.bPtr[row]], op.bPtr[row], op.bPtr[row + 1], op.aData[k] });
+			}
+		}
+		std::make_heap(heap.begin(), heap.end(), later);
+
+		int count = 0;
+		int last = -1;
+		while (!heap.empty()) {
+			std::pop_heap(heap.begin(), heap.end(), later);
+			HeapEntry &e = heap.back();
+			if (e.col != last) {
+				if (NUMERIC) {
+					idx[count] = e.col;
+					data[count] = e.a * op.bData[e.pos];
+				}
+				count += 1;
+				last = e.col;
+			} else if (NUMERIC) {
+				data[count - 1] += e.a * op.bData[e.pos];
+			}
+
+			e.pos += 1;
+			if (e.pos < e.end) {
+				e.col = op.bIdx[e.pos];
+				std::push_heap(heap.begin(), heap.end(), later);
+			} else {
+				heap.pop_back();
+			}
+		}
+		return count;
+	}
+
+	std::vector<int> marker;
+	std::vector<T> values;
+	std::vector<int> touched;
+	int stamp;
+	std::vector<int> hashKeys;
+	std::vector<T> hashValues;
+	std::vector<HeapEntry> heap;
+};
+
+// symbolic + numeric product of numOuter rows into ptr/idx/data (csr, or csc for the column-wise
+// dataflow), returns the number of non-zero elements of the result
+template<typename T>
+int spGEMMCompress(int numOuter, const SpGEMMOperands<T> &op, SpGEMMAccumulator kind,
+		AlignedArray<int> &ptr, AlignedArray<int> &idx, AlignedArray<T> &data) {
+	SpGEMMWorkspace<T> workspace;
+	std::vector<long> flops(numOuter);
+
+	// 1) symbolic pass: exact row sizes
+	ptr = AlignedArray<int>(numOuter + 1);
+	long total = 0;
+	ptr[0] = 0;
+	for (int i = 0; i < numOuter; i++) {
+		flops[i] = SpGEMMWorkspace<T>::rowFlops(op, i);
+		total += workspace.symbolicRow(op, i, flops[i], kind);
+		if (total > INT_MAX) {
+			throw std::runtime_error("spGEMM: result has more than INT_MAX non-zero elements");
+		}
+		ptr[i + 1] = (int) total;
+	}
+
+	// 2) numeric pass
+	idx = AlignedArray<int>(total);
+	data = AlignedArray<T>(total);
+	for (int i = 0; i < numOuter; i++) {
+		workspace.numericRow(op, i, flops[i], kind, idx.get() + ptr[i], data.get() + ptr[i]);
+	}
+	return (int) total;
+}
+
+// sparse-output gustavson product of two runtime-sized csr matrices
+template<typename T>
+DynSparseCSR<T> gustavsonSpGEMM(const DynSparseCSR<T> &a, const DynSparseCSR<T> &b, SpGEMMAccumulator kind = SPGEMM_AUTO) {
+	if (a.cols != b.rows) {
+		throw std::invalid_argument("gustavsonSpGEMM: a.cols != b.rows");
+	}
+	SpGEMMOperands<T> op = { b.cols, a.rowptr.get(), a.col.get(), a.data.get(), b.rowptr.get(), b.col.get(), b.data.get() };
+	DynSparseCSR<T> c;
+	c.rows = a.rows;
+	c.cols = b.cols;
+	c.nnz = spGEMMCompress(a.rows, op, kind, c.rowptr, c.col, c.data);
+	return c;
+}
+
+// sparse-output gustavson product of two fixed-size csr matrices
+template<int M, int K, int N, int NNZ1, int NNZ2, typename T>
+DynSparseCSR<T> gustavsonSpGEMM(const SparseCSR<M, K, NNZ1, T> &a, const SparseCSR<K, N, NNZ2, T> &b,
+		SpGEMMAccumulator kind = SPGEMM_AUTO) {
+	SpGEMMOperands<T> op = { N, a.rowptr, a.col, a.data, b.rowptr, b.col, b.data };
+	DynSparseCSR<T> c;
+	c.rows = M;
+	c.cols = N;
+	c.nnz = spGEMMCompress(M, op, kind, c.rowptr, c.col, c.data);
+	return c;
+}
+
+// sparse-output column-wise product of two runtime-sized csc matrices:
+// column j of C is the sum over k in column j of b of b(k, j) times column k of a
+template<typename T>
+DynSparseCSC<T> columnWiseSpGEMM(const DynSparseCSC<T> &a, const DynSparseCSC<T> &b, SpGEMMAccumulator kind = SPGEMM_AUTO) {
+	if (a.cols != b.rows) {
+		throw std::invalid_argument("columnWiseSpGEMM: a.cols != b.rows");
+	}
+	SpGEMMOperands<T> op = { a.rows, b.colptr.get(), b.row.get(), b.data.get(), a.colptr.get(), a.row.get(), a.data.get() };
+	DynSparseCSC<T> c;
+	c.rows = a.rows;
+	c.cols = b.cols;
+	c.nnz = spGEMMCompress(b.cols, op, kind, c.colptr, c.row, c.data);
+	return c;
+}
+
+// sparse-output column-wise product of two fixed-size csc matrices
+template<int M, int K, int N, int NNZ1, int NNZ2, typename T>
+DynSparseCSC<T> columnWiseSpGEMM(const SparseCSC<M, K, NNZ1, T> &a, const SparseCSC<K, N, NNZ2, T> &b,
+		SpGEMMAccumulator kind = SPGEMM_AUTO) {
+	SpGEMMOperands<T> op = { M, b.colptr, b.row, b.data, a.colptr, a.row, a.data };
+	DynSparseCSC<T> c;
+	c.rows = M;
+	c.cols = N;
+	c.nnz = spGEMMCompress(N, op, kind, c.colptr, c.row, c.data);
+	return c;
+}
+
+// ---multithreaded gustavson product---
+// rows of A are split into contiguous ranges of (almost) equal flops. every thread runs the numeric
+// pass over its rows straight into its own index/value buffers (no symbolic pass is needed since
+// nothing is shared), then the row counts of all threads are stitched into one rowptr with a
+// prefix sum and the buffers are copied to their final place.
+
+// per-thread accumulators and output buffers of parallelGustavsonSpGEMM.
+// they are kept between calls, so repeated products reuse the memory of the previous ones
+// instead of allocating it again
+template<typename T>
+class SpGEMMArena {
+public:
+	struct alignas(SPARSE_ALIGNMENT) ThreadData {
+		SpGEMMWorkspace<T> workspace;
+		std::vector<int> idx;
+		std::vector<T> data;
+		long count = 0;
+	};
+
+	// make room for numThreads threads
+	void reserve(int numThreads) {
+		if ((int) threads.size() < numThreads) {
+			threads.resize(numThreads);
+		}
+	}
+
+	ThreadData &thread(int tid) {
+		return threads[tid];
+	}
+
+	// flops of every row (exclusive prefix sum) and number of elements of every row of the result
+	std::vector<long> flopPrefix;
+	std::vector<int> rowCount;
+
+private:
+	std::vector<ThreadData> threads;
+};
+
+// multithreaded symbolic-free product of numOuter rows into ptr/idx/data,
+// returns the number of non-zero elements of the result
+template<typename T>
+int parallelSpGEMMCompress(int numOuter, const SpGEMMOperands<T> &op, SpGEMMAccumulator kind, ThreadPool &pool,
+		SpGEMMArena<T> &arena, AlignedArray<int> &ptr, AlignedArray<int> &idx, AlignedArray<T> &data) {
+	const int numThreads = pool.size();
+	arena.reserve(numThreads);
+	if ((int) arena.flopPrefix.size() < numOuter + 1) {
+		arena.flopPrefix.resize(numOuter + 1);
+		arena.rowCount.resize(numOuter);
+	}
+	long *flopPrefix = arena.flopPrefix.data();
+	int *rowCount = arena.rowCount.data();
+
+	// 1) flops of every row, prefix sum over equally sized row ranges
+	std::vector<long> partial(numThreads + 1, 0);
+	pool.run([&](int tid) {
+		long begin, end;
+		splitRange(numOuter, numThreads, tid, begin, end);
+		long sum = 0;
+		for (long i = begin; i < end; i++) {
+			flopPrefix[i] = sum;
+			sum += SpGEMMWorkspace<T>::rowFlops(op, (int) i);
+		}
+		partial[tid + 1] = sum;
+	});
+	for (int t = 0; t < numThreads; t++) {
+		partial[t + 1] += partial[t];
+	}
+	pool.run([&](int tid) {
+		long begin, end;
+		splitRange(numOuter, numThreads, tid, begin, end);
+		for (long i = begin; i < end; i++) {
+			flopPrefix[i] += partial[tid];
+		}
+	});
+	flopPrefix[numOuter] = partial[numThreads];
+
+	// 2) numeric pass over flop-balanced row ranges into per-thread buffers
+	pool.run([&](int tid) {
+		typename SpGEMMArena<T>::ThreadData &local = arena.thread(tid);
+		int first = balancedSplit(flopPrefix, numOuter, numThreads, tid);
+		int last = balancedSplit(flopPrefix, numOuter, numThreads, tid + 1);
+		long count = 0;
+		for (int i = first; i < last; i++) {
+			long flops = flopPrefix[i + 1] - flopPrefix[i];
+			// a row never has more elements than flops
+			if ((long) local.idx.size() < count + flops) {
+				local.idx.resize(std::max(count + flops, 2 * (long) local.idx.size()));
+				local.data.resize(local.idx.size());
+			}
+			rowCount[i] = local.workspace.numericRow(op, i, flops, kind, local.idx.data() + count, local.data.data() + count);
+			count += rowCount[i];
+		}
+		local.count = count;
+	});
+
+	// 3) stitch: offsets of the threads, then rowptr and the buffers of every thread
+	std::vector<long> offset(numThreads + 1, 0);
+	for (int t = 0; t < numThreads; t++) {
+		offset[t + 1] = offset[t] + arena.thread(t).count;
+	}
+	if (offset[numThreads] > INT_MAX) {
+		throw std::runtime_error("spGEMM: result has more than INT_MAX non-zero elements");
+	}
+	ptr = AlignedArray<int>(numOuter + 1);
+	idx = AlignedArray<int>(offset[numThreads]);
+	data = AlignedArray<T>(offset[numThreads]);
+	pool.run([&](int tid) {
+		const typename SpGEMMArena<T>::ThreadData &local = arena.thread(tid);
+		int first = balancedSplit(flopPrefix, numOuter, numThreads, tid);
+		int last = balancedSplit(flopPrefix, numOuter, numThreads, tid + 1);
+		int pos = (int) offset[tid];
+		for (int i = first; i < last; i++) {
+			ptr[i] = pos;
+			pos += rowCount[i];
+		}
+		std::copy(local.idx.begin(), local.idx.begin() + local.count, idx.get() + offset[tid]);
+		std::copy(local.data.begin(), local.data.begin() + local.count, data.get() + offset[tid]);
+	});
+	ptr[numOuter] = (int) offset[numThreads];
+	return (int) offset[numThreads];
+}
+
+// multithreaded sparse-output gustavson product of two runtime-sized csr matrices.
+// keep arena alive between calls to reuse its memory
+template<typename T>
+DynSparseCSR<T> parallelGustavsonSpGEMM(const DynSparseCSR<T> &a, const DynSparseCSR<T> &b, ThreadPool &pool,
+		SpGEMMArena<T> &arena, SpGEMMAccumulator kind = SPGEMM_AUTO) {
+	if (a.cols != b.rows) {
+		throw std::invalid_argument("parallelGustavsonSpGEMM: a.cols != b.rows");
+	}
+	SpGEMMOperands<T> op = { b.cols, a.rowptr.get(), a.col.get(), a.data.get(), b.rowptr.get(), b.col.get(), b.data.get() };
+	DynSparseCSR<T> c;
+	c.rows = a.rows;
+	c.cols = b.cols;
+	c.nnz = parallelSpGEMMCompress(a.rows, op, kind, pool, arena, c.rowptr, c.col, c.data);
+	return c;
+}
+
+#endif // SPGEMM_H
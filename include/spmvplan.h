@@ -0,0 +1,304 @@
+// spmvplan.h
+#ifndef SPMVPLAN_H
+#define SPMVPLAN_H
+
+#include <chrono>
+#include <limits>
+#include <memory>
+#include <ostream>
+#include <utility>
+#include <vector>
+#include <algorithm>
+#include "sparsematrix.h"
+#include "sparsealgs.h"
+#include "formatselect.h"
+#include "parallel.h"
+
+// ---inspector-executor spMV for repeated multiplications with the same matrix---
+// a plan is built once per matrix (the inspector) and fixes everything that does not depend on the
+// input vector: the thread partition, the kernel variant, the prefetch distance and the scratch memory
+// of the parallel kernels. spMV(plan, inVector, outVector) (the executor) then runs the chosen kernel
+// with one indirect call per part, without allocating or looking at the structure again.
+// buildSeconds is the cost paid up front, to be amortized over the calls.
+// the plan keeps pointers into the matrix, which has to outlive it; its values may change, its pattern may not
+
+enum PlanKernel {KERNEL_SCALAR, KERNEL_GATHER, KERNEL_PREFETCH, KERNEL_MERGE_PATH, KERNEL_BLOCKED, KERNEL_GENERIC,
+	KERNEL_LOCAL_VECTORS};
+
+inline const char *kernelName(PlanKernel kernel) {
+	static const char *names[] = {"scalar", "gather", "prefetch", "merge-path", "register-blocked", "generic-blocked",
+		"local-vectors"};
+	return names[kernel];
+}
+
+// stored elements per thread below which a plan uses fewer threads, waking a thread costs more
+const long PLAN_MIN_NNZ_PER_THREAD = 1L << 15;
+
+// mean row length from which an untuned csr plan uses the gathered kernel
+const int PLAN_GATHER_MIN_ROW = 16;
+
+// prefetch distances in non-zero elements tried by a tuned csr plan. an untuned plan prefetches
+// at the first one when inVector does not fit in the L2 cache
+const int PLAN_PREFETCH_DISTANCES[] = {32, 8, 128};
+const int PLAN_NUM_PREFETCH_DISTANCES = 3;
+
+// timed calls per candidate kernel when tuning, after one warm-up call
+const int PLAN_TUNE_REPS = 3;
+
+template<typename T>
+class SpMVPlan;
+
+template<typename T>
+void spMV(SpMVPlan<T> &plan, const T *inVector, T *outVector);
+
+template<typename T>
+class SpMVPlan {
+public:
+	// kernel for the rows (csr) or block rows (bsr) [first, last)
+	typedef void (*RangeKernel)(const SpMVPlan &plan, const T *inVector, T *outVector, int first, int last);
+
+	// with tune, the csr row kernels and prefetch distances are timed on this matrix and the fastest
+	// is kept; without, the kernel follows from the mean row length and the size of inVector
+	SpMVPlan(const DynSparseCSR<T> &csr, int numThreads = defaultNumThreads(), bool tune = true) {
+		initCSR(csr.rows, csr.cols, csr.rowptr.get(), csr.col.get(), csr.data.get(), numThreads, tune);
+	}
+
+	template<int ROWS, int COLS, int NNZ>
+	SpMVPlan(const SparseCSR<ROWS, COLS, NNZ, T> &csr, int numThreads = defaultNumThreads(), bool tune = true) {
+		initCSR(ROWS, COLS, csr.rowptr, csr.col, csr.data, numThreads, tune);
+	}
+
+	SpMVPlan(const DynSparseBSR<T> &bsr, int numThreads = defaultNumThreads()) {
+		initBSR(bsr.rows, bsr.cols, bsr.blockSize, bsr.blockRowptr.get(), bsr.blockCol.get(), bsr.data.get(), numThreads);
+	}
+
+	template<int ROWS, int COLS, int BLOCKSIZE, int NNZBLOCKS>
+	SpMVPlan(const SparseBSR<ROWS, COLS, BLOCKSIZE, NNZBLOCKS, T> &bsr, int numThreads = defaultNumThreads()) {
+		initBSR(ROWS, COLS, BLOCKSIZE, bsr.blockRowptr, bsr.blockCol, bsr.data, numThreads);
+	}
+
+	SpMVPlan(const DynSparseSSS<T> &sss, int numThreads = defaultNumThreads()) {
+		initSSS(sss.n, sss.dvalues.get(), sss.rowptr.get(), sss.col.get(), sss.values.get(), numThreads);
+	}
+
+	template<int N, int LOWERNNZ>
+	SpMVPlan(const SparseSSS<N, LOWERNNZ, T> &sss, int numThreads = defaultNumThreads()) {
+		initSSS(N, sss.dvalues, sss.rowptr, sss.col, sss.values, numThreads);
+	}
+
+	SpMVFormat format;
+	PlanKernel kernel;
+	int rows;
+	int cols;
+	int blockSize;			// 1 except for bsr
+	int threads;
+	int prefetchDistance;	// 0 except for KERNEL_PREFETCH
+	double buildSeconds;	// inspection and tuning
+
+	// csr row pointers, bsr block row pointers or sss lower triangle row pointers, with their
+	// column indices and values; diagonal is the sss diagonal
+	const int *rowptr;
+	const int *col;
+	const T *data;
+	const T *diagonal;
+
+	RangeKernel rangeKernel;	// null for KERNEL_MERGE_PATH and KERNEL_LOCAL_VECTORS
+	RowPartition partition;
+	MergePathPartition mergePartition;
+	SSSPartition<T> sssPartition;
+	std::vector<T> carry;		// merge-path carry-outs
+	std::unique_ptr<ThreadPool> pool;
+
+private:
+	static void scalarRows(const SpMVPlan &plan, const T *inVector, T *outVector, int first, int last) {
+		csrSpMVRows(plan.rowptr, plan.col, plan.data, inVector, outVector, first, last);
+	}
+
+	static void gatherRows(const SpMVPlan &plan, const T *inVector, T *outVector, int first, int last) {
+		csrSpMVRowsGather(plan.rowptr, plan.col, plan.data, inVector, outVector, first, last);
+	}
+
+	static void prefetchRows(const SpMVPlan &plan, const T *inVector, T *outVector, int first, int last) {
+		csrSpMVRowsPrefetch(plan.rowptr, plan.col, plan.data, inVector, outVector, first, last, plan.prefetchDistance);
+	}
+
+	template<int BS>
+	static void blockedRows(const SpMVPlan &plan, const T *inVector, T *outVector, int first, int last) {
+		bsrSpMVBlockRows<T, BS>(plan.rows, plan.cols, plan.rowptr, plan.col, plan.data, inVector, outVector, first, last);
+	}
+
+	static void genericRows(const SpMVPlan &plan, const T *inVector, T *outVector, int first, int last) {
+		bsrSpMVGenericBlockRows(plan.rows, plan.cols, plan.blockSize, plan.rowptr, plan.col, plan.data, inVector, outVector,
+			first, last);
+	}
+
+	// threads for a matrix with this many stored elements, at least 1 and at most numThreads
+	static int planThreads(long stored, int numThreads) {
+		return (int) std::max(1L, std::min((long) numThreads, stored / PLAN_MIN_NNZ_PER_THREAD));
+	}
+
+	void setArrays(SpMVFormat format, int rows, int cols, int blockSize, const int *rowptr, const int *col, const T *data,
+			const T *diagonal) {
+		this->format = format;
+		this->rows = rows;
+		this->cols = cols;
+		this->blockSize = blockSize;
+		this->rowptr = rowptr;
+		this->col = col;
+		this->data = data;
+		this->diagonal = diagonal;
+		prefetchDistance = 0;
+		rangeKernel = nullptr;
+	}
+
+	void setCSRKernel(PlanKernel kernel, int distance = 0) {
+		this->kernel = kernel;
+		prefetchDistance = kernel == KERNEL_PREFETCH ? distance : 0;
+		rangeKernel = kernel == KERNEL_GATHER ? gatherRows : kernel == KERNEL_PREFETCH ? prefetchRows : scalarRows;
+	}
+
+	void initCSR(int rows, int cols, const int *rowptr, const int *col, const T *data, int numThreads, bool tune) {
+		auto start = std::chrono::steady_clock::now();
+		setArrays(FORMAT_CSR, rows, cols, 1, rowptr, col, data, nullptr);
+		const long nnz = rowptr[rows];
+		threads = planThreads(nnz, numThreads);
+		pool.reset(new ThreadPool(threads));
+
+		int rowMax = 0;
+		for (int i = 0; i < rows; i++) {
+			rowMax = std::max(rowMax, rowptr[i + 1] - rowptr[i]);
+		}
+		if (threads > 1 && 2L * rowMax * threads > nnz) {
+			// a single row holds more than half the share of a thread, row ranges cannot be balanced
+			kernel = KERNEL_MERGE_PATH;
+			mergePartition = MergePathPartition(rowptr, rows, threads);
+			carry.assign(threads, T(0));
+		} else {
+			partition = RowPartition(rowptr, rows, threads);
+			if (tune) {
+				tuneCSR();
+			} else if (nnz >= (long) PLAN_GATHER_MIN_ROW * rows) {
+				setCSRKernel(KERNEL_GATHER);
+			} else if ((long) cols * (long) sizeof(T) > l2CacheSize()) {
+				setCSRKernel(KERNEL_PREFETCH, PLAN_PREFETCH_DISTANCES[0]);
+			} else {
+				setCSRKernel(KERNEL_SCALAR);
+			}
+		}
+		buildSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// times every csr row kernel (median of PLAN_TUNE_REPS calls) and keeps the fastest
+	void tuneCSR() {
+		std::vector<std::pair<PlanKernel, int>> candidates = {{KERNEL_SCALAR, 0}, {KERNEL_GATHER, 0}};
+		for (int d = 0; d < PLAN_NUM_PREFETCH_DISTANCES; d++) {
+			candidates.push_back({KERNEL_PREFETCH, PLAN_PREFETCH_DISTANCES[d]});
+		}
+		std::vector<T> inVector(cols, T(1));
+		std::vector<T> outVector(rows);
+		std::vector<double> times(PLAN_TUNE_REPS);
+		double bestSeconds = std::numeric_limits<double>::max();
+		std::pair<PlanKernel, int> best = candidates[0];
+		for (const std::pair<PlanKernel, int> &candidate : candidates) {
+			setCSRKernel(candidate.first, candidate.second);
+			spMV(*this, inVector.data(), outVector.data());
+			for (double &t : times) {
+				auto start = std::chrono::steady_clock::now();
+				spMV(*this, inVector.data(), outVector.data());
+				t = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			}
+			std::sort(times.begin(), times.end());
+			if (times[PLAN_TUNE_REPS / 2] < bestSeconds) {
+				bestSeconds = times[PLAN_TUNE_REPS / 2];
+				best = candidate;
+			}
+		}
+		setCSRKernel(best.first, best.second);
+	}
+
+	// block rows are split by their number of blocks, every block size with a register-blocked
+	// kernel uses it, the others the generic loop
+	void initBSR(int rows, int cols, int blockSize, const int *blockRowptr, const int *blockCol, const T *data,
+			int numThreads) {
+		auto start = std::chrono::steady_clock::now();
+		setArrays(FORMAT_BSR, rows, cols, blockSize, blockRowptr, blockCol, data, nullptr);
+		const int blockRows = (rows + blockSize - 1) / blockSize;
+		threads = planThreads((long) blockRowptr[blockRows] * blockSize * blockSize, numThreads);
+		pool.reset(new ThreadPool(threads));
+		partition = RowPartition(blockRowptr, blockRows, threads);
+
+		kernel = KERNEL_BLOCKED;
+		switch (blockSize) {
+		case 1:
+			kernel = KERNEL_SCALAR;
+			rangeKernel = scalarRows;
+			break;
+		case 2:
+			rangeKernel = blockedRows<2>;
+			break;
+		case 3:
+			rangeKernel = blockedRows<3>;
+			break;
+		case 4:
+			rangeKernel = blockedRows<4>;
+			break;
+		case 8:
+			rangeKernel = blockedRows<8>;
+			break;
+		default:
+			kernel = KERNEL_GENERIC;
+			rangeKernel = genericRows;
+		}
+		buildSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// the local vectors of the partition are the scratch memory, one thread runs the same kernel with a single part
+	void initSSS(int n, const T *dvalues, const int *rowptr, const int *col, const T *values, int numThreads) {
+		auto start = std::chrono::steady_clock::now();
+		setArrays(FORMAT_SSS, n, n, 1, rowptr, col, values, dvalues);
+		threads = planThreads(2L * rowptr[n] + n, numThreads);
+		pool.reset(new ThreadPool(threads));
+		kernel = KERNEL_LOCAL_VECTORS;
+		sssPartition = SSSPartition<T>(rowptr, col, n, threads);
+		buildSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+};
+
+// the executor: outVector = A inVector with the kernel and partition of the plan
+template<typename T>
+void spMV(SpMVPlan<T> &plan, const T *inVector, T *outVector) {
+	ThreadPool &pool = *plan.pool;
+	switch (plan.kernel) {
+	case KERNEL_MERGE_PATH:
+		csrMergePathSpMV(plan.rowptr, plan.col, plan.data, plan.rows, inVector, outVector, plan.mergePartition, pool,
+			plan.carry.data());
+		break;
+	case KERNEL_LOCAL_VECTORS:
+		sssParallelSpMV(plan.rows, plan.diagonal, plan.rowptr, plan.col, plan.data, inVector, outVector,
+			plan.sssPartition, pool);
+		break;
+	default:
+		pool.run([&](int tid) {
+			for (int t = tid; t < plan.partition.numParts(); t += pool.size()) {
+				plan.rangeKernel(plan, inVector, outVector, plan.partition.bounds[t], plan.partition.bounds[t + 1]);
+			}
+		});
+	}
+}
+
+template<typename T>
+std::ostream &operator<<(std::ostream &os, const SpMVPlan<T> &plan) {
+	os << formatName(plan.format);
+	if (plan.format == FORMAT_BSR) {
+		os << " " << plan.blockSize << "x" << plan.blockSize;
+	}
+	os << " plan: " << kernelName(plan.kernel) << " kernel";
+	if (plan.kernel == KERNEL_PREFETCH) {
+		os << " (distance " << plan.prefetchDistance << ")";
+	}
+	os << ", " << plan.threads << (plan.threads == 1 ? " thread" : " threads") << ", built in "
+		<< plan.buildSeconds * 1e3 << " ms\n";
+	return os;
+}
+
+#endif // SPMVPLAN_H
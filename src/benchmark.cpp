@@ -0,0 +1,674 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+
+#include "sparsematrix.h"
+#include "sparsealgs.h"
+#include "sparseconvert.h"
+#include "sparsebuild.h"
+#include "spgemm.h"
+#include "randommatrix.h"
+#include "parallel.h"
+
+// benchmark of the runtime-sized formats on generated matrices:
+// spMV over COO/CSR/narrow-index and tiled CSR/BSR/ELL/SELL/HYB/DIA/TJDS/SSS (serial and, where a parallel kernel exists, over 1, 2, 4, ...
+// threads) and the four SpMM dataflows plus the sparse-output SpGEMMs (gustavson with every accumulator,
+// column-wise, and multithreaded gustavson on a fresh and on a reused arena).
+// every result is checked against a reference computed here with plain loops.
+// usage: benchmark [--quick] [--reps N] [--threads N] [--csv PATH] [--json PATH]
+
+// one measured kernel
+struct Result {
+	std::string kernel;		// spMV, parallelSpMV, innerProductSpMM, ...
+	std::string format;
+	std::string structure;
+	int rows;
+	int cols;
+	long nnz;
+	int threads;
+	double seconds;			// median over the repetitions
+	double gflops;
+	double gbps;			// matrix, input and output bytes per run over the median time
+	double bytesPerNnz;		// matrix bytes per non-zero element, padding and indices included
+	double speedup;			// over the serial spMV of the same format, 1 for the rest
+	double error;			// largest difference to the reference, relative to its largest magnitude
+	bool correct;
+};
+
+struct Options {
+	bool quick = false;
+	int reps = 10;
+	int maxThreads = defaultNumThreads();
+	std::string csvPath;
+	std::string jsonPath;
+};
+
+// row sorting window of SELL, a few chunks, so that rows are only reordered locally
+const int SELL_SIGMA = 256;
+
+// relative error tolerance of the checks, well above the rounding differences of reordered sums
+const double TOLERANCE = 1e-10;
+
+// median of reps timed calls of run, each preceded by an untimed call of prepare; one untimed warm-up run
+template<typename P, typename F>
+double medianTime(int reps, P prepare, F run) {
+	prepare();
+	run();
+	std::vector<double> times(reps);
+	for (int r = 0; r < reps; r++) {
+		prepare();
+		auto start = std::chrono::steady_clock::now();
+		run();
+		times[r] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+	std::sort(times.begin(), times.end());
+	return reps % 2 == 1 ? times[reps / 2] : (times[reps / 2 - 1] + times[reps / 2]) / 2;
+}
+
+template<typename F>
+double medianTime(int reps, F run) {
+	return medianTime(reps, [] {}, run);
+}
+
+// largest |result - reference| relative to the largest |reference|
+double relativeError(const double *result, const std::vector<double> &reference) {
+	double diff = 0;
+	double scale = 0;
+	for (size_t i = 0; i < reference.size(); i++) {
+		diff = std::max(diff, std::fabs(result[i] - reference[i]));
+		scale = std::max(scale, std::fabs(reference[i]));
+	}
+	return diff / std::max(scale, 1e-300);
+}
+
+// thread counts 1, 2, 4, ... up to maxThreads (always included)
+std::vector<int> threadCounts(int maxThreads) {
+	std::vector<int> counts;
+	for (int t = 1; t < maxThreads; t *= 2) {
+		counts.push_back(t);
+	}
+	counts.push_back(std::max(1, maxThreads));
+	return counts;
+}
+
+// bytes of the stored arrays of every format
+size_t matrixBytes(const DynSparseCOO<double> &coo) {
+	return (size_t) coo.nnz * (sizeof(double) + 2 * sizeof(int));
+}
+
+size_t matrixBytes(const DynSparseCSR<double> &csr) {
+	return (size_t) csr.nnz * (sizeof(double) + sizeof(int)) + ((size_t) csr.rows + 1) * sizeof(int);
+}
+
+size_t matrixBytes(const DynSparseBSR<double> &bsr) {
+	size_t blockRows = (bsr.rows + bsr.blockSize - 1) / bsr.blockSize;
+	return (size_t) bsr.nnzBlocks * bsr.blockSize * bsr.blockSize * sizeof(double)
+		+ (size_t) bsr.nnzBlocks * sizeof(int) + (blockRows + 1) * sizeof(int);
+}
+
+size_t matrixBytes(const DynSparseELL<double> &ell) {
+	return (size_t) ell.rows * ell.maxNnzCols * (sizeof(double) + sizeof(int));
+}
+
+size_t matrixBytes(const DynSparseTJDS<double> &tjds) {
+	return (size_t) tjds.nnz * (sizeof(double) + sizeof(int)) + ((size_t) tjds.tjTiles + 1) * sizeof(int)
+		+ (size_t) tjds.cols * sizeof(int);
+}
+
+size_t matrixBytes(const DynSparseSSS<double> &sss) {
+	return (size_t) sss.n * sizeof(double) + (size_t) sss.lowerNnz * (sizeof(double) + sizeof(int))
+		+ ((size_t) sss.n + 1) * sizeof(int);
+}
+
+size_t matrixBytes(const DynSparseCSC<double> &csc) {
+	return (size_t) csc.nnz * (sizeof(double) + sizeof(int)) + ((size_t) csc.cols + 1) * sizeof(int);
+}
+
+template<typename I>
+size_t matrixBytes(const SparseTiledCSR<double, I> &tiled) {
+	return (size_t) tiled.nnz * sizeof(double) + tiled.indexBytes();
+}
+
+template<typename I, typename P>
+size_t matrixBytes(const SparseIndexedCSR<double, I, P> &csr) {
+	return (size_t) csr.nnz * sizeof(double) + csr.indexBytes();
+}
+
+template<typename D>
+size_t matrixBytes(const SparseDeltaCSR<double, D> &csr) {
+	return (size_t) csr.nnz * sizeof(double) + csr.indexBytes();
+}
+
+template<int C>
+size_t matrixBytes(const SparseSELL<double, C> &sell) {
+	return sell.paddedNnz() * (sizeof(double) + sizeof(int)) + (size_t) sell.rows * sizeof(int)
+		+ ((size_t) sell.numChunks + 1) * sizeof(long) + (size_t) sell.numChunks * sizeof(int);
+}
+
+size_t matrixBytes(const SparseHYB<double> &hyb) {
+	return hyb.paddedEllNnz() * (sizeof(double) + sizeof(int)) + (size_t) hyb.cooNnz * (sizeof(double) + 2 * sizeof(int));
+}
+
+size_t matrixBytes(const SparseDIA<double> &dia) {
+	return dia.storedNnz() * sizeof(double) + (size_t) dia.numDiags * sizeof(int);
+}
+
+// stencil pattern: numDiags full diagonals of a 2D grid of side m = sqrt(n), at offsets
+// 0, 1, -1, m, -m, 2, -2, 2m, -2m, ... (5 diagonals give the 5-point stencil)
+DynSparseCSR<double> stencilCSR(int n, int numDiags, uint64_t seed) {
+	const int m = std::max(1, (int) std::sqrt((double) n));
+	std::vector<int> offsets = {0};
+	for (int d = 1; (int) offsets.size() < numDiags && d < n; d++) {
+		for (int o : {d, -d, d * m, -d * m}) {
+			if ((int) offsets.size() < numDiags && std::abs(o) < n && std::find(offsets.begin(), offsets.end(), o) == offsets.end()) {
+				offsets.push_back(o);
+			}
+		}
+	}
+	std::sort(offsets.begin(), offsets.end());
+	return generateCSR<double>(n, n, seed,
+		[&](Xoshiro256 &, int i) {
+			int len = 0;
+			for (int o : offsets) {
+				len += i + o >= 0 && i + o < n;
+			}
+			return len;
+		},
+		[&](Xoshiro256 &gen, int i, int, int *col, double *data) {
+			int j = 0;
+			for (int o : offsets) {
+				if (i + o >= 0 && i + o < n) {
+					col[j] = i + o;
+					data[j++] = 1 + 8 * gen.uniform();
+				}
+			}
+		}, defaultNumThreads());
+}
+
+// a generated test matrix
+struct MatrixCase {
+	std::string structure;
+	DynSparseCSR<double> csr;
+	bool symmetric;
+};
+
+MatrixCase makeCase(const std::string &structure, int n, int nnzPerRow, uint64_t seed) {
+	MatrixCase mc;
+	mc.structure = structure;
+	mc.symmetric = false;
+	if (structure == "uniform") {
+		mc.csr = randomUniformCSR<double>(n, n, nnzPerRow, seed);
+	} else if (structure == "wide") {
+		// 8 columns per row, so the input vector outgrows the L2 cache long before the matrix is large
+		mc.csr = randomUniformCSR<double>(n, 8 * n, nnzPerRow, seed);
+	} else if (structure == "banded") {
+		mc.csr = randomBandedCSR<double>(n, n, 2 * nnzPerRow, nnzPerRow, seed);
+	} else if (structure == "block") {
+		mc.csr = randomBlockCSR<double>(n, n, 4, std::max(1, nnzPerRow / 4), seed);
+	} else if (structure == "stencil") {
+		mc.csr = stencilCSR(n, nnzPerRow, seed);
+	} else if (structure == "powerlaw") {
+		int scale = 0;
+		while ((1 << (scale + 1)) <= n) {
+			scale++;
+		}
+		mc.csr = randomRMATCSR<double>(scale, nnzPerRow, seed);
+	} else {
+		mc.csr = randomSymmetricCSR<double>(n, nnzPerRow, seed);
+		mc.symmetric = true;
+	}
+	return mc;
+}
+
+// outVector = csr * inVector with plain loops, accumulated in long double
+std::vector<double> referenceSpMV(const DynSparseCSR<double> &csr, const std::vector<double> &inVector) {
+	std::vector<double> out(csr.rows);
+	for (int i = 0; i < csr.rows; i++) {
+		long double sum = 0;
+		for (int j = csr.rowptr[i]; j < csr.rowptr[i + 1]; j++) {
+			sum += (long double) csr.data[j] * inVector[csr.col[j]];
+		}
+		out[i] = (double) sum;
+	}
+	return out;
+}
+
+// row-major dense a * b with plain loops
+std::vector<double> referenceSpMM(const DynSparseCSR<double> &a, const DynSparseCSR<double> &b) {
+	std::vector<long double> acc((size_t) a.rows * b.cols, 0);
+	for (int i = 0; i < a.rows; i++) {
+		for (int k = a.rowptr[i]; k < a.rowptr[i + 1]; k++) {
+			for (int j = b.rowptr[a.col[k]]; j < b.rowptr[a.col[k] + 1]; j++) {
+				acc[(size_t) i * b.cols + b.col[j]] += (long double) a.data[k] * b.data[j];
+			}
+		}
+	}
+	return std::vector<double>(acc.begin(), acc.end());
+}
+
+class Benchmark {
+public:
+	explicit Benchmark(const Options &options) : options(options) {}
+
+	void spMVCase(const MatrixCase &mc) {
+		const DynSparseCSR<double> &csr = mc.csr;
+		std::vector<double> inVector(csr.cols);
+		Xoshiro256 gen(7);
+		for (double &x : inVector) {
+			x = gen.uniform() - 0.5;
+		}
+		std::vector<double> reference = referenceSpMV(csr, inVector);
+		std::vector<double> outVector(csr.rows);
+		const double *in = inVector.data();
+		double *out = outVector.data();
+
+		DynSparseCOO<double> coo = csrToCOO(csr);
+		double serial = measureSpMV(mc, "COO", matrixBytes(coo), [&] { spMV(coo, in, out); }, outVector, reference);
+		for (int t : threadCounts(options.maxThreads)) {
+			ThreadPool pool(t);
+			measureSpMV(mc, "COO", matrixBytes(coo), [&] { parallelSpMV(coo, in, out, pool); }, outVector, reference,
+				t, serial);
+		}
+
+		serial = measureSpMV(mc, "CSR", matrixBytes(csr), [&] { spMV(csr, in, out); }, outVector, reference);
+		for (int t : threadCounts(options.maxThreads)) {
+			ThreadPool pool(t);
+			RowPartition partition(csr, t);
+			measureSpMV(mc, "CSR", matrixBytes(csr), [&] { parallelSpMV(csr, in, out, partition, pool); }, outVector,
+				reference, t, serial);
+		}
+
+		// narrower indices: 16-bit columns where they fit, 8-bit column differences everywhere
+		size_t csrIndexBytes = matrixBytes(csr) - (size_t) csr.nnz * sizeof(double);
+		if (csr.cols <= 1 << 16) {
+			SparseIndexedCSR<double, uint16_t> csr16(csr);
+			std::printf("%-9s %-10s index bytes %zu vs %zu for CSR\n", "CSR16", mc.structure.c_str(), csr16.indexBytes(),
+				csrIndexBytes);
+			serial = measureSpMV(mc, "CSR16", matrixBytes(csr16), [&] { spMV(csr16, in, out); }, outVector, reference);
+			for (int t : threadCounts(options.maxThreads)) {
+				ThreadPool pool(t);
+				RowPartition partition(csr16, t);
+				measureSpMV(mc, "CSR16", matrixBytes(csr16), [&] { parallelSpMV(csr16, in, out, partition, pool); },
+					outVector, reference, t, serial);
+			}
+		} else {
+			std::printf("%-9s %-10s skipped: %d columns do not fit 16-bit indices\n", "CSR16", mc.structure.c_str(), csr.cols);
+		}
+		// 64-bit row pointer, built from the row lengths by buildIndexedCSR as a matrix beyond 2^31 - 1
+		// non-zero elements would be
+		SparseIndexedCSR<double, int, int64_t> csr64 = buildIndexedCSR<double, int, int64_t>(csr.rows, csr.cols,
+			[&](int i) { return csr.rowptr[i + 1] - csr.rowptr[i]; },
+			[&](int i, long len, int *col, double *data) {
+				std::copy(csr.col.get() + csr.rowptr[i], csr.col.get() + csr.rowptr[i] + len, col);
+				std::copy(csr.data.get() + csr.rowptr[i], csr.data.get() + csr.rowptr[i] + len, data);
+			});
+		serial = measureSpMV(mc, "CSR64", matrixBytes(csr64), [&] { spMV(csr64, in, out); }, outVector, reference);
+		for (int t : threadCounts(options.maxThreads)) {
+			ThreadPool pool(t);
+			RowPartition partition(csr64, t);
+			measureSpMV(mc, "CSR64", matrixBytes(csr64), [&] { parallelSpMV(csr64, in, out, partition, pool); },
+				outVector, reference, t, serial);
+		}
+
+		SparseDeltaCSR<double> delta(csr);
+		std::printf("%-9s %-10s index bytes %zu vs %zu for CSR\n", "Delta8", mc.structure.c_str(), delta.indexBytes(),
+			csrIndexBytes);
+		serial = measureSpMV(mc, "Delta8", matrixBytes(delta), [&] { spMV(delta, in, out); }, outVector, reference);
+		for (int t : threadCounts(options.maxThreads)) {
+			ThreadPool pool(t);
+			RowPartition partition(delta, t);
+			measureSpMV(mc, "Delta8", matrixBytes(delta), [&] { parallelSpMV(delta, in, out, partition, pool); },
+				outVector, reference, t, serial);
+		}
+
+		// tiling only pays off once the input vector outgrows the half of the L2 cache a panel gets,
+		// the panel width is the automatic one for this machine. with 16-bit panel-relative columns
+		// the panels are at most 65536 columns wide
+		if ((long) csr.cols * (long) sizeof(double) > l2CacheSize() / 2) {
+			SparseTiledCSR<double> tiled(csr);
+			serial = measureSpMV(mc, "Tiled", matrixBytes(tiled), [&] { spMV(tiled, in, out); }, outVector, reference);
+			for (int t : threadCounts(options.maxThreads)) {
+				ThreadPool pool(t);
+				RowPartition partition(tiled, t);
+				measureSpMV(mc, "Tiled", matrixBytes(tiled), [&] { parallelSpMV(tiled, in, out, partition, pool); },
+					outVector, reference, t, serial);
+			}
+			SparseTiledCSR<double, uint16_t> tiled16(csr);
+			std::printf("%-9s %-10s %d panels of %d columns, index bytes %zu vs %zu for CSR\n", "Tiled16",
+				mc.structure.c_str(), tiled16.numPanels, tiled16.panelWidth, tiled16.indexBytes(), csrIndexBytes);
+			serial = measureSpMV(mc, "Tiled16", matrixBytes(tiled16), [&] { spMV(tiled16, in, out); }, outVector,
+				reference);
+			for (int t : threadCounts(options.maxThreads)) {
+				ThreadPool pool(t);
+				RowPartition partition(tiled16, t);
+				measureSpMV(mc, "Tiled16", matrixBytes(tiled16), [&] { parallelSpMV(tiled16, in, out, partition, pool); },
+					outVector, reference, t, serial);
+			}
+		} else {
+			std::printf("%-9s %-10s skipped: input vector of %zu KiB fits the %ld KiB L2 cache\n", "Tiled",
+				mc.structure.c_str(), csr.cols * sizeof(double) >> 10, l2CacheSize() >> 10);
+		}
+
+		DynSparseBSR<double> bsr = csrToBSR(csr, 4);
+		measureSpMV(mc, "BSR4", matrixBytes(bsr), [&] { spMV(bsr, in, out); }, outVector, reference);
+
+		// ELL pads every row to the longest one, skip it where that multiplies the storage
+		int longest = 0;
+		for (int i = 0; i < csr.rows; i++) {
+			longest = std::max(longest, csr.rowptr[i + 1] - csr.rowptr[i]);
+		}
+		if ((long) longest * csr.rows <= 4L * csr.nnz + csr.rows) {
+			DynSparseELL<double> ell = csrToELL(csr);
+			measureSpMV(mc, "ELL", matrixBytes(ell), [&] { spMV(ell, in, out); }, outVector, reference);
+		} else {
+			std::printf("%-9s %-10s skipped: longest row %d vs %.1f on average\n", "ELL", mc.structure.c_str(),
+				longest, (double) csr.nnz / std::max(1, csr.rows));
+		}
+
+		// SELL pads every chunk of rows to its longest row after sorting the rows by length within
+		// windows of SELL_SIGMA rows, skipped where that still multiplies the storage like ELL
+		SparseSELL<double> sell(csr, SELL_SIGMA);
+		if (sell.paddedNnz() <= 4 * (size_t) csr.nnz + csr.rows) {
+			serial = measureSpMV(mc, "SELL", matrixBytes(sell), [&] { spMV(sell, in, out); }, outVector, reference);
+			for (int t : threadCounts(options.maxThreads)) {
+				ThreadPool pool(t);
+				measureSpMV(mc, "SELL", matrixBytes(sell), [&] { parallelSpMV(sell, in, out, pool); }, outVector,
+					reference, t, serial);
+			}
+		} else {
+			std::printf("%-9s %-10s skipped: %zu stored elements for %d non-zero elements\n", "SELL", mc.structure.c_str(),
+				sell.paddedNnz(), csr.nnz);
+		}
+
+		// HYB picks its ELL width from the row lengths, so long rows spill into the COO tail instead of padding
+		SparseHYB<double> hyb(csr);
+		serial = measureSpMV(mc, "HYB", matrixBytes(hyb), [&] { spMV(hyb, in, out); }, outVector, reference);
+		for (int t : threadCounts(options.maxThreads)) {
+			ThreadPool pool(t);
+			measureSpMV(mc, "HYB", matrixBytes(hyb), [&] { parallelSpMV(hyb, in, out, pool); }, outVector, reference,
+				t, serial);
+		}
+
+		// DIA pads every stored diagonal to the full row count, only run it where that moves fewer bytes than csr
+		DIAReport diaReport = analyzeDiagonals(csr);
+		if (diaReport.worthConverting) {
+			SparseDIA<double> dia(csr);
+			serial = measureSpMV(mc, "DIA", matrixBytes(dia), [&] { spMV(dia, in, out); }, outVector, reference);
+			for (int t : threadCounts(options.maxThreads)) {
+				ThreadPool pool(t);
+				measureSpMV(mc, "DIA", matrixBytes(dia), [&] { parallelSpMV(dia, in, out, pool); }, outVector,
+					reference, t, serial);
+			}
+		} else {
+			std::printf("%-9s %-10s skipped: %d diagonals, fill %.1f\n", "DIA", mc.structure.c_str(), diaReport.numDiags,
+				diaReport.fill);
+		}
+
+		DynSparseTJDS<double> tjds = csrToTJDS(csr);
+		serial = measureSpMV(mc, "TJDS", matrixBytes(tjds), [&] { spMV(tjds, in, out); }, outVector, reference);
+		for (int t : threadCounts(options.maxThreads)) {
+			ThreadPool pool(t);
+			TJDSPartition<double> partition(tjds, t);
+			measureSpMV(mc, "TJDS", matrixBytes(tjds), [&] { parallelSpMV(tjds, in, out, partition, pool); }, outVector,
+				reference, t, serial);
+		}
+
+		if (mc.symmetric) {
+			DynSparseSSS<double> sss = csrToSSS(csr);
+			serial = measureSpMV(mc, "SSS", matrixBytes(sss), [&] { spMV(sss, in, out); }, outVector, reference);
+			for (int t : threadCounts(options.maxThreads)) {
+				ThreadPool pool(t);
+				SSSPartition<double> partition(sss, t);
+				measureSpMV(mc, "SSS", matrixBytes(sss), [&] { parallelSpMV(sss, in, out, partition, pool); },
+					outVector, reference, t, serial);
+			}
+		}
+	}
+
+	void spMMCase(const MatrixCase &mc) {
+		const DynSparseCSR<double> &a = mc.csr;
+		DynSparseCSC<double> aCSC = csrToCSC(a);
+		const int n = a.rows;
+		std::vector<double> reference = referenceSpMM(a, a);
+		std::vector<double> dense((size_t) n * n);
+		auto clear = [&] { std::fill(dense.begin(), dense.end(), 0.0); };
+
+		// multiplications of the product: sum over k of nnz(column k of a) * nnz(row k of a)
+		double flops = 0;
+		for (int k = 0; k < n; k++) {
+			flops += 2.0 * (aCSC.colptr[k + 1] - aCSC.colptr[k]) * (a.rowptr[k + 1] - a.rowptr[k]);
+		}
+		// the inner product writes every entry of the dense result, the other dataflows only
+		// accumulate into its non-zero entries (the clearing between runs is not timed)
+		size_t denseBytes = dense.size() * sizeof(double);
+		size_t productBytes = (size_t) (reference.size() - std::count(reference.begin(), reference.end(), 0.0)) * sizeof(double);
+
+		measureSpMM(mc, "innerProductSpMM", "CSRxCSC", matrixBytes(a) + matrixBytes(aCSC) + denseBytes, flops,
+			clear, [&] { innerProductSpMM(a, aCSC, dense.data()); }, dense, reference);
+		measureSpMM(mc, "outerProductSpMM", "CSCxCSR", matrixBytes(aCSC) + matrixBytes(a) + productBytes, flops,
+			clear, [&] { outerProductSpMM(aCSC, a, dense.data()); }, dense, reference);
+		measureSpMM(mc, "gustavsonProductSpMM", "CSRxCSR", 2 * matrixBytes(a) + productBytes, flops,
+			clear, [&] { gustavsonProductSpMM(a, a, dense.data()); }, dense, reference);
+		measureSpMM(mc, "columnWiseProductSpMM", "CSCxCSC", 2 * matrixBytes(aCSC) + productBytes, flops,
+			clear, [&] { columnWiseProductSpMM(aCSC, aCSC, dense.data()); }, dense, reference);
+
+		// sparse output, checked by expanding it into the dense array
+		auto csrError = [&](const DynSparseCSR<double> &product) {
+			clear();
+			for (int i = 0; i < product.rows; i++) {
+				for (int j = product.rowptr[i]; j < product.rowptr[i + 1]; j++) {
+					dense[(size_t) i * n + product.col[j]] = product.data[j];
+				}
+			}
+			return relativeError(dense.data(), reference);
+		};
+		const double bytesPerNnz = (double) matrixBytes(a) / std::max(1, a.nnz);
+		DynSparseCSR<double> product;
+		const double serial = medianTime(options.reps, [&] { product = gustavsonSpGEMM(a, a); });
+		record(mc, "gustavsonSpGEMM", "CSRxCSR", 1, serial, flops, 2 * matrixBytes(a) + matrixBytes(product),
+			bytesPerNnz, 1, csrError(product));
+
+		// every accumulator forced on all rows instead of the per-row choice
+		const SpGEMMAccumulator kinds[] = {SPGEMM_DENSE, SPGEMM_HASH, SPGEMM_HEAP};
+		const char *kindNames[] = {"gustavsonSpGEMM-dense", "gustavsonSpGEMM-hash", "gustavsonSpGEMM-heap"};
+		for (int k = 0; k < 3; k++) {
+			double seconds = medianTime(options.reps, [&] { product = gustavsonSpGEMM(a, a, kinds[k]); });
+			record(mc, kindNames[k], "CSRxCSR", 1, seconds, flops, 2 * matrixBytes(a) + matrixBytes(product),
+				bytesPerNnz, serial / seconds, csrError(product));
+		}
+
+		DynSparseCSC<double> cscProduct;
+		double seconds = medianTime(options.reps, [&] { cscProduct = columnWiseSpGEMM(aCSC, aCSC); });
+		clear();
+		for (int j = 0; j < cscProduct.cols; j++) {
+			for (int k = cscProduct.colptr[j]; k < cscProduct.colptr[j + 1]; k++) {
+				dense[(size_t) cscProduct.row[k] * n + j] = cscProduct.data[k];
+			}
+		}
+		record(mc, "columnWiseSpGEMM", "CSCxCSC", 1, seconds, flops, 2 * matrixBytes(aCSC) + matrixBytes(cscProduct),
+			bytesPerNnz, serial / seconds, relativeError(dense.data(), reference));
+
+		// the first product on a fresh arena allocates the per-thread buffers, the following ones
+		// reuse them; speedup is over the serial gustavsonSpGEMM
+		for (int t : threadCounts(options.maxThreads)) {
+			ThreadPool pool(t);
+			SpGEMMArena<double> arena;
+			auto start = std::chrono::steady_clock::now();
+			product = parallelGustavsonSpGEMM(a, a, pool, arena);
+			seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			record(mc, "parallelSpGEMM-fresh", "CSRxCSR", t, seconds, flops, 2 * matrixBytes(a) + matrixBytes(product),
+				bytesPerNnz, serial / seconds, csrError(product));
+			seconds = medianTime(options.reps, [&] { product = parallelGustavsonSpGEMM(a, a, pool, arena); });
+			record(mc, "parallelSpGEMM-reused", "CSRxCSR", t, seconds, flops, 2 * matrixBytes(a) + matrixBytes(product),
+				bytesPerNnz, serial / seconds, csrError(product));
+		}
+	}
+
+	const std::vector<Result> &results() const {
+		return all;
+	}
+
+	bool allCorrect() const {
+		for (const Result &r : all) {
+			if (!r.correct) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+private:
+	// serial spMV when threads == 0, a parallel kernel otherwise; returns the median time
+	template<typename F>
+	double measureSpMV(const MatrixCase &mc, const char *format, size_t bytes, F run, std::vector<double> &outVector,
+			const std::vector<double> &reference, int threads = 0, double serial = 0) {
+		std::fill(outVector.begin(), outVector.end(), 0.0);
+		double seconds = medianTime(options.reps, run);
+		const DynSparseCSR<double> &csr = mc.csr;
+		size_t vectors = ((size_t) csr.rows + csr.cols) * sizeof(double);
+		record(mc, threads == 0 ? "spMV" : "parallelSpMV", format, std::max(1, threads), seconds, 2.0 * csr.nnz,
+			bytes + vectors, (double) bytes / std::max(1, csr.nnz), threads == 0 ? 1 : serial / seconds,
+			relativeError(outVector.data(), reference));
+		return seconds;
+	}
+
+	template<typename P, typename F>
+	void measureSpMM(const MatrixCase &mc, const char *kernel, const char *format, size_t bytes, double flops,
+			P prepare, F run, std::vector<double> &dense, const std::vector<double> &reference) {
+		double seconds = medianTime(options.reps, prepare, run);
+		record(mc, kernel, format, 1, seconds, flops, bytes, (double) matrixBytes(mc.csr) / std::max(1, mc.csr.nnz), 1,
+			relativeError(dense.data(), reference));
+	}
+
+	void record(const MatrixCase &mc, const char *kernel, const char *format, int threads, double seconds, double flops,
+			size_t bytes, double bytesPerNnz, double speedup, double error) {
+		Result r;
+		r.kernel = kernel;
+		r.format = format;
+		r.structure = mc.structure;
+		r.rows = mc.csr.rows;
+		r.cols = mc.csr.cols;
+		r.nnz = mc.csr.nnz;
+		r.threads = threads;
+		r.seconds = seconds;
+		r.gflops = flops / seconds * 1e-9;
+		r.gbps = bytes / seconds * 1e-9;
+		r.bytesPerNnz = bytesPerNnz;
+		r.speedup = speedup;
+		r.error = error;
+		r.correct = error <= TOLERANCE;
+		all.push_back(r);
+		std::printf("%-22s %-8s %-10s %8d %10ld %3d %10.4f ms %7.2f GFLOP/s %7.2f GB/s %6.2f B/nnz %5.2fx %s\n",
+			r.kernel.c_str(), r.format.c_str(), r.structure.c_str(), r.rows, r.nnz, r.threads, r.seconds * 1e3,
+			r.gflops, r.gbps, r.bytesPerNnz, r.speedup, r.correct ? "ok" : "WRONG");
+	}
+
+	Options options;
+	std::vector<Result> all;
+};
+
+void writeCSV(const std::string &path, const std::vector<Result> &results) {
+	std::ofstream file(path);
+	if (!file) {
+		throw std::runtime_error("cannot write " + path);
+	}
+	file << "kernel,format,structure,rows,cols,nnz,threads,seconds,gflops,gbps,bytes_per_nnz,speedup,error,correct\n";
+	for (const Result &r : results) {
+		file << r.kernel << ',' << r.format << ',' << r.structure << ',' << r.rows << ',' << r.cols << ',' << r.nnz
+			<< ',' << r.threads << ',' << r.seconds << ',' << r.gflops << ',' << r.gbps << ',' << r.bytesPerNnz << ','
+			<< r.speedup << ',' << r.error << ',' << (r.correct ? 1 : 0) << '\n';
+	}
+}
+
+void writeJSON(const std::string &path, const std::vector<Result> &results, const Options &options) {
+	std::ofstream file(path);
+	if (!file) {
+		throw std::runtime_error("cannot write " + path);
+	}
+	file << "{\n  \"hardware_threads\": " << defaultNumThreads() << ",\n  \"l2_cache_bytes\": " << l2CacheSize()
+		<< ",\n  \"reps\": " << options.reps << ",\n  \"results\": [\n";
+	for (size_t k = 0; k < results.size(); k++) {
+		const Result &r = results[k];
+		file << "    {\"kernel\": \"" << r.kernel << "\", \"format\": \"" << r.format << "\", \"structure\": \""
+			<< r.structure << "\", \"rows\": " << r.rows << ", \"cols\": " << r.cols << ", \"nnz\": " << r.nnz
+			<< ", \"threads\": " << r.threads << ", \"seconds\": " << r.seconds << ", \"gflops\": " << r.gflops
+			<< ", \"gbps\": " << r.gbps << ", \"bytes_per_nnz\": " << r.bytesPerNnz << ", \"speedup\": " << r.speedup
+			<< ", \"error\": " << r.error << ", \"correct\": " << (r.correct ? "true" : "false") << "}"
+			<< (k + 1 < results.size() ? "," : "") << "\n";
+	}
+	file << "  ]\n}\n";
+}
+
+int main(int argc, char **argv) {
+	Options options;
+	for (int k = 1; k < argc; k++) {
+		std::string arg = argv[k];
+		bool hasValue = k + 1 < argc;
+		if (arg == "--quick") {
+			options.quick = true;
+			options.reps = 3;
+		} else if (arg == "--reps" && hasValue) {
+			options.reps = std::max(1, std::atoi(argv[++k]));
+		} else if (arg == "--threads" && hasValue) {
+			options.maxThreads = std::max(1, std::atoi(argv[++k]));
+		} else if (arg == "--csv" && hasValue) {
+			options.csvPath = argv[++k];
+		} else if (arg == "--json" && hasValue) {
+			options.jsonPath = argv[++k];
+		} else {
+			std::cout << "usage: " << argv[0] << " [--quick] [--reps N] [--threads N] [--csv PATH] [--json PATH]\n";
+			return arg == "--help" ? 0 : 1;
+		}
+	}
+
+	const std::vector<std::string> structures = {"uniform", "wide", "banded", "block", "stencil", "powerlaw", "symmetric"};
+	const std::vector<int> sizes = options.quick ? std::vector<int>{1 << 12, 1 << 15} : std::vector<int>{1 << 14, 1 << 17, 1 << 20};
+	const std::vector<int> densities = options.quick ? std::vector<int>{4, 16} : std::vector<int>{4, 16, 64};
+	// largest matrix, so that all formats of it fit in memory at once
+	const long maxNnz = 1L << 25;
+	Benchmark benchmark(options);
+	uint64_t seed = 1;
+
+	std::cout << "kernel                 format   structure      rows        nnz thr      median      throughput      bandwidth"
+		"      storage speedup check\n";
+	std::cout << "======spMV======\n";
+	for (int n : sizes) {
+		for (int density : densities) {
+			if ((long) n * density > maxNnz) {
+				continue;
+			}
+			for (const std::string &structure : structures) {
+				benchmark.spMVCase(makeCase(structure, n, density, seed++));
+			}
+		}
+	}
+
+	// the inner product visits every entry of the dense result, so the SpMM matrices stay small
+	std::cout << "======SpMM======\n";
+	const int spMMSize = options.quick ? 512 : 2048;
+	const std::vector<std::string> spMMStructures = {"uniform", "banded", "powerlaw"};
+	for (int density : densities) {
+		for (const std::string &structure : spMMStructures) {
+			benchmark.spMMCase(makeCase(structure, spMMSize, density, seed++));
+		}
+	}
+
+	if (!options.csvPath.empty()) {
+		writeCSV(options.csvPath, benchmark.results());
+	}
+	if (!options.jsonPath.empty()) {
+		writeJSON(options.jsonPath, benchmark.results(), options);
+	}
+	if (!benchmark.allCorrect()) {
+		std::cout << "some results differ from the reference\n";
+		return 1;
+	}
+	return 0;
+}
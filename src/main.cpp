@@ -1,9 +1,21 @@
 #include <iostream>
 #include <cstdlib>
+#include <cstdio>
+#include <cmath>
+#include <chrono>
+#include <vector>
+#include <numeric>
 
 #include "sparsematrix.h"
 #include "sparsealgs.h"
+#include "sparsebuild.h"
+#include "spgemm.h"
+#include "reorder.h"
 #include "randommatrix.h"
+#include "spmvplan.h"
+#include "formatselect.h"
+#include "binarymatrix.h"
+#include "solver.h"
 
 // prints the contents of a 2D array with M rows and N columns
 template<int M, int N, typename T>
@@ -25,6 +37,310 @@ void print1Darray(T arr[M]) {
 	std::cout << '\n';
 }
 
+// times parallelSpMV and mergePathSpMV on a runtime-sized, power-law csr matrix
+// for 1, 2, 4, ... threads up to all hardware threads
+void reportCSRScaling() {
+	const int rows = 200000;
+	const int nnz = 2000000;
+	std::vector<int> row(nnz), col(nnz);
+	std::vector<double> val(nnz);
+	for (int k = 0; k < nnz; k++) {
+		// cubing a uniform number piles most non-zero elements into the first rows
+		double u = (double) rand() / (RAND_MAX + 1.0);
+		row[k] = (int) (rows * u * u * u);
+		col[k] = (int) (rows * ((double) rand() / (RAND_MAX + 1.0)));
+		val[k] = 1 + static_cast <float> (rand()) / (static_cast <float> (RAND_MAX / (8)));
+	}
+	DynSparseCSR<double> csr = buildCSR(rows, rows, nnz, row.data(), col.data(), val.data());
+	std::vector<double> vecIn(rows, 1.0), vecOut(rows);
+
+	const int reps = 20;
+	double serialTime = 0;
+	int maxThreads = defaultNumThreads();
+	std::cout << "rows = " << rows << ", nnz = " << csr.nnz << ", longest row = ";
+	int longest = 0;
+	for (int i = 0; i < rows; i++) {
+		longest = std::max(longest, csr.rowptr[i + 1] - csr.rowptr[i]);
+	}
+	std::cout << longest << "\n";
+	for (int threads = 1; ; threads = std::min(2 * threads, maxThreads)) {
+		ThreadPool pool(threads);
+		RowPartition partition(csr, threads);
+		MergePathPartition mergePartition(csr, threads);
+		parallelSpMV(csr, vecIn.data(), vecOut.data(), partition, pool);
+
+		auto start = std::chrono::steady_clock::now();
+		for (int r = 0; r < reps; r++) {
+			parallelSpMV(csr, vecIn.data(), vecOut.data(), partition, pool);
+		}
+		double time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / reps;
+		start = std::chrono::steady_clock::now();
+		for (int r = 0; r < reps; r++) {
+			mergePathSpMV(csr, vecIn.data(), vecOut.data(), mergePartition, pool);
+		}
+		double mergeTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / reps;
+		if (threads == 1) {
+			serialTime = time;
+		}
+		std::cout << threads << " threads: " << time * 1e3 << " ms, speedup " << serialTime / time
+			<< " | merge-path: " << mergeTime * 1e3 << " ms, speedup " << serialTime / mergeTime << "\n";
+		if (threads == maxThreads) {
+			break;
+		}
+	}
+}
+
+// builds an spMV plan for a generated power-law csr matrix and compares its calls with plain spMV,
+// the build time is repaid after build / (plain - planned) calls
+void reportPlanAmortization() {
+	DynSparseCSR<double> csr = randomRMATCSR<double>(18, 16, 42);
+	std::vector<double> vecIn(csr.cols, 1.0), vecOut(csr.rows);
+	SpMVPlan<double> plan(csr);
+	std::cout << "rows = " << csr.rows << ", nnz = " << csr.nnz << "\n" << plan;
+
+	const int reps = 20;
+	auto start = std::chrono::steady_clock::now();
+	for (int r = 0; r < reps; r++) {
+		spMV(csr, vecIn.data(), vecOut.data());
+	}
+	double plainTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / reps;
+	start = std::chrono::steady_clock::now();
+	for (int r = 0; r < reps; r++) {
+		spMV(plan, vecIn.data(), vecOut.data());
+	}
+	double planTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / reps;
+	std::cout << "spMV: " << plainTime * 1e3 << " ms, planned spMV: " << planTime * 1e3 << " ms";
+	if (planTime < plainTime) {
+		std::cout << ", build repaid after " << (long) std::ceil(plan.buildSeconds / (plainTime - planTime)) << " calls";
+	}
+	std::cout << "\n";
+}
+
+// prints a format choice as "BSR 4x4, 1 thread(s)"
+void printChoice(const FormatChoice &choice) {
+	std::cout << formatName(choice.format);
+	if (choice.format == FORMAT_BSR) {
+		std::cout << " " << choice.blockSize << "x" << choice.blockSize;
+	}
+	std::cout << ", " << choice.threads << " thread(s)";
+}
+
+// selects the spMV format of a generated banded matrix and stores the choice in a cache file, then
+// selects again through a cache read back from that file, which converts without timing anything
+void reportFormatSelection() {
+	DynSparseCSR<double> csr = randomBandedCSR<double>(1 << 16, 1 << 16, 32, 16, 7);
+	std::cout << analyzeMatrix(csr);
+	const char *path = "formatcache.txt";
+	std::remove(path);
+
+	auto start = std::chrono::steady_clock::now();
+	FormatCache cache(path);
+	SelectedMatrix<double> selected = selectFormat(csr, &cache);
+	double selectTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::cout << "selected ";
+	printChoice(selected.choice);
+	std::cout << " (" << selected.choice.seconds * 1e3 << " ms per spMV) in " << selectTime * 1e3 << " ms\n";
+
+	start = std::chrono::steady_clock::now();
+	FormatCache reloaded(path);
+	SelectedMatrix<double> cached = selectFormat(csr, &reloaded);
+	double cachedTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::cout << "reselected from " << path << ": ";
+	printChoice(cached.choice);
+	std::cout << " in " << cachedTime * 1e3 << " ms\n";
+
+	// both selections against plain csr spMV
+	std::vector<double> vecIn(csr.cols), expected(csr.rows), vecOut(csr.rows);
+	for (int j = 0; j < csr.cols; j++) {
+		vecIn[j] = (double) rand() / RAND_MAX;
+	}
+	spMV(csr, vecIn.data(), expected.data());
+	double diff = 0;
+	for (SelectedMatrix<double> *m : {&selected, &cached}) {
+		spMV(*m, vecIn.data(), vecOut.data());
+		for (int i = 0; i < csr.rows; i++) {
+			diff = std::max(diff, std::fabs(vecOut[i] - expected[i]));
+		}
+	}
+	std::cout << "largest difference to csr spMV = " << diff << "\n";
+	std::remove(path);
+}
+
+// saves a generated matrix as binary csr, csc and bsr files, maps them back with index checking and
+// compares their spMV with the in-memory csr one; a file with a corrupted column index is refused
+void reportBinaryRoundTrip() {
+	DynSparseCSR<double> csr = randomUniformCSR<double>(20000, 20000, 8, 11);
+	std::vector<double> vecIn(csr.cols), expected(csr.rows), vecOut(csr.rows);
+	for (int j = 0; j < csr.cols; j++) {
+		vecIn[j] = (double) rand() / RAND_MAX;
+	}
+	spMV(csr, vecIn.data(), expected.data());
+	auto difference = [&] {
+		double diff = 0;
+		for (int i = 0; i < csr.rows; i++) {
+			diff = std::max(diff, std::fabs(vecOut[i] - expected[i]));
+		}
+		return diff;
+	};
+
+	const char *csrPath = "matrix.csr.bin";
+	const char *cscPath = "matrix.csc.bin";
+	const char *bsrPath = "matrix.bsr.bin";
+	saveBinaryMatrix(csrPath, csr);
+	saveBinaryMatrix(cscPath, csrToCSC(csr));
+	saveBinaryMatrix(bsrPath, csrToBSR(csr, 4));
+	{
+		MappedSparseCSR<double> mappedCsr(csrPath, false, true);
+		spMV(mappedCsr, vecIn.data(), vecOut.data());
+		std::cout << "mapped csr: largest difference = " << difference() << "\n";
+		MappedSparseCSC<double> mappedCsc(cscPath, false, true);
+		spMV(mappedCsc, vecIn.data(), vecOut.data());
+		std::cout << "mapped csc: largest difference = " << difference() << "\n";
+		MappedSparseBSR<double> mappedBsr(bsrPath, false, true);
+		spMV(mappedBsr, vecIn.data(), vecOut.data());
+		std::cout << "mapped bsr: largest difference = " << difference() << "\n";
+	}
+
+	std::vector<int> badCol(csr.col.get(), csr.col.get() + csr.nnz);
+	badCol[csr.nnz / 2] = csr.cols;
+	writeBinaryMatrix(csrPath, BINARY_CSR, csr.rows, csr.cols, csr.nnz, 1, csr.rowptr.get(), csr.rows + 1,
+		badCol.data(), csr.nnz, csr.data.get(), csr.nnz);
+	try {
+		MappedSparseCSR<double> corrupted(csrPath, false, true);
+		std::cout << "corrupted file was accepted\n";
+	} catch (const std::runtime_error &e) {
+		std::cout << "corrupted file: " << e.what() << "\n";
+	}
+	std::remove(csrPath);
+	std::remove(cscPath);
+	std::remove(bsrPath);
+}
+
+// jacobi pcg composed of one pass per step over the existing kernels (parallelSpMV, then separate
+// dot and axpy loops), the baseline the fused loop of solver.h is measured against
+CGResult composedJacobiPCG(const DynSparseSSS<double> &sss, const double *b, double *x, double tolerance,
+		int maxIterations) {
+	const int n = sss.n;
+	ThreadPool pool(cgThreads(n, defaultNumThreads()));
+	SSSPartition<double> partition(sss, pool.size());
+	std::vector<double> invDiag = inverseDiagonal(sss.dvalues.get(), n);
+	std::vector<double> r(n), z(n), p(n), q(n), partial(pool.size());
+	auto forEach = [&](auto body) {
+		pool.run([&](int tid) {
+			long begin, end;
+			splitRange(n, pool.size(), tid, begin, end);
+			for (long i = begin; i < end; i++) {
+				body(i);
+			}
+		});
+	};
+	auto dot = [&](const std::vector<double> &u, const std::vector<double> &v) {
+		pool.run([&](int tid) {
+			long begin, end;
+			splitRange(n, pool.size(), tid, begin, end);
+			double sum = 0;
+			for (long i = begin; i < end; i++) {
+				sum += u[i] * v[i];
+			}
+			partial[tid] = sum;
+		});
+		double sum = 0;
+		for (double s : partial) {
+			sum += s;
+		}
+		return sum;
+	};
+
+	parallelSpMV(sss, x, q.data(), partition, pool);
+	forEach([&](long i) { r[i] = b[i] - q[i]; });
+	forEach([&](long i) { z[i] = invDiag[i] * r[i]; });
+	forEach([&](long i) { p[i] = z[i]; });
+	double rz = dot(r, z);
+	double rr = dot(r, r);
+	const double bNorm = std::sqrt(std::inner_product(b, b + n, b, 0.0));
+
+	CGResult result = {};
+	result.bytesPerIteration = (double) n * sizeof(double) + (double) sss.lowerNnz * (sizeof(double) + sizeof(int))
+		+ (double) (n + 1) * sizeof(int) + (double) PCG_COMPOSED_VECTOR_STREAMS * n * sizeof(double);
+	auto start = std::chrono::steady_clock::now();
+	int k = 0;
+	while (std::sqrt(rr) > tolerance * bNorm && k < maxIterations) {
+		parallelSpMV(sss, p.data(), q.data(), partition, pool);
+		const double alpha = rz / dot(p, q);
+		forEach([&](long i) { x[i] += alpha * p[i]; });
+		forEach([&](long i) { r[i] -= alpha * q[i]; });
+		forEach([&](long i) { z[i] = invDiag[i] * r[i]; });
+		double rzNew = dot(r, z);
+		rr = dot(r, r);
+		const double beta = rzNew / rz;
+		rz = rzNew;
+		forEach([&](long i) { p[i] = z[i] + beta * p[i]; });
+		k++;
+	}
+	result.iterations = k;
+	result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	result.secondsPerIteration = k > 0 ? result.seconds / k : 0;
+	result.residual = bNorm > 0 ? std::sqrt(rr) / bNorm : 0;
+	result.converged = result.residual <= tolerance;
+	return result;
+}
+
+// solves a 2D Poisson problem (5-point stencil on an m x m grid) with rows and columns scaled by
+// 1 ... 10, by cg and jacobi-preconditioned cg on its SSS and CSR forms
+void reportCGSolvers() {
+	const int m = 300;
+	const int n = m * m;
+	std::vector<double> scale(n);
+	for (int i = 0; i < n; i++) {
+		scale[i] = 1 + 9.0 * rand() / RAND_MAX;
+	}
+	std::vector<int> row, col;
+	std::vector<double> val;
+	auto add = [&](int i, int j, double a) {
+		row.push_back(i);
+		col.push_back(j);
+		val.push_back(scale[i] * a * scale[j]);
+	};
+	for (int y = 0; y < m; y++) {
+		for (int x = 0; x < m; x++) {
+			int i = y * m + x;
+			add(i, i, 4);
+			if (x > 0) {
+				add(i, i - 1, -1);
+			}
+			if (x < m - 1) {
+				add(i, i + 1, -1);
+			}
+			if (y > 0) {
+				add(i, i - m, -1);
+			}
+			if (y < m - 1) {
+				add(i, i + m, -1);
+			}
+		}
+	}
+	DynSparseCSR<double> csr = buildCSR(n, n, (int) row.size(), row.data(), col.data(), val.data());
+	DynSparseSSS<double> sss = csrToSSS(csr);
+	std::vector<double> b(n, 1.0), x(n);
+	std::cout << "n = " << n << ", nnz = " << csr.nnz << "\n";
+
+	std::fill(x.begin(), x.end(), 0.0);
+	std::cout << "SSS CG:  " << conjugateGradient(sss, b.data(), x.data(), 1e-8, 10000);
+	std::fill(x.begin(), x.end(), 0.0);
+	CGResult pcg = jacobiPCG(sss, b.data(), x.data(), 1e-8, 10000);
+	std::cout << "SSS PCG: " << pcg;
+	std::fill(x.begin(), x.end(), 0.0);
+	std::cout << "CSR CG:  " << conjugateGradient(csr, b.data(), x.data(), 1e-8, 10000);
+	std::fill(x.begin(), x.end(), 0.0);
+	std::cout << "CSR PCG: " << jacobiPCG(csr, b.data(), x.data(), 1e-8, 10000);
+	std::fill(x.begin(), x.end(), 0.0);
+	CGResult composed = composedJacobiPCG(sss, b.data(), x.data(), 1e-8, 10000);
+	std::cout << "SSS PCG composed of separate passes: " << composed;
+	std::cout << "measured time per iteration: fused " << pcg.secondsPerIteration * 1e3 << " ms, composed "
+		<< composed.secondsPerIteration * 1e3 << " ms (" << composed.secondsPerIteration / pcg.secondsPerIteration
+		<< "x)\n";
+}
+
 int main() {
 	srand(time(NULL));
 	
@@ -86,12 +402,8 @@ int main() {
 	print1Darray<6, int>(vecOut);
 
 	// 4) tjds SpMV
-	// create copy of original input vector for reordering
-	int vecCpy[9];
-	for (int i = 0; i < 9; i++) {
-		vecCpy[i] = vecIn[i];
-	}
-
+	// built from the csc form, which leaves the dense matrix untouched. the column permutation is
+	// stored in the matrix, so the input vector is not reordered
 	std::cout << "---TJDS SpMV---\n";
 	int denseTjdsMat[6][9] = {};
 	createSparseMatTjds<6, 9, 1, 9, int>(11, 3, denseTjdsMat);
@@ -99,8 +411,9 @@ int main() {
 	print2Darray<6, 9, int>(denseTjdsMat);
 
 
-	SparseTJDS<6, 9, 11, 3, int> tjdsMat(denseTjdsMat, vecCpy);
-	spMV(tjdsMat, vecCpy, vecOut);
+	SparseCSC<6, 9, 11, int> tjdsCscMat(denseTjdsMat);
+	SparseTJDS<6, 9, 11, 3, int> tjdsMat(tjdsCscMat);
+	spMV(tjdsMat, vecIn, vecOut);
 	std::cout << "results:\n";
 	print1Darray<6, int>(vecOut);
 
@@ -117,6 +430,72 @@ int main() {
 	std::cout << "result:\n";
 	print1Darray<9, int>(vecOutSym);
 	
+	// 6) runtime-sized csr SpMV, same matrix as 1)
+	std::cout << "---Runtime-sized CSR SpMV---\n";
+	DynSparseCSR<int> dynCsrMat(6, 9, &denseMat[0][0]);
+	spMV(dynCsrMat, vecIn, vecOut);
+	std::cout << "result:\n";
+	print1Darray<6, int>(vecOut);
+
+	// 7) hybrid ELL + COO SpMV, same matrix as 3), with an explicit ELL width of 2 so that the elements
+	// of the maxed row past the second spill into the COO tail (the width chooseWidth picks for a
+	// matrix this small depends on the random rows and may be 0, which leaves everything in the tail)
+	std::cout << "---HYB SpMV---\n";
+	SparseHYB<int> hybMat(DynSparseCSR<int>(6, 9, &denseEllMat[0][0]), 2);
+	std::cout << "ell width = " << hybMat.k << "\n" << hybMat;
+	spMV(hybMat, vecIn, vecOut);
+	std::cout << "result:\n";
+	print1Darray<6, int>(vecOut);
+
+	// 8) diagonal (DIA) SpMV on a tridiagonal matrix, whose three diagonals are full
+	std::cout << "---DIA SpMV---\n";
+	int denseDiaMat[6][9] = {};
+	for (int i = 0; i < 6; i++) {
+		for (int j = std::max(0, i - 1); j <= i + 1; j++) {
+			denseDiaMat[i][j] = 1 + rand() % 9;
+		}
+	}
+	std::cout << "matrix:\n";
+	print2Darray<6, 9, int>(denseDiaMat);
+
+	DynSparseCSR<int> diaCsrMat(6, 9, &denseDiaMat[0][0]);
+	DIAReport diaReport = analyzeDiagonals(diaCsrMat);
+	std::cout << "diagonals = " << diaReport.numDiags << ", fill = " << diaReport.fill << ", bytes per spMV: csr "
+		<< diaReport.csrBytes << ", dia " << diaReport.diaBytes << "\n";
+	SparseDIA<int> diaMat(diaCsrMat);
+	std::cout << diaMat;
+	spMV(diaMat, vecIn, vecOut);
+	std::cout << "result:\n";
+	print1Darray<6, int>(vecOut);
+
+	// 9) reverse Cuthill-McKee reordering of the matrix of 5), the permuted SpMV keeps the original
+	// numbering and gives the same result as 5)
+	std::cout << "---RCM-reordered CSR SpMV---\n";
+	DynSparseCSR<int> symCsrMat(9, 9, &denseSssMat[0][0]);
+	std::vector<int> perm = rcmOrdering(symCsrMat);
+	DynSparseCSR<int> rcmMat = permuteSymmetric(symCsrMat, perm);
+	std::cout << "before: " << bandwidthProfile(symCsrMat) << "after:  " << bandwidthProfile(rcmMat);
+	int work[18];
+	permutedSpMV(rcmMat, perm, vecIn, vecOutSym, work);
+	std::cout << "result:\n";
+	print1Darray<9, int>(vecOutSym);
+
+	// 10) multithreaded csr SpMV with nnz-balanced row partitioning and merge-path partitioning
+	std::cout << "---Parallel CSR SpMV scaling---\n";
+	reportCSRScaling();
+
+	// 11) inspector-executor plan: partition and kernel chosen once, then reused for every call
+	std::cout << "---Planned CSR SpMV---\n";
+	reportPlanAmortization();
+
+	// 12) automatic format selection, timed once and then read back from a cache file
+	std::cout << "---Format selection---\n";
+	reportFormatSelection();
+
+	// 13) binary container round trip: save, memory-map with index checks, spMV on the mapping
+	std::cout << "---Memory-mapped binary matrices---\n";
+	reportBinaryRoundTrip();
+
 	// ---Sparse Matrix Matrix Multiplication Algorithms---	
 	std::cout << "\n======Matrix Matrix Multiplication======\n";
 	double dense1[5][8] = {};
@@ -160,6 +539,21 @@ int main() {
 	columnWiseProductSpMM(aCSC, bCSC, denseOutColumnWise);
 	std::cout << "---column-wise product SpMM---\n";
 	print2Darray<5, 4, double>(denseOutColumnWise);
-	
+
+	// 5) sparse x dense multi-vector product, matrix 2 used as 4 right-hand sides
+	double denseOutMulti[5][4] = { 0.0 };
+	spMM(aCSR, dense2, denseOutMulti);
+	std::cout << "---sparse x dense (4 vectors) SpMM---\n";
+	print2Darray<5, 4, double>(denseOutMulti);
+
+	// 6) sparse-output gustavson product, same result as 3) without a dense output matrix
+	DynSparseCSR<double> sparseOut = gustavsonSpGEMM(aCSR, bCSR);
+	std::cout << "---sparse-output gustavson SpGEMM---\n";
+	std::cout << sparseOut;
+
+	// ---Linear Solvers---
+	std::cout << "\n======Conjugate Gradient======\n";
+	reportCGSolvers();
+
 	return 0;
 }